@@ -0,0 +1,424 @@
+/*
+ * filters_bench: throughput micro-benchmarks for Filters,
+ * DitheringAndQuantization, ColorSpace and the drawing primitives.
+ *
+ * Every function is run over a matrix of image sizes, pixel formats and
+ * parameters on synthetic, deterministic inputs. Each case is warmed up, then
+ * timed several times; the median and 95th percentile are reported in
+ * milliseconds and as megapixels per second. Results can be written as JSON
+ * to track regressions between releases.
+ *
+ *   filters_bench [--sizes 1,10,100] [--formats rgb32,gray8] [--filter name]
+ *                 [--warmup N] [--repeat N] [--json results.json]
+ */
+#include "colorspace.h"
+#include "ditheringandquantization.h"
+#include "drawingengine.h"
+#include "filters.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QColor>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPoint>
+#include <QString>
+#include <QStringList>
+#include <QSysInfo>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace {
+struct Case {
+  QString name;   ///< Function name, e.g. "applyMedianFilter".
+  QString params; ///< Parameter description, e.g. "kernelSize=5".
+  std::function<QImage(const QImage &)> run;
+};
+
+struct Settings {
+  std::vector<double> sizes{1, 10, 100};
+  QStringList formats{"rgb32", "gray8"};
+  QString filter;
+  int warmup = 1;
+  int repeat = 5;
+  QString jsonPath;
+};
+
+/* Deterministic test image: smooth gradients plus xorshift noise, so that
+ * both flat areas and a realistic number of distinct colors are present. */
+QImage syntheticImage(double megapixels, QImage::Format format) {
+  int width = int(std::lround(std::sqrt(megapixels * 1e6 * 4.0 / 3.0)));
+  int height = int(std::lround(megapixels * 1e6 / width));
+  QImage image(width, height, QImage::Format_RGB32);
+
+  quint32 state = 0x9e3779b9u;
+  for (int y = 0; y < height; ++y) {
+    QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+    for (int x = 0; x < width; ++x) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      int noise = int(state & 31) - 16;
+      int r = qBound(0, x * 255 / width + noise, 255);
+      int g = qBound(0, y * 255 / height + noise, 255);
+      int b = qBound(0, ((x + y) & 255) + noise, 255);
+      line[x] = qRgb(r, g, b);
+    }
+  }
+  return image.convertToFormat(format);
+}
+
+/* Converts every row to a color space and back, through planar rows. */
+template <typename T>
+QImage roundTrip(const QImage &image,
+                 void (*to)(const QRgb *, int, ColorSpace::Channels<T>),
+                 void (*from)(ColorSpace::Channels<const T>, int, QRgb *)) {
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  const int width = src.width();
+  std::vector<T> planes(size_t(width) * 3);
+  T *c0 = planes.data(), *c1 = c0 + width, *c2 = c1 + width;
+  for (int y = 0; y < src.height(); ++y) {
+    to(reinterpret_cast<const QRgb *>(src.constScanLine(y)), width,
+       ColorSpace::Channels<T>::planar(c0, c1, c2));
+    from(ColorSpace::Channels<const T>::planar(c0, c1, c2), width,
+         reinterpret_cast<QRgb *>(dst.scanLine(y)));
+  }
+  return dst;
+}
+
+using Primitive =
+    std::function<void(QImage &, QPoint, QPoint, const QColor &)>;
+
+/* Draws count primitives between deterministic pseudo-random points on a
+ * copy of the image. The points are spread over spread times the canvas in
+ * each direction, centred on it, so with a spread above 1 most primitives
+ * reach off the canvas and have to be clipped. */
+QImage drawShapes(const QImage &image, int count, int spread,
+                  const Primitive &draw) {
+  QImage canvas = image.copy();
+  const int w = image.width(), h = image.height();
+  quint32 state = 0x2545f491u;
+  auto next = [&](int range) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return int(state % quint32(range));
+  };
+  auto point = [&]() {
+    return QPoint(next(spread * w) - (spread - 1) * w / 2,
+                  next(spread * h) - (spread - 1) * h / 2);
+  };
+  for (int i = 0; i < count; ++i) {
+    const QPoint a = point(), b = point();
+    draw(canvas, a, b, QColor(next(256), next(256), next(256)));
+  }
+  return canvas;
+}
+
+std::vector<Case> allCases() {
+  using namespace Filters;
+  using namespace DitheringAndQuantization;
+  std::vector<Case> cases;
+
+  cases.push_back({"invert", "", [](const QImage &im) { return invert(im); }});
+  cases.push_back({"adjustBrightness", "delta=20", [](const QImage &im) {
+                     return adjustBrightness(im, 20);
+                   }});
+  cases.push_back({"adjustContrast", "factor=1.5", [](const QImage &im) {
+                     return adjustContrast(im, 1.5);
+                   }});
+  cases.push_back({"adjustGamma", "gamma=0.8", [](const QImage &im) {
+                     return adjustGamma(im, 0.8);
+                   }});
+  cases.push_back(
+      {"blur3x3", "", [](const QImage &im) { return blur3x3(im); }});
+  cases.push_back({"gaussianBlur3x3", "",
+                   [](const QImage &im) { return gaussianBlur3x3(im); }});
+  cases.push_back(
+      {"sharpen3x3", "", [](const QImage &im) { return sharpen3x3(im); }});
+  cases.push_back({"edgeDetect3x3", "",
+                   [](const QImage &im) { return edgeDetect3x3(im); }});
+  cases.push_back(
+      {"emboss3x3", "", [](const QImage &im) { return emboss3x3(im); }});
+
+  for (int k : {3, 5, 7, 9}) {
+    QVector<QVector<int>> kernel(k, QVector<int>(k, 1));
+    cases.push_back({"applyConvolution", QString("kernel=%1x%1").arg(k),
+                     [kernel, k](const QImage &im) {
+                       return applyConvolution(im, kernel, k * k, 0, k / 2,
+                                               k / 2);
+                     }});
+  }
+  for (int k : {3, 5, 7}) {
+    QString p = QString("kernelSize=%1").arg(k);
+    cases.push_back({"applyMedianFilter", p, [k](const QImage &im) {
+                       return applyMedianFilter(im, k);
+                     }});
+    cases.push_back({"applyErosionFilter", p, [k](const QImage &im) {
+                       return applyErosionFilter(im, k);
+                     }});
+    cases.push_back({"applyDilationFilter", p, [k](const QImage &im) {
+                       return applyDilationFilter(im, k);
+                     }});
+  }
+  for (int n : {2, 4, 6, 16, 64}) {
+    for (int levels : {2, 4, 8}) {
+      QString p = QString("map=%1 levels=%2").arg(n).arg(levels);
+      cases.push_back({"applyOrderedDithering", p,
+                       [n, levels](const QImage &im) {
+                         return applyOrderedDithering(im, n, levels);
+                       }});
+      cases.push_back({"applyOrderedDitheringInYCbCr", p,
+                       [n, levels](const QImage &im) {
+                         return applyOrderedDitheringInYCbCr(im, n, levels);
+                       }});
+    }
+  }
+  for (int levels : {2, 4, 8}) {
+    cases.push_back({"applyBlueNoiseDithering",
+                     QString("levels=%1").arg(levels),
+                     [levels](const QImage &im) {
+                       return applyBlueNoiseDithering(im, levels);
+                     }});
+  }
+  cases.push_back({"applyOrderedDithering", "map=8 levels=4 indexed",
+                   [](const QImage &im) {
+                     return applyOrderedDithering(im, 8, 4,
+                                                  OutputFormat::Indexed8);
+                   }});
+  cases.push_back({"equalizeHistogram", "mode=luma", [](const QImage &im) {
+                     return equalizeHistogram(im);
+                   }});
+  cases.push_back({"equalizeHistogram", "mode=rgb", [](const QImage &im) {
+                     return equalizeHistogram(im, HistogramMode::PerChannel);
+                   }});
+  for (int tiles : {4, 8, 16}) {
+    cases.push_back({"applyCLAHE", QString("tiles=%1 clip=2").arg(tiles),
+                     [tiles](const QImage &im) {
+                       return applyCLAHE(im, tiles, tiles, 2.0);
+                     }});
+  }
+  const std::pair<DiffusionKernel, const char *> kernels[] = {
+      {DiffusionKernel::FloydSteinberg, "fs"},
+      {DiffusionKernel::JarvisJudiceNinke, "jjn"},
+      {DiffusionKernel::Atkinson, "atkinson"}};
+  for (const auto &kernel : kernels) {
+    DiffusionKernel k = kernel.first;
+    cases.push_back({"applyErrorDiffusion",
+                     QString("kernel=%1 levels=2").arg(kernel.second),
+                     [k](const QImage &im) {
+                       return applyErrorDiffusion(im, k, 2);
+                     }});
+  }
+  cases.push_back({"applyErrorDiffusion", "kernel=fs levels=2 serpentine",
+                   [](const QImage &im) {
+                     return applyErrorDiffusion(
+                         im, DiffusionKernel::FloydSteinberg, 2, true);
+                   }});
+  for (int colors : {16, 64, 256}) {
+    cases.push_back({"applyPopularityQuantization",
+                     QString("colors=%1").arg(colors),
+                     [colors](const QImage &im) {
+                       return applyPopularityQuantization(im, colors);
+                     }});
+  }
+  cases.push_back({"applyPopularityQuantization", "colors=256 bits=6",
+                   [](const QImage &im) {
+                     return applyPopularityQuantization(im, 256, 6);
+                   }});
+  cases.push_back({"applyPopularityQuantization", "colors=256 indexed",
+                   [](const QImage &im) {
+                     return applyPopularityQuantization(
+                         im, 256, 8, OutputFormat::Indexed8);
+                   }});
+  for (int colors : {16, 256}) {
+    cases.push_back({"applyMedianCutQuantization",
+                     QString("colors=%1").arg(colors),
+                     [colors](const QImage &im) {
+                       return applyMedianCutQuantization(im, colors);
+                     }});
+    cases.push_back({"applyOctreeQuantization",
+                     QString("colors=%1").arg(colors),
+                     [colors](const QImage &im) {
+                       return applyOctreeQuantization(im, colors);
+                     }});
+    cases.push_back({"applyKMeansQuantization",
+                     QString("colors=%1").arg(colors),
+                     [colors](const QImage &im) {
+                       return applyKMeansQuantization(im, colors);
+                     }});
+  }
+  cases.push_back({"ColorSpace::rgbToYCbCr", "round trip",
+                   [](const QImage &im) {
+                     return roundTrip(im, ColorSpace::rgbToYCbCr,
+                                      ColorSpace::yCbCrToRgb);
+                   }});
+  cases.push_back({"ColorSpace::rgbToHsv", "round trip", [](const QImage &im) {
+                     return roundTrip(im, ColorSpace::rgbToHsv,
+                                      ColorSpace::hsvToRgb);
+                   }});
+  cases.push_back({"ColorSpace::rgbToLinear", "round trip",
+                   [](const QImage &im) {
+                     return roundTrip(im, ColorSpace::rgbToLinear,
+                                      ColorSpace::linearToRgb);
+                   }});
+  cases.push_back({"ColorSpace::rgbToLab", "round trip", [](const QImage &im) {
+                     return roundTrip(im, ColorSpace::rgbToLab,
+                                      ColorSpace::labToRgb);
+                   }});
+
+  // Circles are centred on the first point and reach the second.
+  auto radius = [](QPoint a, QPoint b) {
+    return int(std::hypot(double(b.x() - a.x()), double(b.y() - a.y())));
+  };
+  const std::pair<const char *, Primitive> primitives[] = {
+      {"drawLineDDA",
+       [](QImage &im, QPoint a, QPoint b, const QColor &c) {
+         drawLineDDA(im, a.x(), a.y(), b.x(), b.y(), c);
+       }},
+      {"drawLineWu",
+       [](QImage &im, QPoint a, QPoint b, const QColor &c) {
+         drawLineWu(im, a.x(), a.y(), b.x(), b.y(), c);
+       }},
+      {"drawCircleMidpoint",
+       [radius](QImage &im, QPoint a, QPoint b, const QColor &c) {
+         drawCircleMidpoint(im, a.x(), a.y(), radius(a, b), c);
+       }},
+      {"drawCircleWu",
+       [radius](QImage &im, QPoint a, QPoint b, const QColor &c) {
+         drawCircleWu(im, a.x(), a.y(), radius(a, b), c);
+       }}};
+  for (const auto &primitive : primitives) {
+    for (int spread : {1, 20}) {
+      const Primitive draw = primitive.second;
+      cases.push_back({primitive.first,
+                       QString("count=1000 spread=%1").arg(spread),
+                       [draw, spread](const QImage &im) {
+                         return drawShapes(im, 1000, spread, draw);
+                       }});
+    }
+  }
+  return cases;
+}
+
+double percentile(std::vector<double> sorted, double p) {
+  std::sort(sorted.begin(), sorted.end());
+  double rank = p * (sorted.size() - 1);
+  size_t lo = size_t(std::floor(rank));
+  size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+bool parseArgs(int argc, char *argv[], Settings &s) {
+  for (int i = 1; i < argc; ++i) {
+    QString arg = QString::fromLocal8Bit(argv[i]);
+    auto next = [&]() {
+      return i + 1 < argc ? QString::fromLocal8Bit(argv[++i]) : QString();
+    };
+    if (arg == "--sizes") {
+      s.sizes.clear();
+      for (const QString &v : next().split(',', Qt::SkipEmptyParts))
+        s.sizes.push_back(v.toDouble());
+    } else if (arg == "--formats") {
+      s.formats = next().split(',', Qt::SkipEmptyParts);
+    } else if (arg == "--filter") {
+      s.filter = next();
+    } else if (arg == "--warmup") {
+      s.warmup = std::max(0, next().toInt());
+    } else if (arg == "--repeat") {
+      s.repeat = std::max(1, next().toInt());
+    } else if (arg == "--json") {
+      s.jsonPath = next();
+    } else {
+      std::fprintf(stderr,
+                   "Usage: filters_bench [--sizes 1,10,100] "
+                   "[--formats rgb32,gray8] [--filter name] [--warmup N] "
+                   "[--repeat N] [--json results.json]\n");
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  if (!parseArgs(argc, argv, settings))
+    return 1;
+
+  const std::vector<Case> cases = allCases();
+  QJsonArray results;
+
+  std::printf("%-30s %-20s %-6s %8s %10s %10s %9s\n", "function", "params",
+              "format", "MP", "median ms", "p95 ms", "MP/s");
+
+  for (double mp : settings.sizes) {
+    for (const QString &formatName : settings.formats) {
+      QImage::Format format = formatName == "gray8"
+                                  ? QImage::Format_Grayscale8
+                                  : QImage::Format_RGB32;
+      QImage input = syntheticImage(mp, format);
+      double actualMp = double(input.width()) * input.height() / 1e6;
+
+      for (const Case &c : cases) {
+        if (!settings.filter.isEmpty() && !c.name.contains(settings.filter))
+          continue;
+
+        for (int i = 0; i < settings.warmup; ++i)
+          c.run(input);
+
+        std::vector<double> samples;
+        for (int i = 0; i < settings.repeat; ++i) {
+          QElapsedTimer timer;
+          timer.start();
+          QImage out = c.run(input);
+          samples.push_back(timer.nsecsElapsed() / 1e6);
+        }
+        double median = percentile(samples, 0.5);
+        double p95 = percentile(samples, 0.95);
+        double throughput = actualMp / (median / 1e3);
+
+        std::printf("%-30s %-20s %-6s %8.2f %10.2f %10.2f %9.2f\n",
+                    qPrintable(c.name), qPrintable(c.params),
+                    qPrintable(formatName), actualMp, median, p95, throughput);
+        std::fflush(stdout);
+
+        QJsonObject entry;
+        entry["function"] = c.name;
+        entry["params"] = c.params;
+        entry["format"] = formatName;
+        entry["width"] = input.width();
+        entry["height"] = input.height();
+        entry["megapixels"] = actualMp;
+        entry["medianMs"] = median;
+        entry["p95Ms"] = p95;
+        entry["megapixelsPerSecond"] = throughput;
+        entry["repeat"] = settings.repeat;
+        results.append(entry);
+      }
+    }
+  }
+
+  if (!settings.jsonPath.isEmpty()) {
+    QJsonObject root;
+    root["benchmark"] = "filters_bench";
+    root["cpu"] = QSysInfo::currentCpuArchitecture();
+    root["os"] = QSysInfo::prettyProductName();
+    root["warmup"] = settings.warmup;
+    root["results"] = results;
+    QFile file(settings.jsonPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+      std::fprintf(stderr, "Cannot write %s\n", qPrintable(settings.jsonPath));
+      return 1;
+    }
+    file.write(QJsonDocument(root).toJson());
+  }
+  return 0;
+}
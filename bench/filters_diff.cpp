@@ -0,0 +1,847 @@
+/*
+ * filters_diff: differential harness for the optimized image operations.
+ *
+ * Runs every function in Filters and DitheringAndQuantization, and the
+ * drawing primitives, against its frozen reference implementation
+ * (referencefilters.h) on randomized images and parameters, and reports the
+ * max/mean absolute error and PSNR per function. A function passes when its
+ * max error stays within its documented tolerance, which is 0 (bit-exact)
+ * unless listed otherwise below. Checks
+ * that do not depend on an input image, such as that of the embedded
+ * blue-noise table, run once.
+ *
+ *   filters_diff [--seed N] [--iterations N] [--verbose]
+ *
+ * Exits with status 1 if any function exceeds its tolerance.
+ */
+#include "bluenoise.h"
+#include "colorspace.h"
+#include "ditheringandquantization.h"
+#include "drawingengine.h"
+#include "filters.h"
+#include "parallel.h"
+#include "referencefilters.h"
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+using Rng = std::mt19937;
+
+/* Per-channel error statistics of one comparison. */
+struct Diff {
+  bool sizeMismatch = false;
+  int maxError = 0;
+  double sumError = 0;
+  double sumSquared = 0;
+  qint64 samples = 0;
+};
+
+/* Statistics accumulated per function over all iterations. */
+struct Summary {
+  int tolerance = 0;
+  int cases = 0;
+  int failures = 0;
+  Diff total;
+};
+
+int randomInt(Rng &rng, int lo, int hi) {
+  return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+/* The image as Format_Indexed8, with a color table of its first 256
+ * distinct colors; later colors map to entry 0. Dithered and quantized
+ * results come as such images, and the filters must accept them. */
+QImage indexed(const QImage &image) {
+  QVector<QRgb> table;
+  std::map<QRgb, int> index;
+  for (int y = 0; y < image.height(); ++y)
+    for (int x = 0; x < image.width() && table.size() < 256; ++x)
+      if (index.emplace(image.pixel(x, y), table.size()).second)
+        table.append(image.pixel(x, y));
+
+  QImage result(image.size(), QImage::Format_Indexed8);
+  result.setColorTable(table);
+  for (int y = 0; y < image.height(); ++y) {
+    for (int x = 0; x < image.width(); ++x) {
+      auto it = index.find(image.pixel(x, y));
+      result.setPixel(x, y, it == index.end() ? 0 : it->second);
+    }
+  }
+  return result;
+}
+
+/* Random image with a mix of noise, gradients and flat regions, so that
+ * quantizers see both many and few distinct colors. */
+QImage randomImage(Rng &rng) {
+  int width = randomInt(rng, 1, 97);
+  int height = randomInt(rng, 1, 97);
+  int style = randomInt(rng, 0, 2);
+  int flatColors = randomInt(rng, 1, 12);
+  std::vector<QRgb> flat(flatColors);
+  for (QRgb &c : flat)
+    c = qRgb(randomInt(rng, 0, 255), randomInt(rng, 0, 255),
+             randomInt(rng, 0, 255));
+
+  QImage image(width, height, QImage::Format_RGB32);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      QRgb c;
+      if (style == 0) {
+        c = qRgb(randomInt(rng, 0, 255), randomInt(rng, 0, 255),
+                 randomInt(rng, 0, 255));
+      } else if (style == 1) {
+        c = qRgb(x * 255 / width, y * 255 / height, (x * y) & 255);
+      } else {
+        c = flat[randomInt(rng, 0, flatColors - 1)];
+      }
+      image.setPixel(x, y, c);
+    }
+  }
+
+  switch (randomInt(rng, 0, 4)) {
+  case 0:
+    return image.convertToFormat(QImage::Format_Grayscale8);
+  case 1:
+    return image.convertToFormat(QImage::Format_ARGB32);
+  case 2:
+    return indexed(image);
+  default:
+    return image;
+  }
+}
+
+QVector<QVector<int>> randomKernel(Rng &rng) {
+  int rows = randomInt(rng, 1, 7);
+  int cols = randomInt(rng, 1, 7);
+  QVector<QVector<int>> kernel(rows, QVector<int>(cols));
+  for (auto &row : kernel)
+    for (int &v : row)
+      v = randomInt(rng, -5, 9);
+  return kernel;
+}
+
+QVector<QRgb> randomPalette(Rng &rng) {
+  QVector<QRgb> palette(randomInt(rng, 1, 16));
+  for (QRgb &c : palette)
+    c = qRgb(randomInt(rng, 0, 255), randomInt(rng, 0, 255),
+             randomInt(rng, 0, 255));
+  return palette;
+}
+
+/* The input tiled to at least minPixels pixels, and at least as wide as
+ * before: the images of randomImage() are too small for the row loops to
+ * use more than one thread. */
+QImage tiled(const QImage &image, int minPixels) {
+  const int width = image.width();
+  const int height = std::max(image.height(), (minPixels + width - 1) / width);
+  QImage result(width, height, QImage::Format_RGB32);
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      result.setPixel(x, y, image.pixel(x, y % image.height()));
+  return result;
+}
+
+/* The input as the 32-bit canvas the editor draws on. */
+QImage canvas(const QImage &image) {
+  return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32
+                                                       : QImage::Format_RGB32);
+}
+
+QColor randomColor(Rng &rng) {
+  return QColor(randomInt(rng, 0, 255), randomInt(rng, 0, 255),
+                randomInt(rng, 0, 255));
+}
+
+/* A point on or around the canvas; one in eight lies far off it, so that
+ * the primitives have to clip. */
+QPoint randomPoint(Rng &rng, const QImage &image) {
+  if (randomInt(rng, 0, 7) == 0)
+    return QPoint(randomInt(rng, -20000, 20000), randomInt(rng, -20000, 20000));
+  return QPoint(randomInt(rng, -image.width(), 2 * image.width()),
+                randomInt(rng, -image.height(), 2 * image.height()));
+}
+
+/* Whether some step of the DDA line from a to b lands exactly half-way
+ * between two pixels. The optimized line rounds such ties up; the reference
+ * rounds them as its accumulated error happens to fall. */
+bool hasDdaTie(const QPoint &a, const QPoint &b) {
+  const int dx = std::abs(b.x() - a.x()), dy = std::abs(b.y() - a.y());
+  const int steps = std::max(dx, dy);
+  return steps > 0 && steps / std::gcd(std::min(dx, dy), steps) % 2 == 0;
+}
+
+/* A random point that continues a DDA line or stroke from `from` without
+ * half-pixel ties. */
+QPoint randomDdaPoint(Rng &rng, const QImage &image, const QPoint &from) {
+  QPoint p;
+  do
+    p = randomPoint(rng, image);
+  while (hasDdaTie(from, p));
+  return p;
+}
+
+/* A random polygon with every vertex on a row of the image, as the
+ * reference fill requires; columns may lie off the canvas. */
+QVector<QPoint> randomPolygon(Rng &rng, const QImage &image) {
+  QVector<QPoint> polygon(randomInt(rng, 3, 9));
+  for (QPoint &p : polygon)
+    p = QPoint(randomInt(rng, -image.width(), 2 * image.width()),
+               randomInt(rng, 0, image.height() - 1));
+  return polygon;
+}
+
+QImage randomPattern(Rng &rng) {
+  QImage pattern(randomInt(rng, 1, 8), randomInt(rng, 1, 8),
+                 QImage::Format_RGB32);
+  for (int y = 0; y < pattern.height(); ++y)
+    for (int x = 0; x < pattern.width(); ++x)
+      pattern.setPixel(x, y, randomColor(rng).rgb());
+  return pattern;
+}
+
+Diff compare(const QImage &a, const QImage &b) {
+  Diff d;
+  if (a.size() != b.size()) {
+    d.sizeMismatch = true;
+    return d;
+  }
+  for (int y = 0; y < a.height(); ++y) {
+    for (int x = 0; x < a.width(); ++x) {
+      QRgb pa = a.pixel(x, y), pb = b.pixel(x, y);
+      int errors[] = {std::abs(qRed(pa) - qRed(pb)),
+                      std::abs(qGreen(pa) - qGreen(pb)),
+                      std::abs(qBlue(pa) - qBlue(pb))};
+      for (int e : errors) {
+        d.maxError = std::max(d.maxError, e);
+        d.sumError += e;
+        d.sumSquared += double(e) * e;
+      }
+      d.samples += 3;
+    }
+  }
+  return d;
+}
+
+double psnr(const Diff &d) {
+  if (d.samples == 0 || d.sumSquared == 0)
+    return std::numeric_limits<double>::infinity();
+  double mse = d.sumSquared / d.samples;
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+struct Check {
+  QString name;
+  int tolerance; ///< Max allowed absolute error per channel.
+  std::function<void(Rng &, const QImage &, QImage &, QImage &)> run;
+};
+
+/* Runs an operation with Indexed8 and with RGB32 output, for checking that
+ * the two agree. An Indexed8 result of another format fails as a size
+ * mismatch. */
+void compareIndexed(
+    const std::function<QImage(DitheringAndQuantization::OutputFormat)> &run,
+    QImage &opt, QImage &ref) {
+  using DitheringAndQuantization::OutputFormat;
+  const QImage indexed = run(OutputFormat::Indexed8);
+  opt = indexed.format() == QImage::Format_Indexed8
+            ? indexed.convertToFormat(QImage::Format_RGB32)
+            : QImage();
+  ref = run(OutputFormat::RGB32);
+}
+
+/* A check that does not depend on the input image; runs once. */
+struct FixedCheck {
+  QString name;
+  int tolerance;
+  std::function<Diff()> run;
+};
+
+/* Adds the absolute difference of two values to d. */
+void accumulate(Diff &d, int a, int b) {
+  const int e = std::abs(a - b);
+  d.maxError = std::max(d.maxError, e);
+  d.sumError += e;
+  d.sumSquared += double(e) * e;
+  ++d.samples;
+}
+
+/* Scalar double-precision forms of the ColorSpace conversions, the
+ * formulas the batch conversions approximate in single precision. Each
+ * maps three channels in place. */
+struct ScalarConversion {
+  void (*fromRgb)(double c[3]);
+  void (*toRgb)(double c[3]);
+};
+
+double decodeSrgb(double v) {
+  return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+}
+
+double encodeSrgb(double linear) {
+  linear = std::clamp(linear, 0.0, 1.0);
+  return linear <= 0.0031308 ? 12.92 * linear
+                             : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+}
+
+void linearFromRgb(double c[3]) {
+  for (int k = 0; k < 3; ++k)
+    c[k] = decodeSrgb(c[k] / 255);
+}
+
+void linearToRgb(double c[3]) {
+  for (int k = 0; k < 3; ++k)
+    c[k] = encodeSrgb(c[k]) * 255;
+}
+
+void hsvFromRgb(double c[3]) {
+  const double r = c[0] / 255, g = c[1] / 255, b = c[2] / 255;
+  const double high = std::max({r, g, b});
+  const double delta = high - std::min({r, g, b});
+  double hue = 0;
+  if (delta > 0) {
+    if (high == r)
+      hue = std::fmod((g - b) / delta + 6, 6);
+    else if (high == g)
+      hue = 2 + (b - r) / delta;
+    else
+      hue = 4 + (r - g) / delta;
+  }
+  c[0] = hue * 60;
+  c[1] = high > 0 ? delta / high : 0;
+  c[2] = high;
+}
+
+void hsvToRgb(double c[3]) {
+  const double sector = std::fmod(c[0] / 60, 6);
+  const double chroma = c[2] * c[1];
+  const double x = chroma * (1 - std::abs(std::fmod(sector, 2) - 1));
+  const double m = c[2] - chroma;
+  const double rgb[6][3] = {{chroma, x, 0}, {x, chroma, 0}, {0, chroma, x},
+                            {0, x, chroma}, {x, 0, chroma}, {chroma, 0, x}};
+  const double *p = rgb[std::min(5, int(sector))];
+  for (int k = 0; k < 3; ++k)
+    c[k] = (p[k] + m) * 255;
+}
+
+constexpr double WhiteX = 0.95047, WhiteZ = 1.08883;
+constexpr double Delta = 6.0 / 29;
+
+double labF(double t) {
+  return t > Delta * Delta * Delta ? std::cbrt(t)
+                                   : t / (3 * Delta * Delta) + 4.0 / 29;
+}
+
+double labFInverse(double f) {
+  return f > Delta ? f * f * f : 3 * Delta * Delta * (f - 4.0 / 29);
+}
+
+void labFromRgb(double c[3]) {
+  linearFromRgb(c);
+  const double x =
+      (0.4124564 * c[0] + 0.3575761 * c[1] + 0.1804375 * c[2]) / WhiteX;
+  const double y = 0.2126729 * c[0] + 0.7151522 * c[1] + 0.0721750 * c[2];
+  const double z =
+      (0.0193339 * c[0] + 0.1191920 * c[1] + 0.9503041 * c[2]) / WhiteZ;
+  c[0] = 116 * labF(y) - 16;
+  c[1] = 500 * (labF(x) - labF(y));
+  c[2] = 200 * (labF(y) - labF(z));
+}
+
+void labToRgb(double c[3]) {
+  const double fy = (c[0] + 16) / 116;
+  const double x = WhiteX * labFInverse(fy + c[1] / 500);
+  const double y = labFInverse(fy);
+  const double z = WhiteZ * labFInverse(fy - c[2] / 200);
+  c[0] = 3.2404542 * x - 1.5371385 * y - 0.4985314 * z;
+  c[1] = -0.9692660 * x + 1.8760108 * y + 0.0415560 * z;
+  c[2] = 0.0556434 * x - 0.2040259 * y + 1.0572252 * z;
+  linearToRgb(c);
+}
+
+/* Converts every 8-bit color to a color space and back, three ways: both
+ * directions with ColorSpace, ColorSpace there and the scalar formula back,
+ * and the scalar formula there and ColorSpace back. Each must give back
+ * the input color. */
+Diff roundTrip(void (*there)(const QRgb *, int, ColorSpace::Channels<float>),
+               void (*back)(ColorSpace::Channels<const float>, int, QRgb *),
+               ScalarConversion scalar) {
+  constexpr int Run = 1 << 16;
+  std::vector<QRgb> in(Run), out(Run);
+  std::vector<float> converted(3 * Run), exact(3 * Run);
+  Diff d;
+  auto compare = [&](int i, QRgb result) {
+    accumulate(d, qRed(in[i]), qRed(result));
+    accumulate(d, qGreen(in[i]), qGreen(result));
+    accumulate(d, qBlue(in[i]), qBlue(result));
+  };
+  for (int red = 0; red < 256; ++red) {
+    for (int i = 0; i < Run; ++i)
+      in[i] = qRgb(red, i >> 8, i & 255);
+
+    there(in.data(), Run,
+          ColorSpace::Channels<float>::interleaved(converted.data()));
+    back(ColorSpace::Channels<const float>::interleaved(converted.data()),
+         Run, out.data());
+    for (int i = 0; i < Run; ++i)
+      compare(i, out[i]);
+
+    for (int i = 0; i < Run; ++i) {
+      double c[3] = {converted[3 * i], converted[3 * i + 1],
+                     converted[3 * i + 2]};
+      scalar.toRgb(c);
+      auto channel = [&](int k) {
+        return std::clamp(int(std::lround(c[k])), 0, 255);
+      };
+      compare(i, qRgb(channel(0), channel(1), channel(2)));
+
+      double e[3] = {double(qRed(in[i])), double(qGreen(in[i])),
+                     double(qBlue(in[i]))};
+      scalar.fromRgb(e);
+      for (int k = 0; k < 3; ++k)
+        exact[3 * i + k] = float(e[k]);
+    }
+    back(ColorSpace::Channels<const float>::interleaved(exact.data()), Run,
+         out.data());
+    for (int i = 0; i < Run; ++i)
+      compare(i, out[i]);
+  }
+  return d;
+}
+
+std::vector<FixedCheck> fixedChecks() {
+  std::vector<FixedCheck> checks;
+  // mask() is an embedded table; it must be what the generator produces.
+  checks.push_back({"BlueNoise::mask", 0, []() {
+                      Diff d;
+                      const std::vector<int> &table = BlueNoise::mask();
+                      const std::vector<int> generated =
+                          BlueNoise::generateMask();
+                      d.sizeMismatch = table.size() != generated.size();
+                      for (size_t i = 0; !d.sizeMismatch && i < table.size();
+                           ++i)
+                        accumulate(d, table[i], generated[i]);
+                      return d;
+                    }});
+
+  // Round trips over all 8-bit colors, against the scalar formulas too.
+  checks.push_back({"ColorSpace linear round trip", 0, []() {
+                      return roundTrip(ColorSpace::rgbToLinear,
+                                       ColorSpace::linearToRgb,
+                                       {linearFromRgb, linearToRgb});
+                    }});
+  checks.push_back({"ColorSpace HSV round trip", 0, []() {
+                      return roundTrip(ColorSpace::rgbToHsv,
+                                       ColorSpace::hsvToRgb,
+                                       {hsvFromRgb, hsvToRgb});
+                    }});
+  // Lab goes through single-precision cube roots and matrix products whose
+  // last bit may vary with the compiler, so one level is allowed; both the
+  // SSE2 and the scalar path currently give every color back exactly.
+  checks.push_back({"ColorSpace Lab round trip", 1, []() {
+                      return roundTrip(ColorSpace::rgbToLab,
+                                       ColorSpace::labToRgb,
+                                       {labFromRgb, labToRgb});
+                    }});
+  return checks;
+}
+
+std::vector<Check> allChecks() {
+  namespace F = Filters;
+  namespace FR = Filters::reference;
+  namespace D = DitheringAndQuantization;
+  namespace DR = DitheringAndQuantization::reference;
+  std::vector<Check> checks;
+
+  checks.push_back({"invert", 0,
+                    [](Rng &, const QImage &in, QImage &opt, QImage &ref) {
+                      opt = F::invert(in);
+                      ref = FR::invert(in);
+                    }});
+  checks.push_back({"adjustBrightness", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int delta = randomInt(rng, -255, 255);
+                      opt = F::adjustBrightness(in, delta);
+                      ref = FR::adjustBrightness(in, delta);
+                    }});
+  checks.push_back({"adjustContrast", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      double factor = randomInt(rng, 0, 400) / 100.0;
+                      opt = F::adjustContrast(in, factor);
+                      ref = FR::adjustContrast(in, factor);
+                    }});
+  checks.push_back({"adjustGamma", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      double gamma = randomInt(rng, 10, 300) / 100.0;
+                      opt = F::adjustGamma(in, gamma);
+                      ref = FR::adjustGamma(in, gamma);
+                    }});
+  checks.push_back({"applyConvolution", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      auto kernel = randomKernel(rng);
+                      int divisor = randomInt(rng, -2, 30);
+                      int offset = randomInt(rng, -64, 128);
+                      int ax = randomInt(rng, 0, kernel[0].size() - 1);
+                      int ay = randomInt(rng, 0, kernel.size() - 1);
+                      opt = F::applyConvolution(in, kernel, divisor, offset,
+                                                ax, ay);
+                      ref = FR::applyConvolution(in, kernel, divisor, offset,
+                                                 ax, ay);
+                    }});
+  checks.push_back({"applyMedianFilter", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int k = 2 * randomInt(rng, 0, 4) + 1;
+                      opt = F::applyMedianFilter(in, k);
+                      // The reference writes colors into indexed images as
+                      // indices; the optimized filter converts them first.
+                      ref = FR::applyMedianFilter(
+                          in.format() == QImage::Format_Indexed8
+                              ? in.convertToFormat(QImage::Format_RGB32)
+                              : in,
+                          k);
+                    }});
+  checks.push_back({"applyErosionFilter", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int k = randomInt(rng, 1, 9);
+                      opt = F::applyErosionFilter(in, k);
+                      ref = FR::applyErosionFilter(in, k);
+                    }});
+  checks.push_back({"applyDilationFilter", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int k = randomInt(rng, 1, 9);
+                      opt = F::applyDilationFilter(in, k);
+                      ref = FR::applyDilationFilter(in, k);
+                    }});
+
+  static const int mapSizes[] = {2, 3, 4, 6, 8, 16, 32, 64};
+  checks.push_back({"applyOrderedDithering", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int n = mapSizes[randomInt(rng, 0, 7)];
+                      int levels = randomInt(rng, 2, 16);
+                      opt = D::applyOrderedDithering(in, n, levels);
+                      ref = DR::applyOrderedDithering(in, n, levels);
+                    }});
+  checks.push_back({"applyOrderedDitheringInYCbCr", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int n = mapSizes[randomInt(rng, 0, 7)];
+                      int levels = randomInt(rng, 2, 16);
+                      opt = D::applyOrderedDitheringInYCbCr(in, n, levels);
+                      ref = DR::applyOrderedDitheringInYCbCr(in, n, levels);
+                    }});
+  checks.push_back({"applyPopularityQuantization", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int colors = randomInt(rng, 1, 64);
+                      opt = D::applyPopularityQuantization(in, colors);
+                      ref = DR::applyPopularityQuantization(in, colors);
+                    }});
+
+  // Indexed8 output must hold the same colors as RGB32 output. At most 6
+  // levels per channel and 256 colors, so that results can be indexed.
+  checks.push_back({"applyOrderedDithering indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int n = mapSizes[randomInt(rng, 0, 7)];
+                      int levels = randomInt(rng, 2, 6);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyOrderedDithering(in, n, levels,
+                                                            format);
+                          },
+                          opt, ref);
+                    }});
+  checks.push_back({"applyBlueNoiseDithering indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int levels = randomInt(rng, 2, 6);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyBlueNoiseDithering(in, levels,
+                                                              format);
+                          },
+                          opt, ref);
+                    }});
+  checks.push_back({"applyPopularityQuantization indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int colors = randomInt(rng, 1, 256);
+                      int bits = randomInt(rng, 1, 8);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyPopularityQuantization(
+                                in, colors, bits, format);
+                          },
+                          opt, ref);
+                    }});
+  checks.push_back({"applyMedianCutQuantization indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int colors = randomInt(rng, 1, 256);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyMedianCutQuantization(in, colors,
+                                                                 format);
+                          },
+                          opt, ref);
+                    }});
+  checks.push_back({"applyOctreeQuantization indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int colors = randomInt(rng, 1, 256);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyOctreeQuantization(in, colors,
+                                                              format);
+                          },
+                          opt, ref);
+                    }});
+  checks.push_back({"applyKMeansQuantization indexed", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      int colors = randomInt(rng, 1, 256);
+                      compareIndexed(
+                          [&](D::OutputFormat format) {
+                            return D::applyKMeansQuantization(in, colors, {},
+                                                              format);
+                          },
+                          opt, ref);
+                    }});
+
+  // Error diffusion runs rows as a wavefront; each case forces a thread
+  // count, on an input tall enough for that many threads.
+  static const std::pair<D::DiffusionKernel, const char *> kernels[] = {
+      {D::DiffusionKernel::FloydSteinberg, "FS"},
+      {D::DiffusionKernel::JarvisJudiceNinke, "JJN"},
+      {D::DiffusionKernel::Stucki, "Stucki"},
+      {D::DiffusionKernel::Atkinson, "Atkinson"}};
+  static const int threadCounts[] = {1, 3, 8};
+  for (const auto &kernel : kernels) {
+    for (bool serpentine : {false, true}) {
+      for (bool withPalette : {false, true}) {
+        const QString name = QString("applyErrorDiffusion %1%2%3")
+                                 .arg(kernel.second)
+                                 .arg(withPalette ? " pal" : " lv")
+                                 .arg(serpentine ? " serp" : "");
+        const D::DiffusionKernel k = kernel.first;
+        checks.push_back(
+            {name, 0,
+             [k, serpentine, withPalette](Rng &rng, const QImage &in,
+                                          QImage &opt, QImage &ref) {
+               const QImage big = tiled(in, randomInt(rng, 1, 3) << 16);
+               const int threads = threadCounts[randomInt(rng, 0, 2)];
+               const auto format = randomInt(rng, 0, 1)
+                                       ? D::OutputFormat::Indexed8
+                                       : D::OutputFormat::RGB32;
+               Parallel::setMaxThreads(threads);
+               if (withPalette) {
+                 const QVector<QRgb> palette = randomPalette(rng);
+                 opt = D::applyErrorDiffusion(big, k, palette, serpentine,
+                                              format);
+                 ref = DR::applyErrorDiffusion(big, k, palette, serpentine);
+               } else {
+                 const int levels = randomInt(rng, 2, 8);
+                 opt =
+                     D::applyErrorDiffusion(big, k, levels, serpentine, format);
+                 ref = DR::applyErrorDiffusion(big, k, levels, serpentine);
+               }
+               Parallel::setMaxThreads(0);
+             }});
+      }
+    }
+  }
+
+  // Drawing primitives, several to a canvas. Anti-aliased pixels blend with
+  // an integer weight in 0..256 instead of in double precision, which moves
+  // them by up to two levels; DDA lines are drawn without half-pixel ties.
+  namespace DER = DrawingEngine::reference;
+  checks.push_back({"drawLineDDA", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      opt = ref = canvas(in);
+                      for (int i = 0; i < 8; ++i) {
+                        const QPoint a = randomPoint(rng, in);
+                        const QPoint b = randomDdaPoint(rng, in, a);
+                        const QColor c = randomColor(rng);
+                        drawLineDDA(opt, a.x(), a.y(), b.x(), b.y(), c);
+                        DER::drawLineDDA(ref, a.x(), a.y(), b.x(), b.y(), c);
+                      }
+                    }});
+  checks.push_back({"drawFreehandPen", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      QVector<QPoint> points{randomPoint(rng, in)};
+                      for (int i = randomInt(rng, 0, 8); i > 0; --i)
+                        points.append(randomDdaPoint(rng, in, points.last()));
+                      const QColor c = randomColor(rng);
+                      opt = ref = canvas(in);
+                      drawFreehandPen(opt, points, c);
+                      DER::drawFreehandPen(ref, points, c);
+                    }});
+  checks.push_back({"drawLineWu", 2,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      opt = ref = canvas(in);
+                      for (int i = 0; i < 8; ++i) {
+                        const QPoint a = randomPoint(rng, in);
+                        const QPoint b = randomPoint(rng, in);
+                        const QColor c = randomColor(rng);
+                        drawLineWu(opt, a.x(), a.y(), b.x(), b.y(), c);
+                        DER::drawLineWu(ref, a.x(), a.y(), b.x(), b.y(), c);
+                      }
+                    }});
+  for (bool antialiased : {false, true}) {
+    checks.push_back(
+        {antialiased ? "drawCircleWu" : "drawCircleMidpoint",
+         antialiased ? 2 : 0,
+         [antialiased](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+           opt = ref = canvas(in);
+           for (int i = 0; i < 4; ++i) {
+             const QPoint c = randomPoint(rng, in);
+             const int r = randomInt(rng, 0, 2 * (in.width() + in.height()));
+             const QColor color = randomColor(rng);
+             if (antialiased) {
+               drawCircleWu(opt, c.x(), c.y(), r, color);
+               DER::drawCircleWu(ref, c.x(), c.y(), r, color);
+             } else {
+               drawCircleMidpoint(opt, c.x(), c.y(), r, color);
+               DER::drawCircleMidpoint(ref, c.x(), c.y(), r, color);
+             }
+           }
+         }});
+    checks.push_back(
+        {antialiased ? "drawHalfCircleWu" : "drawHalfCircleMidpoint",
+         antialiased ? 2 : 0,
+         [antialiased](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+           opt = ref = canvas(in);
+           for (int i = 0; i < 4; ++i) {
+             const QPoint c = randomPoint(rng, in);
+             const int r = randomInt(rng, 0, 2 * (in.width() + in.height()));
+             const double nx = randomInt(rng, -4, 4) / 4.0;
+             const double ny = randomInt(rng, -4, 4) / 4.0;
+             const QColor color = randomColor(rng);
+             if (antialiased) {
+               drawHalfCircleWu(opt, c.x(), c.y(), r, nx, ny, color);
+               DER::drawHalfCircleWu(ref, c.x(), c.y(), r, nx, ny, color);
+             } else {
+               drawHalfCircleMidpoint(opt, c.x(), c.y(), r, nx, ny, color);
+               DER::drawHalfCircleMidpoint(ref, c.x(), c.y(), r, nx, ny,
+                                           color);
+             }
+           }
+         }});
+  }
+  checks.push_back({"fillPolygonET", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      const QVector<QPoint> polygon = randomPolygon(rng, in);
+                      opt = ref = canvas(in);
+                      if (randomInt(rng, 0, 1)) {
+                        const QColor c = randomColor(rng);
+                        fillPolygonET(opt, polygon, c);
+                        DER::fillPolygonET(ref, polygon, c);
+                      } else {
+                        const QImage pattern = randomPattern(rng);
+                        fillPolygonET(opt, polygon, &pattern);
+                        DER::fillPolygonET(ref, polygon, &pattern);
+                      }
+                    }});
+  checks.push_back({"fillSeedScanline", 0,
+                    [](Rng &rng, const QImage &in, QImage &opt, QImage &ref) {
+                      const int x = randomInt(rng, 0, in.width() - 1);
+                      const int y = randomInt(rng, 0, in.height() - 1);
+                      const QColor c = randomColor(rng);
+                      const QImage pattern = randomPattern(rng);
+                      const bool solid = randomInt(rng, 0, 1);
+                      opt = ref = canvas(in);
+                      fillSeedScanline(opt, x, y, solid ? &c : nullptr,
+                                       solid ? nullptr : &pattern);
+                      DER::fillSeedScanline(ref, x, y, solid ? &c : nullptr,
+                                            solid ? nullptr : &pattern);
+                    }});
+  return checks;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned seed = 12345;
+  int iterations = 50;
+  bool verbose = false;
+  for (int i = 1; i < argc; ++i) {
+    QString arg = QString::fromLocal8Bit(argv[i]);
+    if (arg == "--seed" && i + 1 < argc) {
+      seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--iterations" && i + 1 < argc) {
+      iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else {
+      std::fprintf(stderr, "Usage: filters_diff [--seed N] [--iterations N] "
+                           "[--verbose]\n");
+      return 1;
+    }
+  }
+
+  const std::vector<Check> checks = allChecks();
+  std::map<QString, Summary> summaries;
+  Rng rng(seed);
+
+  for (int it = 0; it < iterations; ++it) {
+    QImage input = randomImage(rng);
+    for (const Check &check : checks) {
+      QImage optimized, reference;
+      check.run(rng, input, optimized, reference);
+      Diff d = compare(optimized, reference);
+
+      Summary &s = summaries[check.name];
+      s.tolerance = check.tolerance;
+      ++s.cases;
+      bool failed = d.sizeMismatch || d.maxError > check.tolerance;
+      if (failed) {
+        ++s.failures;
+        if (verbose)
+          std::printf("FAIL %s on %dx%d (format %d): max error %d%s\n",
+                      qPrintable(check.name), input.width(), input.height(),
+                      int(input.format()), d.maxError,
+                      d.sizeMismatch ? ", size mismatch" : "");
+      }
+      s.total.sizeMismatch |= d.sizeMismatch;
+      s.total.maxError = std::max(s.total.maxError, d.maxError);
+      s.total.sumError += d.sumError;
+      s.total.sumSquared += d.sumSquared;
+      s.total.samples += d.samples;
+    }
+  }
+
+  for (const FixedCheck &check : fixedChecks()) {
+    Diff d = check.run();
+    Summary &s = summaries[check.name];
+    s.tolerance = check.tolerance;
+    s.cases = 1;
+    if (d.sizeMismatch || d.maxError > check.tolerance) {
+      s.failures = 1;
+      if (verbose)
+        std::printf("FAIL %s: max error %d%s\n", qPrintable(check.name),
+                    d.maxError, d.sizeMismatch ? ", size mismatch" : "");
+    }
+    s.total = d;
+  }
+
+  std::printf("%-38s %6s %6s %9s %10s %9s  %s\n", "function", "cases",
+              "tol", "max err", "mean err", "PSNR dB", "result");
+  int failedFunctions = 0;
+  for (const auto &entry : summaries) {
+    const Summary &s = entry.second;
+    double mean = s.total.samples ? s.total.sumError / s.total.samples : 0.0;
+    double p = psnr(s.total);
+    bool ok = s.failures == 0;
+    failedFunctions += ok ? 0 : 1;
+    std::printf("%-38s %6d %6d %9d %10.4f %9s  %s\n", qPrintable(entry.first),
+                s.cases, s.tolerance, s.total.maxError, mean,
+                std::isinf(p) ? "inf" : qPrintable(QString::number(p, 'f', 2)),
+                ok ? "ok" : qPrintable(QString("FAILED (%1)").arg(s.failures)));
+  }
+  std::printf("\nseed %u, %d iterations: %s\n", seed, iterations,
+              failedFunctions ? "FAILED" : "all functions within tolerance");
+  return failedFunctions ? 1 : 0;
+}
@@ -1,4 +1,6 @@
 #include "DitheringAndQuantizationWidget.h"
+#include "ditheringandquantization.h"
+#include <QCheckBox>
 #include <QComboBox>
 #include <QHBoxLayout>
 #include <QLabel>
@@ -23,10 +25,10 @@ DitheringQuantizationWidget::DitheringQuantizationWidget(QWidget *parent)
   QHBoxLayout *ditheringLayout = new QHBoxLayout;
   QLabel *labelThreshold = new QLabel(tr("Threshold Map Size:"), dockContent);
   comboThresholdSize = new QComboBox(dockContent);
-  comboThresholdSize->addItem("2", 2);
-  comboThresholdSize->addItem("3", 3);
-  comboThresholdSize->addItem("4", 4);
-  comboThresholdSize->addItem("6", 6);
+  for (int size : DitheringAndQuantization::thresholdMapSizes())
+    comboThresholdSize->addItem(QString::number(size), size);
+  // Not a matrix size: selects the blue-noise mask.
+  comboThresholdSize->addItem(tr("Blue noise"), 0);
   QLabel *labelLevels = new QLabel(tr("Levels/Channel:"), dockContent);
   spinLevels = new QSpinBox(dockContent);
   spinLevels->setRange(2, 256);
@@ -51,6 +53,37 @@ DitheringQuantizationWidget::DitheringQuantizationWidget(QWidget *parent)
   mainLayout->addWidget(btnApplyDitheringYCbCr);
   connect(btnApplyDitheringYCbCr, &QPushButton::clicked, this,
           &DitheringQuantizationWidget::onApplyOrderedDitheringYCbCrClicked);
+  // The YCbCr variant only supports threshold matrices.
+  connect(comboThresholdSize,
+          QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this] {
+            btnApplyDitheringYCbCr->setEnabled(
+                comboThresholdSize->currentData().toInt() != 0);
+          });
+
+  // --- Error Diffusion Section ---
+  QLabel *labelDiffusion = new QLabel(tr("Error Diffusion"), dockContent);
+  labelDiffusion->setStyleSheet("font-weight: bold; font-size: 11pt;");
+  mainLayout->addWidget(labelDiffusion);
+
+  QHBoxLayout *diffusionLayout = new QHBoxLayout;
+  QLabel *labelKernel = new QLabel(tr("Kernel:"), dockContent);
+  comboKernel = new QComboBox(dockContent);
+  comboKernel->addItem(tr("Floyd–Steinberg"), QStringLiteral("fs"));
+  comboKernel->addItem(tr("Jarvis–Judice–Ninke"), QStringLiteral("jjn"));
+  comboKernel->addItem(tr("Stucki"), QStringLiteral("stucki"));
+  comboKernel->addItem(tr("Atkinson"), QStringLiteral("atkinson"));
+  checkSerpentine = new QCheckBox(tr("Serpentine"), dockContent);
+  diffusionLayout->addWidget(labelKernel);
+  diffusionLayout->addWidget(comboKernel);
+  diffusionLayout->addSpacing(10);
+  diffusionLayout->addWidget(checkSerpentine);
+  mainLayout->addLayout(diffusionLayout);
+
+  btnApplyDiffusion =
+      new QPushButton(tr("Apply Error Diffusion"), dockContent);
+  mainLayout->addWidget(btnApplyDiffusion);
+  connect(btnApplyDiffusion, &QPushButton::clicked, this,
+          &DitheringQuantizationWidget::onApplyErrorDiffusionClicked);
 
   // --- Separator ---
   QFrame *separator = new QFrame(dockContent);
@@ -58,9 +91,9 @@ DitheringQuantizationWidget::DitheringQuantizationWidget(QWidget *parent)
   separator->setFrameShadow(QFrame::Sunken);
   mainLayout->addWidget(separator);
 
-  // --- Popularity Quantization Section ---
+  // --- Color Quantization Section ---
   QLabel *labelQuantization =
-      new QLabel(tr("Popularity Quantization"), dockContent);
+      new QLabel(tr("Color Quantization"), dockContent);
   labelQuantization->setStyleSheet("font-weight: bold; font-size: 11pt;");
   mainLayout->addWidget(labelQuantization);
 
@@ -80,14 +113,41 @@ DitheringQuantizationWidget::DitheringQuantizationWidget(QWidget *parent)
   connect(btnApplyQuantization, &QPushButton::clicked, this,
           &DitheringQuantizationWidget::onApplyPopularityQuantizationClicked);
 
+  btnApplyMedianCut =
+      new QPushButton(tr("Apply Median Cut Quantization"), dockContent);
+  mainLayout->addWidget(btnApplyMedianCut);
+  connect(btnApplyMedianCut, &QPushButton::clicked, this,
+          &DitheringQuantizationWidget::onApplyMedianCutQuantizationClicked);
+
+  btnApplyOctree =
+      new QPushButton(tr("Apply Octree Quantization"), dockContent);
+  mainLayout->addWidget(btnApplyOctree);
+  connect(btnApplyOctree, &QPushButton::clicked, this,
+          &DitheringQuantizationWidget::onApplyOctreeQuantizationClicked);
+
+  // --- Output Format ---
+  checkIndexed =
+      new QCheckBox(tr("Indexed output (8-bit palette)"), dockContent);
+  checkIndexed->setToolTip(
+      tr("Keep results of up to 256 colors as palette images, a quarter of "
+         "the memory, saved as 8-bit PNG."));
+  mainLayout->addWidget(checkIndexed);
+
   dockContent->setLayout(mainLayout);
   setWidget(dockContent);
 }
 
+bool DitheringQuantizationWidget::indexedOutput() const {
+  return checkIndexed->isChecked();
+}
+
 void DitheringQuantizationWidget::onApplyOrderedDitheringClicked() {
   int thresholdMapSize = comboThresholdSize->currentData().toInt();
   int levelsPerChannel = spinLevels->value();
-  emit applyOrderedDitheringRequested(thresholdMapSize, levelsPerChannel);
+  if (thresholdMapSize == 0)
+    emit applyBlueNoiseDitheringRequested(levelsPerChannel);
+  else
+    emit applyOrderedDitheringRequested(thresholdMapSize, levelsPerChannel);
 }
 
 void DitheringQuantizationWidget::onApplyOrderedDitheringYCbCrClicked() {
@@ -96,7 +156,23 @@ void DitheringQuantizationWidget::onApplyOrderedDitheringYCbCrClicked() {
   emit applyOrderedDitheringYCbCrRequested(thresholdMapSize, levelsPerChannel);
 }
 
+void DitheringQuantizationWidget::onApplyErrorDiffusionClicked() {
+  emit applyErrorDiffusionRequested(comboKernel->currentData().toString(),
+                                    spinLevels->value(),
+                                    checkSerpentine->isChecked());
+}
+
 void DitheringQuantizationWidget::onApplyPopularityQuantizationClicked() {
   int numColors = spinNumColors->value();
   emit applyPopularityQuantizationRequested(numColors);
 }
+
+void DitheringQuantizationWidget::onApplyMedianCutQuantizationClicked() {
+  int numColors = spinNumColors->value();
+  emit applyMedianCutQuantizationRequested(numColors);
+}
+
+void DitheringQuantizationWidget::onApplyOctreeQuantizationClicked() {
+  int numColors = spinNumColors->value();
+  emit applyOctreeQuantizationRequested(numColors);
+}
@@ -9,15 +9,26 @@
  * @brief The DitheringQuantizationWidget class
  *
  * This dockable widget provides a graphical user interface for applying
- * ordered dithering and popularity color quantization algorithms to an image.
+ * ordered dithering and color quantization algorithms to an image.
  *
  * For Ordered Dithering, the user can select:
- * - The size of the threshold map (2, 3, 4, or 6).
+ * - The size of the threshold map (2, 3, 4, 6, or a Bayer matrix up to 64),
+ *   or the blue-noise mask.
  * - The number of quantization levels per color channel.
  *
- * For Popularity Quantization, the user can select:
+ * For Error Diffusion, which shares the number of levels, the user can
+ * select:
+ * - The diffusion kernel (Floyd–Steinberg, Jarvis–Judice–Ninke, Stucki or
+ *   Atkinson).
+ * - Serpentine scanning.
+ *
+ * For Color Quantization (popularity, median cut or octree), the user can
+ * select:
  * - The number of colors in the resulting image.
  *
+ * A checkbox selects whether dithered and quantized results are kept as
+ * indexed 8-bit images, read with indexedOutput().
+ *
  * The widget emits signals when the user clicks the corresponding apply
  * buttons.
  */
@@ -30,6 +41,12 @@ public:
    */
   explicit DitheringQuantizationWidget(QWidget *parent = nullptr);
 
+  /**
+   * @brief Returns true if results should be indexed 8-bit images, with the
+   * "indexed" parameter of the operations.
+   */
+  bool indexedOutput() const;
+
 signals:
   /**
    * @brief Emitted when the user requests to apply ordered dithering.
@@ -39,6 +56,13 @@ signals:
   void applyOrderedDitheringRequested(int thresholdMapSize,
                                       int levelsPerChannel);
 
+  /**
+   * @brief Emitted when the user requests ordered dithering with the
+   * blue-noise mask.
+   * @param levelsPerChannel The number of quantization levels per channel.
+   */
+  void applyBlueNoiseDitheringRequested(int levelsPerChannel);
+
   /**
    * @brief Emitted when the user requests to apply ordered dithering with
    * conversion to YCbCr space.
@@ -49,16 +73,40 @@ signals:
   void applyOrderedDitheringYCbCrRequested(int thresholdMapSize,
                                            int levelsPerChannel);
 
+  /**
+   * @brief Emitted when the user requests to apply error diffusion.
+   * @param kernel The kernel name as in the "diffuse" operation, e.g. "fs".
+   * @param levelsPerChannel The number of quantization levels per channel.
+   * @param serpentine Whether every other row is scanned right to left.
+   */
+  void applyErrorDiffusionRequested(const QString &kernel,
+                                    int levelsPerChannel, bool serpentine);
+
   /**
    * @brief Emitted when the user requests to apply popularity quantization.
    * @param numColors The desired number of colors.
    */
   void applyPopularityQuantizationRequested(int numColors);
 
+  /**
+   * @brief Emitted when the user requests to apply median cut quantization.
+   * @param numColors The desired number of colors.
+   */
+  void applyMedianCutQuantizationRequested(int numColors);
+
+  /**
+   * @brief Emitted when the user requests to apply octree quantization.
+   * @param numColors The desired number of colors.
+   */
+  void applyOctreeQuantizationRequested(int numColors);
+
 private slots:
   void onApplyOrderedDitheringClicked();
   void onApplyOrderedDitheringYCbCrClicked();
+  void onApplyErrorDiffusionClicked();
   void onApplyPopularityQuantizationClicked();
+  void onApplyMedianCutQuantizationClicked();
+  void onApplyOctreeQuantizationClicked();
 
 private:
   // Controls for Ordered Dithering.
@@ -69,10 +117,20 @@ private:
   class QPushButton
       *btnApplyDitheringYCbCr; ///< Button to apply ordered dithering.
 
-  // Controls for Popularity Quantization.
+  // Controls for Error Diffusion.
+  class QComboBox *comboKernel;         ///< Dropdown to select the kernel.
+  class QCheckBox *checkSerpentine;     ///< Whether to scan serpentine.
+  class QPushButton *btnApplyDiffusion; ///< Button to apply error diffusion.
+
+  // Controls for Color Quantization.
   class QSpinBox *spinNumColors; ///< SpinBox for number of colors.
   class QPushButton
       *btnApplyQuantization; ///< Button to apply popularity quantization.
+  class QPushButton
+      *btnApplyMedianCut; ///< Button to apply median cut quantization.
+  class QPushButton *btnApplyOctree; ///< Button to apply octree quantization.
+
+  class QCheckBox *checkIndexed; ///< Whether results are indexed images.
 };
 
 #endif // DITHERINGANDQUANTIZATIONWIDGET_H
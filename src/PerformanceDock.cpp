@@ -0,0 +1,124 @@
+#include "PerformanceDock.h"
+#include "telemetry.h"
+
+#include <QCheckBox>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+PerformanceDock::PerformanceDock(QWidget *parent) : QDockWidget(parent) {
+  setWindowTitle(tr("Performance"));
+
+  QWidget *dockContent = new QWidget(this);
+  QVBoxLayout *layout = new QVBoxLayout(dockContent);
+  layout->setContentsMargins(10, 10, 10, 10);
+  layout->setSpacing(10);
+
+  QHBoxLayout *controlsLayout = new QHBoxLayout;
+  checkRecord = new QCheckBox(tr("Record timings"), dockContent);
+  checkRecord->setChecked(Telemetry::isEnabled());
+  connect(checkRecord, &QCheckBox::toggled, this,
+          &PerformanceDock::onRecordToggled);
+  QLabel *labelRows = new QLabel(tr("Show last:"), dockContent);
+  spinRows = new QSpinBox(dockContent);
+  spinRows->setRange(1, 1000);
+  spinRows->setValue(20);
+  connect(spinRows, qOverload<int>(&QSpinBox::valueChanged), this,
+          &PerformanceDock::refresh);
+  controlsLayout->addWidget(checkRecord);
+  controlsLayout->addStretch();
+  controlsLayout->addWidget(labelRows);
+  controlsLayout->addWidget(spinRows);
+  layout->addLayout(controlsLayout);
+
+  table = new QTableWidget(0, 4, dockContent);
+  table->setHorizontalHeaderLabels(
+      {tr("Operation"), tr("Duration (ms)"), tr("MP/s"), tr("Threads")});
+  table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+  table->verticalHeader()->setVisible(false);
+  table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  table->setSelectionMode(QAbstractItemView::NoSelection);
+  layout->addWidget(table);
+
+  QHBoxLayout *buttonLayout = new QHBoxLayout;
+  QPushButton *btnClear = new QPushButton(tr("Clear"), dockContent);
+  connect(btnClear, &QPushButton::clicked, this,
+          &PerformanceDock::onClearClicked);
+  QPushButton *btnExport =
+      new QPushButton(tr("Export Chrome Trace..."), dockContent);
+  btnExport->setToolTip(
+      tr("Save the recorded events for chrome://tracing or Perfetto"));
+  connect(btnExport, &QPushButton::clicked, this,
+          &PerformanceDock::onExportClicked);
+  buttonLayout->addWidget(btnClear);
+  buttonLayout->addWidget(btnExport);
+  layout->addLayout(buttonLayout);
+
+  dockContent->setLayout(layout);
+  setWidget(dockContent);
+
+  refreshTimer = new QTimer(this);
+  refreshTimer->setInterval(500);
+  connect(refreshTimer, &QTimer::timeout, this, [this]() {
+    if (isVisible() && Telemetry::isEnabled())
+      refresh();
+  });
+  refreshTimer->start();
+}
+
+void PerformanceDock::onRecordToggled(bool enabled) {
+  Telemetry::setEnabled(enabled);
+  refresh();
+}
+
+void PerformanceDock::onClearClicked() {
+  Telemetry::clear();
+  refresh();
+}
+
+void PerformanceDock::onExportClicked() {
+  QString path = QFileDialog::getSaveFileName(this, tr("Export Chrome Trace"),
+                                              "trace.json",
+                                              tr("Trace files (*.json)"));
+  if (path.isEmpty())
+    return;
+  if (!Telemetry::writeChromeTrace(path))
+    QMessageBox::warning(this, tr("Error"),
+                         tr("Could not write the trace file."));
+}
+
+void PerformanceDock::refresh() {
+  const QVector<Telemetry::Event> events = Telemetry::snapshot();
+
+  // Newest top-level operations first; nested calls (e.g. blur3x3 calling
+  // applyConvolution) are part of their caller's duration.
+  QVector<Telemetry::Event> operations;
+  for (int i = events.size() - 1; i >= 0; --i) {
+    const Telemetry::Event &e = events[i];
+    if (e.kind != Telemetry::Event::Operation || e.depth != 0)
+      continue;
+    operations.append(e);
+    if (operations.size() == spinRows->value())
+      break;
+  }
+
+  table->setRowCount(operations.size());
+  for (int row = 0; row < operations.size(); ++row) {
+    const Telemetry::Event &e = operations[row];
+    double ms = e.durationNs / 1e6;
+    double mps = e.durationNs > 0 ? e.pixels * 1e3 / e.durationNs : 0.0;
+    table->setItem(row, 0, new QTableWidgetItem(QString::fromLatin1(e.name)));
+    table->setItem(row, 1, new QTableWidgetItem(QString::number(ms, 'f', 2)));
+    table->setItem(row, 2,
+                   new QTableWidgetItem(e.pixels ? QString::number(mps, 'f', 1)
+                                                 : QString("-")));
+    table->setItem(row, 3, new QTableWidgetItem(QString::number(e.threads)));
+  }
+}
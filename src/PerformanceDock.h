@@ -0,0 +1,40 @@
+#ifndef PERFORMANCEDOCK_H
+#define PERFORMANCEDOCK_H
+
+#include <QDockWidget>
+
+/**
+ * @brief The PerformanceDock class
+ *
+ * This dock widget controls the Telemetry recording and lists the most
+ * recent top-level operations (filters and scene redraws) with their
+ * duration, throughput in megapixels per second and thread count. The
+ * recorded events can be exported as a chrome://tracing JSON file.
+ *
+ * The table is refreshed periodically while the dock is visible and
+ * recording is enabled.
+ */
+class PerformanceDock : public QDockWidget {
+  Q_OBJECT
+
+public:
+  /**
+   * @brief Constructs a PerformanceDock widget.
+   * @param parent Parent widget (default is nullptr).
+   */
+  explicit PerformanceDock(QWidget *parent = nullptr);
+
+private slots:
+  void onRecordToggled(bool enabled);
+  void onClearClicked();
+  void onExportClicked();
+  void refresh();
+
+private:
+  class QCheckBox *checkRecord;   ///< Enables Telemetry recording.
+  class QSpinBox *spinRows;       ///< Number of operations to list.
+  class QTableWidget *table;      ///< The last operations, newest first.
+  class QTimer *refreshTimer;     ///< Periodic table refresh.
+};
+
+#endif // PERFORMANCEDOCK_H
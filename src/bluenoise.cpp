@@ -0,0 +1,192 @@
+#include "bluenoise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iterator>
+#include <random>
+
+namespace BlueNoise {
+namespace {
+constexpr int N = MaskSize;
+constexpr int Cells = N * N;
+/* Width of the Gaussian energy filter, as in Ulichney's paper. */
+constexpr double Sigma = 1.5;
+/* Share of cells set in the initial pattern. */
+constexpr int InitialOnesDivisor = 10;
+constexpr double Pi = 3.14159265358979323846;
+
+using Complex = std::complex<double>;
+
+/* In-place radix-2 FFT of n values spaced by stride; inverse if sign > 0
+ * (unscaled). */
+void fft(Complex *data, int n, int stride, int sign) {
+  for (int i = 1, j = 0; i < n; ++i) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j)
+      std::swap(data[i * stride], data[j * stride]);
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    const double angle = sign * 2 * Pi / len;
+    const Complex step(std::cos(angle), std::sin(angle));
+    for (int i = 0; i < n; i += len) {
+      Complex w(1);
+      for (int k = 0; k < len / 2; ++k) {
+        Complex &a = data[(i + k) * stride];
+        Complex &b = data[(i + k + len / 2) * stride];
+        const Complex t = b * w;
+        b = a - t;
+        a += t;
+        w *= step;
+      }
+    }
+  }
+}
+
+void fft2d(std::vector<Complex> &data, int sign) {
+  for (int y = 0; y < N; ++y)
+    fft(data.data() + y * N, N, 1, sign);
+  for (int x = 0; x < N; ++x)
+    fft(data.data() + x, N, N, sign);
+}
+
+/* The Gaussian filter on the torus, centred on cell 0. */
+std::vector<double> gaussianKernel() {
+  std::vector<double> kernel(Cells);
+  for (int y = 0; y < N; ++y) {
+    for (int x = 0; x < N; ++x) {
+      const int dx = x < N / 2 ? x : x - N;
+      const int dy = y < N / 2 ? y : y - N;
+      kernel[y * N + x] =
+          std::exp(-(dx * dx + dy * dy) / (2 * Sigma * Sigma));
+    }
+  }
+  return kernel;
+}
+
+/* Binary pattern with the energy of every cell: the pattern filtered with
+ * the Gaussian kernel, wrapping around the edges. */
+class Pattern {
+public:
+  Pattern(const std::vector<char> &bits, const std::vector<double> &kernel,
+          const std::vector<Complex> &kernelSpectrum)
+      : bits(bits), kernel(kernel), energy(Cells) {
+    std::vector<Complex> spectrum(bits.begin(), bits.end());
+    fft2d(spectrum, -1);
+    for (int i = 0; i < Cells; ++i)
+      spectrum[i] *= kernelSpectrum[i];
+    fft2d(spectrum, 1);
+    for (int i = 0; i < Cells; ++i)
+      energy[i] = spectrum[i].real() / Cells;
+  }
+
+  /* Sets or clears a cell and updates the energies around it. */
+  void toggle(int cell) {
+    bits[cell] = !bits[cell];
+    const double sign = bits[cell] ? 1.0 : -1.0;
+    const int cx = cell % N, cy = cell / N;
+    for (int y = 0; y < N; ++y) {
+      const double *k = kernel.data() + ((y - cy + N) % N) * N;
+      double *e = energy.data() + y * N;
+      for (int x = 0; x < N; ++x)
+        e[x] += sign * k[(x - cx + N) % N];
+    }
+  }
+
+  /* The set cell of highest energy, the centre of the tightest cluster. */
+  int tightestCluster() const { return extreme(1, true); }
+
+  /* The clear cell of lowest energy, the centre of the largest void. */
+  int largestVoid() const { return extreme(0, false); }
+
+  int ones() const { return int(std::count(bits.begin(), bits.end(), 1)); }
+
+private:
+  int extreme(char value, bool highest) const {
+    int best = -1;
+    for (int i = 0; i < Cells; ++i) {
+      if (bits[i] != value)
+        continue;
+      if (best < 0 || (highest ? energy[i] > energy[best]
+                               : energy[i] < energy[best]))
+        best = i;
+    }
+    return best;
+  }
+
+  std::vector<char> bits;
+  const std::vector<double> &kernel;
+  std::vector<double> energy;
+};
+
+/* The output of generateMask(). */
+const int EmbeddedMask[Cells] = {
+#include "bluenoisemask.inc"
+};
+} // namespace
+
+std::vector<int> generateMask() {
+  const std::vector<double> kernel = gaussianKernel();
+  std::vector<Complex> kernelSpectrum(kernel.begin(), kernel.end());
+  fft2d(kernelSpectrum, -1);
+
+  // Initial pattern: a fixed pseudo-random tenth of the cells, relaxed by
+  // moving the tightest cluster into the largest void until they coincide.
+  std::vector<char> bits(Cells, 0);
+  std::mt19937 random(20240601u);
+  for (int placed = 0; placed < Cells / InitialOnesDivisor;) {
+    const int cell = int(random() % Cells);
+    if (!bits[cell]) {
+      bits[cell] = 1;
+      ++placed;
+    }
+  }
+  {
+    Pattern pattern(bits, kernel, kernelSpectrum);
+    for (;;) {
+      const int cluster = pattern.tightestCluster();
+      pattern.toggle(cluster);
+      const int gap = pattern.largestVoid();
+      pattern.toggle(gap);
+      if (gap == cluster)
+        break;
+      bits[cluster] = 0;
+      bits[gap] = 1;
+    }
+  }
+
+  std::vector<int> rank(Cells, 0);
+  Pattern removing(bits, kernel, kernelSpectrum);
+  const int initialOnes = removing.ones();
+
+  // Phase 1: rank the initial cells by removing the tightest clusters.
+  for (int r = initialOnes - 1; r >= 0; --r) {
+    const int cell = removing.tightestCluster();
+    removing.toggle(cell);
+    rank[cell] = r;
+  }
+
+  // Phases 2 and 3: rank the remaining cells by filling the largest voids.
+  // Once more than half of the cells are set, the tightest cluster of clear
+  // cells is the clear cell of lowest energy, since the energies of a
+  // pattern and of its complement add up to a constant; so both phases pick
+  // the same cell.
+  Pattern filling(bits, kernel, kernelSpectrum);
+  for (int r = initialOnes; r < Cells; ++r) {
+    const int cell = filling.largestVoid();
+    filling.toggle(cell);
+    rank[cell] = r;
+  }
+  return rank;
+}
+
+const std::vector<int> &mask() {
+  static const std::vector<int> table(std::begin(EmbeddedMask),
+                                      std::end(EmbeddedMask));
+  return table;
+}
+
+} // namespace BlueNoise
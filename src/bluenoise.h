@@ -0,0 +1,42 @@
+#ifndef BLUENOISE_H
+#define BLUENOISE_H
+
+#include <vector>
+
+/**
+ * @namespace BlueNoise
+ * @brief Blue-noise threshold masks generated with void-and-cluster.
+ *
+ * A blue-noise mask ranks its cells so that the cells below any threshold
+ * are spread evenly, without the regular cross-hatch of Bayer matrices and
+ * without the clumps of white noise. Used as a threshold matrix, it dithers
+ * with the same table lookups as ordered dithering.
+ */
+namespace BlueNoise {
+
+/** @brief Width and height of mask(). */
+constexpr int MaskSize = 64;
+
+/**
+ * @brief Returns the MaskSize × MaskSize mask, row by row: a permutation of
+ * 0 .. MaskSize² - 1 giving the rank of every cell.
+ *
+ * The mask is the output of generateMask(), embedded as a table so that no
+ * process pays for generating it.
+ */
+const std::vector<int> &mask();
+
+/**
+ * @brief Generates the mask with Ulichney's void-and-cluster method.
+ *
+ * Runs on the torus, so the mask tiles seamlessly. Pixel energies are
+ * Gaussian-filtered patterns; they are computed with FFT convolutions when a
+ * phase starts and updated incrementally as single pixels are toggled. The
+ * result is deterministic. Takes some 30-60 ms; only used to check and
+ * regenerate the table behind mask().
+ */
+std::vector<int> generateMask();
+
+} // namespace BlueNoise
+
+#endif // BLUENOISE_H
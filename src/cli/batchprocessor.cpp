@@ -0,0 +1,284 @@
+#include "batchprocessor.h"
+#include "parallel.h"
+#include "rawimage.h"
+#include "streaming.h"
+#include <QByteArray>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+/* One image travelling through the pipeline. */
+struct Item {
+  int index = 0;
+  QString input;
+  QImage image;
+  QString error;
+  qint64 decodeNs = 0, filterNs = 0, encodeNs = 0;
+};
+
+/* Blocking FIFO with a fixed capacity, closed once its producers are done. */
+class BoundedQueue {
+public:
+  explicit BoundedQueue(int capacity) : capacity(capacity) {}
+
+  void push(Item item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return int(items.size()) < capacity; });
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+  }
+
+  /* Returns false once the queue is closed and drained. */
+  bool pop(Item &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+    if (items.empty())
+      return false;
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable notEmpty, notFull;
+  std::deque<Item> items;
+  int capacity;
+  bool closed = false;
+};
+
+/* Runs fn on count threads and calls done once all of them returned. */
+template <typename Fn, typename Done>
+std::thread runStage(int count, Fn fn, Done done) {
+  return std::thread([count, fn, done]() {
+    std::vector<std::thread> workers;
+    for (int i = 0; i < count; ++i)
+      workers.emplace_back(fn);
+    for (std::thread &t : workers)
+      t.join();
+    done();
+  });
+}
+
+double megapixels(const QSize &size) {
+  return double(size.width()) * size.height() / 1e6;
+}
+} // namespace
+
+BatchProcessor::BatchProcessor(const Options &options) : opts(options) {
+  opts.jobs = qMax(1, opts.jobs);
+}
+
+int BatchProcessor::run() {
+  if (opts.stripRows > 0)
+    return runStreaming();
+
+  const int total = opts.inputs.size();
+  QDir outDir(opts.outputDir);
+
+  BoundedQueue toFilter(opts.jobs), toEncode(opts.jobs);
+  std::atomic<int> nextInput{0};
+  std::mutex reportMutex;
+  int done = 0, failed = 0;
+  double totalMegapixels = 0;
+
+  auto report = [&](const Item &item, const QSize &size) {
+    std::lock_guard<std::mutex> lock(reportMutex);
+    ++done;
+    QByteArray name = QFileInfo(item.input).fileName().toLocal8Bit();
+    if (!item.error.isEmpty()) {
+      ++failed;
+      std::printf("[%d/%d] %s: %s\n", done, total, name.constData(),
+                  item.error.toLocal8Bit().constData());
+    } else {
+      double mp = megapixels(size);
+      totalMegapixels += mp;
+      double filterMs = item.filterNs / 1e6;
+      std::printf("[%d/%d] %s %dx%d: decode %.1f ms, filter %.1f ms "
+                  "(%.1f MP/s), encode %.1f ms\n",
+                  done, total, name.constData(), size.width(), size.height(),
+                  item.decodeNs / 1e6, filterMs,
+                  filterMs > 0 ? mp / (filterMs / 1e3) : 0.0,
+                  item.encodeNs / 1e6);
+    }
+    std::fflush(stdout);
+  };
+
+  QElapsedTimer wall;
+  wall.start();
+
+  std::thread decodeStage = runStage(
+      opts.jobs,
+      [&]() {
+        for (int i = nextInput++; i < total; i = nextInput++) {
+          Item item;
+          item.index = i;
+          item.input = opts.inputs[i];
+          QElapsedTimer t;
+          t.start();
+          if (RawImage::isRawImage(item.input))
+            item.image = RawImage::load(item.input, &item.error);
+          else if (!item.image.load(item.input))
+            item.error = QStringLiteral("could not decode image");
+          item.decodeNs = t.nsecsElapsed();
+          toFilter.push(std::move(item));
+        }
+      },
+      [&]() { toFilter.close(); });
+
+  // The filter workers run their row loops concurrently; share the cores
+  // between them rather than giving each loop all of them.
+  const int budget = std::max(1, Parallel::maxThreads() / opts.jobs);
+  std::thread filterStage = runStage(
+      opts.jobs,
+      [&]() {
+        Parallel::ThreadBudget threads(budget);
+        Item item;
+        while (toFilter.pop(item)) {
+          if (item.error.isEmpty()) {
+            QElapsedTimer t;
+            t.start();
+            item.image = Operations::applyAll(item.image, opts.operations);
+            item.filterNs = t.nsecsElapsed();
+            if (item.image.isNull())
+              item.error = QStringLiteral("filtering failed");
+          }
+          toEncode.push(std::move(item));
+        }
+      },
+      [&]() { toEncode.close(); });
+
+  std::thread encodeStage = runStage(
+      opts.jobs,
+      [&]() {
+        Item item;
+        while (toEncode.pop(item)) {
+          QSize size = item.image.size();
+          if (item.error.isEmpty()) {
+            QFileInfo info(item.input);
+            QString suffix =
+                opts.format.isEmpty() ? info.suffix() : opts.format;
+            QString output =
+                outDir.filePath(info.completeBaseName() + '.' + suffix);
+            QElapsedTimer t;
+            t.start();
+            if (RawImage::isRawImage(output))
+              RawImage::save(item.image, output, &item.error);
+            else if (!item.image.save(output))
+              item.error = QStringLiteral("could not write %1").arg(output);
+            item.encodeNs = t.nsecsElapsed();
+          }
+          // Free the pixels before waiting on the report lock.
+          item.image = QImage();
+          report(item, size);
+        }
+      },
+      []() {});
+
+  decodeStage.join();
+  filterStage.join();
+  encodeStage.join();
+
+  double seconds = wall.nsecsElapsed() / 1e9;
+  int succeeded = total - failed;
+  std::printf("Processed %d image(s), %.1f MP in %.2f s: %.2f images/s, "
+              "%.1f MP/s",
+              succeeded, totalMegapixels, seconds,
+              seconds > 0 ? succeeded / seconds : 0.0,
+              seconds > 0 ? totalMegapixels / seconds : 0.0);
+  if (failed > 0)
+    std::printf(" (%d failed)", failed);
+  std::printf("\n");
+  return failed;
+}
+
+int BatchProcessor::runStreaming() {
+  const int total = opts.inputs.size();
+  if (!Streaming::isOutputFormat(opts.format)) {
+    std::fprintf(stderr, "Streaming writes PPM or PGM, not %s\n",
+                 opts.format.toLocal8Bit().constData());
+    return total;
+  }
+  // Strips are written as PPM, or PGM when asked for.
+  const QString suffix = opts.format.compare(QLatin1String("pgm"),
+                                             Qt::CaseInsensitive) == 0
+                             ? QStringLiteral("pgm")
+                             : QStringLiteral("ppm");
+  QDir outDir(opts.outputDir);
+  std::atomic<int> nextInput{0};
+  std::mutex reportMutex;
+  int done = 0, failed = 0;
+  double totalMegapixels = 0;
+
+  QElapsedTimer wall;
+  wall.start();
+
+  // As in run(): the workers share the cores of their row loops.
+  const int budget = std::max(1, Parallel::maxThreads() / opts.jobs);
+  auto worker = [&]() {
+    Parallel::ThreadBudget threads(budget);
+    for (int i = nextInput++; i < total; i = nextInput++) {
+      const QString &input = opts.inputs[i];
+      QFileInfo info(input);
+      QString output = outDir.filePath(info.completeBaseName() + '.' + suffix);
+      QString error;
+      QSize size;
+      QElapsedTimer t;
+      t.start();
+      bool ok = Streaming::processFile(input, output, opts.operations,
+                                       opts.stripRows, &error, &size);
+      double ms = t.nsecsElapsed() / 1e6;
+
+      std::lock_guard<std::mutex> lock(reportMutex);
+      ++done;
+      QByteArray name = info.fileName().toLocal8Bit();
+      if (!ok) {
+        ++failed;
+        std::printf("[%d/%d] %s: %s\n", done, total, name.constData(),
+                    error.toLocal8Bit().constData());
+      } else {
+        double mp = megapixels(size);
+        totalMegapixels += mp;
+        std::printf("[%d/%d] %s %dx%d: streamed in %.1f ms (%.1f MP/s)\n",
+                    done, total, name.constData(), size.width(),
+                    size.height(), ms, ms > 0 ? mp / (ms / 1e3) : 0.0);
+      }
+      std::fflush(stdout);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < opts.jobs; ++i)
+    workers.emplace_back(worker);
+  for (std::thread &t : workers)
+    t.join();
+
+  double seconds = wall.nsecsElapsed() / 1e9;
+  int succeeded = total - failed;
+  std::printf("Streamed %d image(s), %.1f MP in %.2f s: %.2f images/s, "
+              "%.1f MP/s",
+              succeeded, totalMegapixels, seconds,
+              seconds > 0 ? succeeded / seconds : 0.0,
+              seconds > 0 ? totalMegapixels / seconds : 0.0);
+  if (failed > 0)
+    std::printf(" (%d failed)", failed);
+  std::printf("\n");
+  return failed;
+}
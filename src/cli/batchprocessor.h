@@ -0,0 +1,54 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include "operations.h"
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief The BatchProcessor class
+ *
+ * Applies a chain of operations to a list of image files and writes the
+ * results into an output directory.
+ *
+ * Images flow through a three-stage pipeline (decode -> filter -> encode).
+ * Each stage runs on its own set of worker threads and the stages are
+ * connected by bounded queues, so decoding of the next images and encoding
+ * of the previous ones overlap with filtering, while at most a few images per
+ * stage are held in memory at once.
+ *
+ * Per-image timings are printed as images complete, followed by the
+ * aggregate throughput.
+ *
+ * With Options::stripRows set, each image is instead streamed through the
+ * operations in strips of rows (see Streaming::processFile), so images
+ * larger than memory can be processed. Up to Options::jobs images are
+ * streamed at once.
+ */
+class BatchProcessor {
+public:
+  struct Options {
+    QStringList inputs;   ///< Input image files.
+    QString outputDir;    ///< Directory the results are written into.
+    QString format;       ///< Output suffix; empty keeps the input suffix.
+    int jobs = 1;         ///< Worker threads per pipeline stage.
+    int stripRows = 0;    ///< Rows per strip when streaming, 0 to disable.
+    QVector<Operations::Operation> operations; ///< Applied in order.
+  };
+
+  explicit BatchProcessor(const Options &options);
+
+  /**
+   * @brief Processes all inputs.
+   * @return The number of images that failed.
+   */
+  int run();
+
+private:
+  int runStreaming();
+
+  Options opts;
+};
+
+#endif // BATCHPROCESSOR_H
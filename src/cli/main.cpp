@@ -0,0 +1,164 @@
+#include "batchprocessor.h"
+#include "operations.h"
+#include "streaming.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+void printUsage() {
+  std::printf(
+      "Usage: ImageFilteringCli [options] <input files or globs...>\n"
+      "\n"
+      "Options:\n"
+      "  -o, --output <dir>   Output directory (required).\n"
+      "  -j, --jobs <N>       Worker threads per pipeline stage "
+      "(default: number of cores).\n"
+      "  --format <suffix>    Output format, e.g. png or rawimg (default:\n"
+      "                       input's). rawimg files are uncompressed and\n"
+      "                       memory-mapped, for fast intermediates.\n"
+      "  --stream <rows>      Process each image in strips of <rows> rows\n"
+      "                       without loading it whole; writes PPM (or PGM\n"
+      "                       with --format pgm). Reads PPM/PGM, rawimg, or\n"
+      "                       formats that decode clip rectangles (JPEG).\n"
+      "  --indexed            Keep dithered and quantized images as 8-bit\n"
+      "                       palette images of up to 256 colors, written\n"
+      "                       as paletted PNG with --format png.\n"
+      "  -h, --help           Show this help.\n"
+      "\n"
+      "Operations, applied in the order given:\n"
+      "  --invert --gray --blur --gauss --sharpen --edge --emboss\n"
+      "  --brightness <delta>   --contrast <factor>   --gamma <value>\n"
+      "  --conv <kernel.txt>    --median <size>       --erode <size>\n"
+      "  --dilate <size>        --dither <map:levels> --dither-ycbcr "
+      "<map:levels>\n"
+      "  --dither-bluenoise <levels>\n"
+      "  --diffuse <kernel:levels[:serpentine]>  (fs, jjn, stucki, atkinson)\n"
+      "  --popularity <colors[:bits]>                  --mediancut <colors>\n"
+      "  --octree <colors>      --kmeans <colors[:iterations]>\n"
+      "  --equalize <luma|rgb>  --clahe <tiles:clip>   --lut <values.txt>\n"
+      "  --macro <macro.json>\n"
+      "\n"
+      "A macro is a chain of operations saved from the GUI (Macro menu); its\n"
+      "operations are inserted where --macro appears.\n"
+      "\n"
+      "Example:\n"
+      "  ImageFilteringCli --brightness 20 --conv kernel.txt --median 5 "
+      "--dither 4:3 -o out 'scans/*.png'\n");
+}
+
+bool isGlob(const QString &pattern) {
+  return pattern.contains('*') || pattern.contains('?') ||
+         pattern.contains('[');
+}
+
+/* Expands a glob in the file name part of the pattern. */
+QStringList expand(const QString &pattern) {
+  if (!isGlob(pattern))
+    return {pattern};
+  QFileInfo info(pattern);
+  QDir dir(info.path());
+  QStringList files;
+  const QStringList names =
+      dir.entryList({info.fileName()}, QDir::Files, QDir::Name);
+  for (const QString &name : names)
+    files.append(dir.filePath(name));
+  return files;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // Needed for the image format plugins; no display server is required.
+  QCoreApplication app(argc, argv);
+
+  BatchProcessor::Options options;
+  options.jobs = QThread::idealThreadCount();
+  bool indexed = false;
+
+  const QStringList args = app.arguments().mid(1);
+  for (int i = 0; i < args.size(); ++i) {
+    const QString &arg = args[i];
+    auto value = [&]() -> QString {
+      if (i + 1 >= args.size()) {
+        std::fprintf(stderr, "Missing value for %s\n",
+                     arg.toLocal8Bit().constData());
+        std::exit(1);
+      }
+      return args[++i];
+    };
+
+    if (arg == QLatin1String("-h") || arg == QLatin1String("--help")) {
+      printUsage();
+      return 0;
+    } else if (arg == QLatin1String("-o") || arg == QLatin1String("--output")) {
+      options.outputDir = value();
+    } else if (arg == QLatin1String("-j") || arg == QLatin1String("--jobs")) {
+      options.jobs = value().toInt();
+    } else if (arg == QLatin1String("--format")) {
+      options.format = value();
+    } else if (arg == QLatin1String("--stream")) {
+      options.stripRows = value().toInt();
+      if (options.stripRows <= 0) {
+        std::fprintf(stderr, "--stream needs a positive number of rows\n");
+        return 1;
+      }
+    } else if (arg == QLatin1String("--indexed")) {
+      indexed = true;
+    } else if (arg == QLatin1String("--macro")) {
+      QVector<Operations::Operation> macro;
+      QString error;
+      if (!Operations::loadMacro(value(), macro, &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+      }
+      options.operations += macro;
+    } else if (arg.startsWith(QLatin1String("--"))) {
+      QString type = arg.mid(2);
+      QString argument = Operations::takesArgument(type) ? value() : QString();
+      Operations::Operation op;
+      QString error;
+      if (!Operations::fromOption(type, argument, op, &error)) {
+        std::fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+        return 1;
+      }
+      options.operations.append(op);
+    } else {
+      options.inputs += expand(arg);
+    }
+  }
+
+  if (indexed) {
+    for (Operations::Operation &op : options.operations) {
+      if (Operations::producesPalette(op.type))
+        op.params["indexed"] = true;
+    }
+  }
+
+  if (options.inputs.isEmpty() || options.outputDir.isEmpty()) {
+    printUsage();
+    return 1;
+  }
+  QString reason;
+  if (options.stripRows > 0 &&
+      !Streaming::canStream(options.operations, &reason)) {
+    std::fprintf(stderr, "%s\n", reason.toLocal8Bit().constData());
+    return 1;
+  }
+  if (options.stripRows > 0 && !Streaming::isOutputFormat(options.format)) {
+    std::fprintf(stderr, "--stream writes PPM or PGM, not %s\n",
+                 options.format.toLocal8Bit().constData());
+    return 1;
+  }
+  if (!QDir().mkpath(options.outputDir)) {
+    std::fprintf(stderr, "Cannot create output directory %s\n",
+                 options.outputDir.toLocal8Bit().constData());
+    return 1;
+  }
+
+  BatchProcessor processor(options);
+  return processor.run() == 0 ? 0 : 2;
+}
@@ -0,0 +1,456 @@
+#include "colorspace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CS_HAVE_SSE2 1
+#endif
+
+namespace ColorSpace {
+namespace {
+/* Pixels converted together by the single-precision kernels. */
+constexpr int Lanes = 4;
+
+/* --- Four floats at a time --- */
+
+#ifdef CS_HAVE_SSE2
+struct F4 {
+  __m128 v;
+};
+
+inline F4 f4(float x) { return {_mm_set1_ps(x)}; }
+inline F4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, F4 a) { _mm_storeu_ps(p, a.v); }
+inline F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F4 operator/(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F4 min(F4 a, F4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline F4 max(F4 a, F4 b) { return {_mm_max_ps(a.v, b.v)}; }
+/* Lanes of a where the mask is set, of b elsewhere. Masks are all ones or
+ * all zeros per lane, as returned by the comparisons. */
+inline F4 select(F4 mask, F4 a, F4 b) {
+  return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+inline F4 operator<(F4 a, F4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline F4 operator>(F4 a, F4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline F4 operator>=(F4 a, F4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline F4 operator==(F4 a, F4 b) { return {_mm_cmpeq_ps(a.v, b.v)}; }
+
+/* Floor of values within int range; SSE2 has no rounding instruction. */
+inline F4 floor(F4 a) {
+  const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+  return {_mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)))};
+}
+
+/* Cube root of positive values: a guess from dividing the exponent by
+ * three, refined by three Newton steps to full single precision. */
+inline F4 cbrt(F4 a) {
+  const __m128i bits = _mm_castps_si128(a.v);
+  const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+  const __m128 one = _mm_set1_ps(float(0x3f800000));
+  const __m128 guess = _mm_add_ps(
+      _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(bits), one), third), one);
+  F4 y{_mm_castsi128_ps(_mm_cvttps_epi32(guess))};
+  for (int i = 0; i < 3; ++i)
+    y = (y + y + a / (y * y)) * F4{third};
+  return y;
+}
+#else
+struct F4 {
+  float v[Lanes];
+};
+
+template <typename Op> inline F4 lanes(F4 a, F4 b, Op op) {
+  F4 r;
+  for (int l = 0; l < Lanes; ++l)
+    r.v[l] = op(a.v[l], b.v[l]);
+  return r;
+}
+inline float maskOf(bool set) {
+  const unsigned bits = set ? ~0u : 0u;
+  float mask;
+  std::memcpy(&mask, &bits, sizeof mask);
+  return mask;
+}
+inline bool isSet(float mask) {
+  unsigned bits;
+  std::memcpy(&bits, &mask, sizeof bits);
+  return bits != 0;
+}
+
+inline F4 f4(float x) { return {{x, x, x, x}}; }
+inline F4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float *p, F4 a) { std::copy(a.v, a.v + Lanes, p); }
+inline F4 operator+(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return x + y; });
+}
+inline F4 operator-(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return x - y; });
+}
+inline F4 operator*(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return x * y; });
+}
+inline F4 operator/(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return x / y; });
+}
+inline F4 min(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return y < x ? y : x; });
+}
+inline F4 max(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return y > x ? y : x; });
+}
+inline F4 select(F4 mask, F4 a, F4 b) {
+  F4 r;
+  for (int l = 0; l < Lanes; ++l)
+    r.v[l] = isSet(mask.v[l]) ? a.v[l] : b.v[l];
+  return r;
+}
+inline F4 operator<(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return maskOf(x < y); });
+}
+inline F4 operator>(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return maskOf(x > y); });
+}
+inline F4 operator>=(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return maskOf(x >= y); });
+}
+inline F4 operator==(F4 a, F4 b) {
+  return lanes(a, b, [](float x, float y) { return maskOf(x == y); });
+}
+inline F4 floor(F4 a) {
+  F4 r;
+  for (int l = 0; l < Lanes; ++l)
+    r.v[l] = std::floor(a.v[l]);
+  return r;
+}
+inline F4 cbrt(F4 a) {
+  F4 r;
+  for (int l = 0; l < Lanes; ++l)
+    r.v[l] = std::cbrt(a.v[l]);
+  return r;
+}
+#endif
+
+/* --- Tables --- */
+
+/* Products of every channel value with the YCbCr coefficients, so that a
+ * conversion only adds three table entries. */
+struct YCbCrTables {
+  double yr[256], yg[256], yb[256];
+  double cbr[256], cbg[256], cbb[256];
+  double crr[256], crg[256], crb[256];
+
+  YCbCrTables() {
+    for (int v = 0; v < 256; ++v) {
+      const double c = v;
+      yr[v] = 0.299 * c;
+      yg[v] = 0.587 * c;
+      yb[v] = 0.114 * c;
+      cbr[v] = 0.168736 * c;
+      cbg[v] = 0.331264 * c;
+      cbb[v] = 0.5 * c;
+      crr[v] = 0.5 * c;
+      crg[v] = 0.418688 * c;
+      crb[v] = 0.081312 * c;
+    }
+  }
+};
+
+const YCbCrTables &yCbCrTables() {
+  static const YCbCrTables tables;
+  return tables;
+}
+
+/* The sRGB transfer function, from a channel value in 0..1 to linear. */
+double decodeSrgb(double value) {
+  return value <= 0.04045 ? value / 12.92
+                          : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+/* Decoding of every 8-bit sRGB value, and the thresholds for encoding back:
+ * a linear value encodes to the largest k whose threshold[k], the decoded
+ * midpoint between k - 1 and k, does not exceed it. bucket[i] holds the
+ * code of i / Buckets, from which at most a couple of thresholds are
+ * stepped over. */
+struct SrgbTables {
+  static constexpr int Buckets = 4096;
+  float linear[256];
+  float unit[256]; ///< v / 255, the input of HSV.
+  float threshold[257];
+  unsigned char bucket[Buckets];
+
+  SrgbTables() {
+    for (int v = 0; v < 256; ++v) {
+      linear[v] = float(decodeSrgb(v / 255.0));
+      unit[v] = float(v / 255.0);
+    }
+    threshold[0] = -1.0f;
+    for (int k = 1; k < 256; ++k)
+      threshold[k] = float(decodeSrgb((k - 0.5) / 255.0));
+    threshold[256] = 2.0f;
+    int code = 0;
+    for (int i = 0; i < Buckets; ++i) {
+      const float value = float(i) / Buckets;
+      while (threshold[code + 1] <= value)
+        ++code;
+      bucket[i] = (unsigned char)(code);
+    }
+  }
+
+  int encode(float value) const {
+    if (!(value > 0.0f))
+      return 0;
+    if (value >= 1.0f)
+      return 255;
+    int code = bucket[int(value * Buckets)];
+    while (threshold[code + 1] <= value)
+      ++code;
+    return code;
+  }
+};
+
+const SrgbTables &srgbTables() {
+  static const SrgbTables tables;
+  return tables;
+}
+
+/* --- Block drivers --- */
+
+/* Converts pixels four at a time: the channels of each pixel are looked up
+ * in table and passed to kernel(c0, c1, c2), which returns the converted
+ * channels through its references. The last block is padded by repeating
+ * its last pixel. */
+template <typename Kernel>
+void fromRgb(const QRgb *in, int count, Channels<float> out,
+             const float *table, Kernel kernel) {
+  for (int i = 0; i < count; i += Lanes) {
+    const int n = std::min(Lanes, count - i);
+    float channels[3][Lanes];
+    for (int l = 0; l < Lanes; ++l) {
+      const QRgb pixel = in[i + std::min(l, n - 1)];
+      channels[0][l] = table[qRed(pixel)];
+      channels[1][l] = table[qGreen(pixel)];
+      channels[2][l] = table[qBlue(pixel)];
+    }
+    F4 c[3] = {load(channels[0]), load(channels[1]), load(channels[2])};
+    kernel(c[0], c[1], c[2]);
+    for (int k = 0; k < 3; ++k) {
+      store(channels[k], c[k]);
+      for (int l = 0; l < n; ++l)
+        out.at(k, i + l) = channels[k][l];
+    }
+  }
+}
+
+/* The inverse of fromRgb(): kernel turns the three channels into red, green
+ * and blue in place, and encode(value) maps those to 8-bit values. */
+template <typename Kernel, typename Encode>
+void toRgb(Channels<const float> in, int count, QRgb *out, Kernel kernel,
+           Encode encode) {
+  for (int i = 0; i < count; i += Lanes) {
+    const int n = std::min(Lanes, count - i);
+    float channels[3][Lanes];
+    for (int k = 0; k < 3; ++k)
+      for (int l = 0; l < Lanes; ++l)
+        channels[k][l] = in.at(k, i + std::min(l, n - 1));
+    F4 c[3] = {load(channels[0]), load(channels[1]), load(channels[2])};
+    kernel(c[0], c[1], c[2]);
+    for (int k = 0; k < 3; ++k)
+      store(channels[k], c[k]);
+    for (int l = 0; l < n; ++l)
+      out[i + l] = qRgb(encode(channels[0][l]), encode(channels[1][l]),
+                        encode(channels[2][l]));
+  }
+}
+
+/* --- CIE L*a*b* --- */
+
+/* D65 white point. */
+constexpr float WhiteX = 0.95047f, WhiteY = 1.0f, WhiteZ = 1.08883f;
+/* f(t) is a cube root above Epsilon = (6/29)^3 and linear below it. */
+constexpr float Delta = 6.0f / 29.0f;
+constexpr float Epsilon = Delta * Delta * Delta;
+
+inline F4 labF(F4 t) {
+  const F4 root = cbrt(max(t, f4(Epsilon)));
+  const F4 linear = t * f4(1.0f / (3.0f * Delta * Delta)) + f4(4.0f / 29.0f);
+  return select(t > f4(Epsilon), root, linear);
+}
+
+inline F4 labFInverse(F4 f) {
+  const F4 cube = f * f * f;
+  const F4 linear = f4(3.0f * Delta * Delta) * (f - f4(4.0f / 29.0f));
+  return select(f > f4(Delta), cube, linear);
+}
+} // namespace
+
+/* --- YCbCr --- */
+
+void rgbToYCbCr(const QRgb *in, int count, Channels<double> out) {
+  const YCbCrTables &t = yCbCrTables();
+  for (int i = 0; i < count; ++i) {
+    const int r = qRed(in[i]), g = qGreen(in[i]), b = qBlue(in[i]);
+    out.at(0, i) = t.yr[r] + t.yg[g] + t.yb[b];
+    out.at(1, i) = 128 - t.cbr[r] - t.cbg[g] + t.cbb[b];
+    out.at(2, i) = 128 + t.crr[r] - t.crg[g] - t.crb[b];
+  }
+}
+
+void yCbCrToRgb(Channels<const double> in, int count, QRgb *out) {
+  int i = 0;
+#ifdef CS_HAVE_SSE2
+  // Clamping before truncating gives the same result as truncating first.
+  const __m128d zero = _mm_setzero_pd(), top = _mm_set1_pd(255.0);
+  const __m128d centre = _mm_set1_pd(128.0);
+  for (; i + 2 <= count; i += 2) {
+    const __m128d y = _mm_set_pd(in.at(0, i + 1), in.at(0, i));
+    const __m128d cb =
+        _mm_sub_pd(_mm_set_pd(in.at(1, i + 1), in.at(1, i)), centre);
+    const __m128d cr =
+        _mm_sub_pd(_mm_set_pd(in.at(2, i + 1), in.at(2, i)), centre);
+    const __m128d r = _mm_add_pd(y, _mm_mul_pd(_mm_set1_pd(1.402), cr));
+    const __m128d g =
+        _mm_sub_pd(_mm_sub_pd(y, _mm_mul_pd(_mm_set1_pd(0.344136), cb)),
+                   _mm_mul_pd(_mm_set1_pd(0.714136), cr));
+    const __m128d b = _mm_add_pd(y, _mm_mul_pd(_mm_set1_pd(1.772), cb));
+    int rgb[3][4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[0]),
+                     _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(r, zero), top)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[1]),
+                     _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(g, zero), top)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[2]),
+                     _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(b, zero), top)));
+    out[i] = qRgb(rgb[0][0], rgb[1][0], rgb[2][0]);
+    out[i + 1] = qRgb(rgb[0][1], rgb[1][1], rgb[2][1]);
+  }
+#endif
+  for (; i < count; ++i) {
+    const double y = in.at(0, i), cb = in.at(1, i), cr = in.at(2, i);
+    const int r = int(y + 1.402 * (cr - 128));
+    const int g = int(y - 0.344136 * (cb - 128) - 0.714136 * (cr - 128));
+    const int b = int(y + 1.772 * (cb - 128));
+    out[i] = qRgb(std::clamp(r, 0, 255), std::clamp(g, 0, 255),
+                  std::clamp(b, 0, 255));
+  }
+}
+
+/* --- HSV --- */
+
+void rgbToHsv(const QRgb *in, int count, Channels<float> out) {
+  fromRgb(in, count, out, srgbTables().unit, [](F4 &r, F4 &g, F4 &b) {
+    const F4 zero = f4(0.0f);
+    const F4 high = max(r, max(g, b));
+    const F4 delta = high - min(r, min(g, b));
+    const F4 chromatic = delta > zero;
+    const F4 inverse = f4(1.0f) / select(chromatic, delta, f4(1.0f));
+    // The sector of the hue depends on which channel is the largest.
+    F4 hue = select(high == r, (g - b) * inverse,
+                    select(high == g, f4(2.0f) + (b - r) * inverse,
+                           f4(4.0f) + (r - g) * inverse));
+    hue = hue * f4(60.0f);
+    hue = select(hue < zero, hue + f4(360.0f), hue);
+    hue = select(hue >= f4(360.0f), hue - f4(360.0f), hue);
+    const F4 saturation =
+        select(high > zero, delta / select(high > zero, high, f4(1.0f)), zero);
+    r = select(chromatic, hue, zero);
+    g = saturation;
+    b = high;
+  });
+}
+
+void hsvToRgb(Channels<const float> in, int count, QRgb *out) {
+  toRgb(
+      in, count, out,
+      [](F4 &h, F4 &s, F4 &v) {
+        const F4 zero = f4(0.0f), one = f4(1.0f), six = f4(6.0f);
+        // Hue in sixths of the circle, wrapped into 0..6.
+        F4 sector = h * f4(1.0f / 60.0f);
+        sector = sector - six * floor(sector * f4(1.0f / 6.0f));
+        const F4 saturation = min(max(s, zero), one);
+        const F4 value = min(max(v, zero), one);
+        const F4 chroma = value * saturation;
+        // Channel n is value - chroma * clamp(min(k, 4 - k), 0, 1), with
+        // k = (n + sector) mod 6 and n = 5, 3, 1 for red, green and blue.
+        auto channel = [&](float n) {
+          F4 k = f4(n) + sector;
+          k = select(k >= six, k - six, k);
+          const F4 ramp = min(max(min(k, f4(4.0f) - k), zero), one);
+          return value - chroma * ramp;
+        };
+        const F4 red = channel(5.0f), green = channel(3.0f);
+        const F4 blue = channel(1.0f);
+        h = red;
+        s = green;
+        v = blue;
+      },
+      [](float value) { return int(value * 255.0f + 0.5f); });
+}
+
+/* --- Linear sRGB --- */
+
+void rgbToLinear(const QRgb *in, int count, Channels<float> out) {
+  const SrgbTables &t = srgbTables();
+  for (int i = 0; i < count; ++i) {
+    out.at(0, i) = t.linear[qRed(in[i])];
+    out.at(1, i) = t.linear[qGreen(in[i])];
+    out.at(2, i) = t.linear[qBlue(in[i])];
+  }
+}
+
+void linearToRgb(Channels<const float> in, int count, QRgb *out) {
+  const SrgbTables &t = srgbTables();
+  for (int i = 0; i < count; ++i)
+    out[i] = qRgb(t.encode(in.at(0, i)), t.encode(in.at(1, i)),
+                  t.encode(in.at(2, i)));
+}
+
+float srgbToLinear(int value) {
+  return srgbTables().linear[std::clamp(value, 0, 255)];
+}
+
+int linearToSrgb(float linear) { return srgbTables().encode(linear); }
+
+/* --- CIE L*a*b* --- */
+
+void rgbToLab(const QRgb *in, int count, Channels<float> out) {
+  fromRgb(in, count, out, srgbTables().linear, [](F4 &r, F4 &g, F4 &b) {
+    const F4 x = (f4(0.4124564f) * r + f4(0.3575761f) * g +
+                  f4(0.1804375f) * b) *
+                 f4(1.0f / WhiteX);
+    const F4 y = (f4(0.2126729f) * r + f4(0.7151522f) * g +
+                  f4(0.0721750f) * b) *
+                 f4(1.0f / WhiteY);
+    const F4 z = (f4(0.0193339f) * r + f4(0.1191920f) * g +
+                  f4(0.9503041f) * b) *
+                 f4(1.0f / WhiteZ);
+    const F4 fx = labF(x), fy = labF(y), fz = labF(z);
+    r = f4(116.0f) * fy - f4(16.0f);
+    g = f4(500.0f) * (fx - fy);
+    b = f4(200.0f) * (fy - fz);
+  });
+}
+
+void labToRgb(Channels<const float> in, int count, QRgb *out) {
+  const SrgbTables &t = srgbTables();
+  toRgb(
+      in, count, out,
+      [](F4 &l, F4 &a, F4 &b) {
+        const F4 fy = (l + f4(16.0f)) * f4(1.0f / 116.0f);
+        const F4 fx = fy + a * f4(1.0f / 500.0f);
+        const F4 fz = fy - b * f4(1.0f / 200.0f);
+        const F4 x = f4(WhiteX) * labFInverse(fx);
+        const F4 y = f4(WhiteY) * labFInverse(fy);
+        const F4 z = f4(WhiteZ) * labFInverse(fz);
+        l = f4(3.2404542f) * x - f4(1.5371385f) * y - f4(0.4985314f) * z;
+        a = f4(-0.9692660f) * x + f4(1.8760108f) * y + f4(0.0415560f) * z;
+        b = f4(0.0556434f) * x - f4(0.2040259f) * y + f4(1.0572252f) * z;
+      },
+      [&t](float linear) { return t.encode(linear); });
+}
+
+} // namespace ColorSpace
@@ -0,0 +1,110 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <QRgb>
+
+/**
+ * @namespace ColorSpace
+ * @brief Batch conversions of rows of RGB pixels to and from YCbCr, HSV,
+ * linear sRGB and CIE L*a*b*.
+ *
+ * Every conversion takes a run of count pixels, typically one image row, so
+ * that per-call setup is amortized and the loops can be vectorized. The
+ * converted values are written to, or read from, three channels described
+ * by Channels, either as three separate planes or interleaved.
+ *
+ * Exact conversions use tables: RGB to YCbCr sums tabulated products and is
+ * bit-exact with evaluating the same double expressions per pixel, sRGB
+ * decoding is a 256-entry table, and encoding linear values back to 8 bits
+ * searches the exact rounding thresholds. HSV and Lab, which need divisions
+ * and cube roots, are computed in single precision on four pixels at a time
+ * with SSE2 where available.
+ *
+ * Alpha is ignored: converted pixels are opaque.
+ */
+namespace ColorSpace {
+
+/**
+ * @brief Three channels of a run of pixels: channel k of pixel i is
+ * c[k][i * step].
+ *
+ * Planar data uses three arrays and a step of 1; interleaved data uses one
+ * array, the channels starting at consecutive elements, and a step of 3.
+ */
+template <typename T> struct Channels {
+  T *c[3];
+  int step = 1;
+
+  /** @brief Three separate planes. */
+  static Channels planar(T *c0, T *c1, T *c2) { return {{c0, c1, c2}, 1}; }
+
+  /** @brief One array holding c0, c1, c2 of every pixel in turn. */
+  static Channels interleaved(T *values) {
+    return {{values, values + 1, values + 2}, 3};
+  }
+
+  T &at(int channel, int i) const { return c[channel][i * step]; }
+};
+
+/**
+ * @brief Converts to full-range YCbCr (BT.601, as in JPEG): Y in 0..255, Cb
+ * and Cr centred on 128.
+ *
+ * Y = 0.299 R + 0.587 G + 0.114 B, Cb = 128 - 0.168736 R - 0.331264 G +
+ * 0.5 B, Cr = 128 + 0.5 R - 0.418688 G - 0.081312 B, evaluated left to right
+ * in double precision; the results are identical to evaluating these
+ * expressions per pixel.
+ */
+void rgbToYCbCr(const QRgb *in, int count, Channels<double> out);
+
+/**
+ * @brief Converts YCbCr back to RGB: R = Y + 1.402 (Cr - 128),
+ * G = Y - 0.344136 (Cb - 128) - 0.714136 (Cr - 128), B = Y + 1.772 (Cb - 128),
+ * each truncated towards zero and clamped to 0..255.
+ */
+void yCbCrToRgb(Channels<const double> in, int count, QRgb *out);
+
+/**
+ * @brief Converts to HSV: hue in degrees, 0 up to 360, saturation and value
+ * in 0..1. Grays have hue and saturation 0.
+ */
+void rgbToHsv(const QRgb *in, int count, Channels<float> out);
+
+/**
+ * @brief Converts HSV back to RGB, rounding to the nearest 8-bit values.
+ * Hues outside 0..360 wrap around; saturation and value are clamped to 0..1.
+ */
+void hsvToRgb(Channels<const float> in, int count, QRgb *out);
+
+/**
+ * @brief Decodes sRGB to linear light, each channel in 0..1.
+ */
+void rgbToLinear(const QRgb *in, int count, Channels<float> out);
+
+/**
+ * @brief Encodes linear light as sRGB, each channel rounded to the nearest
+ * 8-bit value and clamped to 0..255.
+ */
+void linearToRgb(Channels<const float> in, int count, QRgb *out);
+
+/**
+ * @brief Converts to CIE L*a*b* with the D65 white point: L* in 0..100,
+ * a* and b* roughly in -128..127.
+ */
+void rgbToLab(const QRgb *in, int count, Channels<float> out);
+
+/**
+ * @brief Converts CIE L*a*b* (D65) back to sRGB; colors outside the sRGB
+ * gamut are clamped per channel.
+ */
+void labToRgb(Channels<const float> in, int count, QRgb *out);
+
+/** @brief Decodes one sRGB channel value to linear light in 0..1. */
+float srgbToLinear(int value);
+
+/** @brief Encodes linear light as the nearest 8-bit sRGB value. */
+int linearToSrgb(float linear);
+
+} // namespace ColorSpace
+
+#endif // COLORSPACE_H
@@ -1,6 +1,7 @@
 #include "cylinderwidget.h"
 #include "cylindermesh.h"
 #include "drawingengine.h"
+#include "telemetry.h"
 #include <QPainter>
 #include <QWheelEvent>
 #include <QFileDialog>
@@ -254,6 +255,7 @@ void CylinderWidget::rasterTriangle(QImage& buf,const Frag& A,const Frag& B,cons
 /* ========= scene ================================================== */
 void CylinderWidget::drawScene(QImage& buf)
 {
+    Telemetry::ScopedTimer timer("CylinderWidget::drawScene", buf);
     fillMatrices();
 
     QVector<Frag> frag(vbo.size());
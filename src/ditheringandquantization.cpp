@@ -1,210 +1,1112 @@
 #include "ditheringandquantization.h"
+#include "bluenoise.h"
+#include "colorspace.h"
+#include "histogram.h"
+#include "jobcontext.h"
+#include "nearestcolor.h"
+#include "parallel.h"
+#include "telemetry.h"
 #include <QColor>
-#include <QMap>
-#include <QPair>
+#include <QElapsedTimer>
 #include <QtMath>
 #include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DQ_HAVE_SSE2 1
+#endif
 
 namespace {
-/* --- Helper: Predefined Threshold Matrices --- */
-static QVector<QVector<int>> getThresholdMatrix(int size) {
-  if (size == 2) {
-    return {{0, 2}, {3, 1}};
+/* --- Helper: Threshold Matrices --- */
+
+/* Bayer matrix of a power-of-two size n, row-major, built recursively:
+ *
+ *   M(2k) = | 4 M(k)      4 M(k) + 2 |
+ *           | 4 M(k) + 3  4 M(k) + 1 |
+ *
+ * Evaluated at compile time. */
+template <int N> constexpr std::array<int, N * N> bayerMatrix() {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "size must be a power of two");
+  std::array<int, N * N> m{};
+  if constexpr (N > 1) {
+    constexpr int h = N / 2;
+    constexpr std::array<int, h * h> half = bayerMatrix<h>();
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < h; ++x) {
+        const int v = 4 * half[y * h + x];
+        m[y * N + x] = v;
+        m[y * N + x + h] = v + 2;
+        m[(y + h) * N + x] = v + 3;
+        m[(y + h) * N + x + h] = v + 1;
+      }
+    }
+  }
+  return m;
+}
+
+constexpr std::array<int, 4> Bayer2 = bayerMatrix<2>();
+constexpr std::array<int, 16> Bayer4 = bayerMatrix<4>();
+constexpr std::array<int, 64> Bayer8 = bayerMatrix<8>();
+constexpr std::array<int, 256> Bayer16 = bayerMatrix<16>();
+constexpr std::array<int, 1024> Bayer32 = bayerMatrix<32>();
+constexpr std::array<int, 4096> Bayer64 = bayerMatrix<64>();
+
+template <size_t N>
+constexpr bool sameCells(const std::array<int, N> &a,
+                         const std::array<int, N> &b) {
+  for (size_t i = 0; i < N; ++i)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
+// The 2x2 and 4x4 matrices used to be spelled out; keep them identical.
+static_assert(sameCells(Bayer2, {0, 2, 3, 1}));
+static_assert(sameCells(Bayer4, {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15,
+                                 7, 13, 5}));
+
+/* The sizes that are not powers of two. */
+constexpr std::array<int, 9> Matrix3 = {6, 8, 4, 1, 0, 3, 5, 2, 7};
+constexpr std::array<int, 36> Matrix6 = {
+    0,  32, 8,  40, 2,  34, 48, 16, 56, 24, 50, 18, 12, 44, 4,  36, 14, 46,
+    60, 28, 52, 20, 62, 30, 3,  35, 11, 43, 1,  33, 51, 19, 59, 27, 49, 17};
+
+/* A threshold matrix of size x size cells, row-major, in static storage. */
+struct ThresholdMatrix {
+  int size;
+  const int *cells;
+
+  int at(int i, int j) const { return cells[j * size + i]; }
+};
+
+ThresholdMatrix thresholdMatrix(int size) {
+  switch (size) {
+  case 3:
+    return {3, Matrix3.data()};
+  case 4:
+    return {4, Bayer4.data()};
+  case 6:
+    return {6, Matrix6.data()};
+  case 8:
+    return {8, Bayer8.data()};
+  case 16:
+    return {16, Bayer16.data()};
+  case 32:
+    return {32, Bayer32.data()};
+  case 64:
+    return {64, Bayer64.data()};
+  default:
+    return {2, Bayer2.data()};
+  }
+}
+
+using DitheringAndQuantization::OutputFormat;
+
+/* Most levels per channel whose combinations fit in an 8-bit color table. */
+constexpr int MaxIndexedLevels = 6;
+
+/* The color table of an indexed result quantized to scaled.size() levels per
+ * channel, scaled[q] being the value of level q: colors are ordered by the
+ * index (r * levels + g) * levels + b of their levels. Empty if the result
+ * is RGB32, because it was not asked for or because of too many levels. */
+QVector<QRgb> levelPalette(const std::vector<quint8> &scaled,
+                           OutputFormat format) {
+  const int levels = int(scaled.size());
+  QVector<QRgb> palette;
+  if (format != OutputFormat::Indexed8 || levels > MaxIndexedLevels)
+    return palette;
+  palette.reserve(levels * levels * levels);
+  for (int r = 0; r < levels; ++r)
+    for (int g = 0; g < levels; ++g)
+      for (int b = 0; b < levels; ++b)
+        palette.append(qRgb(scaled[r], scaled[g], scaled[b]));
+  return palette;
+}
+
+/* The image results are written into: Indexed8 with the palette as color
+ * table if that was asked for and the palette fits, RGB32 otherwise. */
+QImage outputImage(const QSize &size, const QVector<QRgb> &palette,
+                   OutputFormat format) {
+  if (format != OutputFormat::Indexed8 || palette.isEmpty() ||
+      palette.size() > 256)
+    return QImage(size, QImage::Format_RGB32);
+  QImage image(size, QImage::Format_Indexed8);
+  image.setColorTable(palette);
+  return image;
+}
+
+/* Output value of each of the levels of ordered dithering. */
+std::vector<quint8> orderedDitherLevels(int levels) {
+  std::vector<quint8> scaled(levels);
+  for (int q = 0; q < levels; ++q)
+    scaled[q] = quint8(int(q * 255.0 / (levels - 1)));
+  return scaled;
+}
+
+/* Output of ordered dithering for every matrix cell and channel value:
+ * entry ((j * n + i) * 256 + v) is the result for value v at x % n == i,
+ * y % n == j, or its level q if levelIndices is set. The entries follow the
+ * per-pixel formula step by step:
+ *
+ *   v_norm = v / 255 * levels, q = floor(v_norm), frac = v_norm - q,
+ *   T = (matrix[j][i] + 0.5) / (n * n), q += frac > T,
+ *   output = clamp(q, 0, levels - 1) scaled back to 0..255,
+ *
+ * in the same double precision arithmetic, so the table is bit-exact with
+ * evaluating it per pixel. Only the comparison depends on the cell, so q and
+ * frac are computed once per value, which keeps building the table cheap
+ * even for a 64x64 matrix. */
+std::vector<quint8> orderedDitherTable(const ThresholdMatrix &matrix,
+                                       int levels, bool levelIndices) {
+  const int n = matrix.size;
+  const int matrixMax = n * n;
+
+  int base[256];
+  double frac[256];
+  for (int v = 0; v < 256; ++v) {
+    double v_norm = (v / 255.0) * levels;
+    base[v] = int(floor(v_norm));
+    frac[v] = v_norm - base[v];
+  }
+  std::vector<quint8> scaled = orderedDitherLevels(levels);
+  if (levelIndices)
+    for (int q = 0; q < levels; ++q)
+      scaled[q] = quint8(q);
+
+  std::vector<quint8> table(size_t(matrixMax) * 256);
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      const double T = (matrix.at(i, j) + 0.5) / double(matrixMax);
+      quint8 *cell = table.data() + size_t(j * n + i) * 256;
+      for (int v = 0; v < 256; ++v) {
+        int q = base[v] + (frac[v] > T ? 1 : 0);
+        cell[v] = scaled[std::clamp(q, 0, levels - 1)];
+      }
+    }
+  }
+  return table;
+}
+
+/* Ordered dithering of src (RGB32) into dst, which is RGB32 or indexed with
+ * the color table of levelPalette(). The output of a channel only depends
+ * on its value and on the position in the threshold matrix, so it is looked
+ * up in a table of n * n * 256 bytes built once per call. Returns the number
+ * of threads used, 0 if the job was cancelled. */
+int ditherWithTable(const QImage &src, QImage &dst,
+                    const ThresholdMatrix &matrix, int levels) {
+  const bool indexed = dst.format() == QImage::Format_Indexed8;
+  const std::vector<quint8> table =
+      orderedDitherTable(matrix, levels, indexed);
+  const int n = matrix.size;
+  const int width = src.width();
+
+  return Parallel::forRows(
+      src.height(), width, [&](int begin, int end, int) {
+        for (int y = begin; y < end; ++y) {
+          const QRgb *in = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+          const quint8 *row = table.data() + size_t(y % n) * n * 256;
+          if (indexed) {
+            uchar *out = dst.scanLine(y);
+            for (int x = 0, i = 0; x < width; ++x) {
+              const quint8 *t = row + i * 256;
+              out[x] = uchar((t[qRed(in[x])] * levels + t[qGreen(in[x])]) *
+                                 levels +
+                             t[qBlue(in[x])]);
+              if (++i == n)
+                i = 0;
+            }
+            continue;
+          }
+          QRgb *out = reinterpret_cast<QRgb *>(dst.scanLine(y));
+          for (int x = 0, i = 0; x < width; ++x) {
+            const quint8 *t = row + i * 256;
+            out[x] = qRgb(t[qRed(in[x])], t[qGreen(in[x])], t[qBlue(in[x])]);
+            if (++i == n)
+              i = 0;
+          }
+        }
+      });
+}
+
+/* Maps every pixel of src (RGB32) to its nearest palette color, in parallel,
+ * into a new image of the given format. Returns the number of threads used,
+ * 0 if the job was cancelled. */
+int mapToPalette(const QImage &src, const QVector<QRgb> &palette,
+                 QImage &dst, OutputFormat format) {
+  const NearestColorLookup lookup(palette);
+  const int width = src.width();
+  dst = outputImage(src.size(), palette, format);
+  const bool indexed = dst.format() == QImage::Format_Indexed8;
+  return Parallel::forRows(src.height(), width, [&](int begin, int end, int) {
+    for (int y = begin; y < end; ++y) {
+      const QRgb *in = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+      if (indexed) {
+        uchar *out = dst.scanLine(y);
+        for (int x = 0; x < width; ++x)
+          out[x] = uchar(lookup.nearestIndex(in[x]));
+        continue;
+      }
+      QRgb *out = reinterpret_cast<QRgb *>(dst.scanLine(y));
+      for (int x = 0; x < width; ++x)
+        out[x] = lookup.nearest(in[x]);
+    }
+  });
+}
+
+inline int channelOf(QRgb color, int axis) {
+  return axis == 0 ? qRed(color) : axis == 1 ? qGreen(color) : qBlue(color);
+}
+
+/* Rounded weighted mean of a set of colors. */
+QRgb meanColor(quint64 red, quint64 green, quint64 blue, quint64 count) {
+  return qRgb(int((red + count / 2) / count), int((green + count / 2) / count),
+              int((blue + count / 2) / count));
+}
+
+/* A box of median cut: a range of the color list, with the channel of
+ * largest extent. */
+struct ColorBox {
+  int begin;
+  int end;
+  quint64 weight = 0;
+  int axis = 0;
+  int low = 0;  ///< Smallest value of the axis channel.
+  int high = 0; ///< Largest value of the axis channel.
+};
+
+ColorBox measureBox(const std::vector<Histogram::ColorCount> &colors,
+                    int begin, int end) {
+  ColorBox box{begin, end};
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  for (int k = begin; k < end; ++k) {
+    box.weight += colors[k].count;
+    for (int a = 0; a < 3; ++a) {
+      int v = channelOf(colors[k].color, a);
+      lo[a] = std::min(lo[a], v);
+      hi[a] = std::max(hi[a], v);
+    }
   }
-  if (size == 3) {
-    return {{6, 8, 4}, {1, 0, 3}, {5, 2, 7}};
+  for (int a = 0; a < 3; ++a) {
+    if (a == 0 || hi[a] - lo[a] > box.high - box.low) {
+      box.axis = a;
+      box.low = lo[a];
+      box.high = hi[a];
+    }
   }
-  if (size == 4) {
-    return {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+  return box;
+}
+
+/* Median cut: starting from one box holding all colors, repeatedly splits
+ * the box with the largest extent along that channel, at the pixel-weighted
+ * median, until there are maxColors boxes or no box can be split. Each box
+ * yields the weighted mean of its colors.
+ *
+ * The median is found from the weights of the 256 channel values and the box
+ * is partitioned around it, so a split is linear in the size of the box. */
+QVector<QRgb> medianCutPalette(std::vector<Histogram::ColorCount> colors,
+                               int maxColors) {
+  std::vector<ColorBox> boxes{measureBox(colors, 0, int(colors.size()))};
+  while (int(boxes.size()) < maxColors) {
+    int pick = -1, extent = 0;
+    for (int b = 0; b < int(boxes.size()); ++b) {
+      const ColorBox &box = boxes[b];
+      const int e = box.high - box.low;
+      if (e > extent || (e > 0 && e == extent &&
+                         box.weight > boxes[pick].weight)) {
+        pick = b;
+        extent = e;
+      }
+    }
+    if (pick < 0)
+      break;
+
+    // Split below the value at which half the weight is reached, keeping at
+    // least the highest value for the upper box.
+    const ColorBox box = boxes[pick];
+    const int axis = box.axis;
+    quint64 weights[256] = {};
+    for (int k = box.begin; k < box.end; ++k)
+      weights[channelOf(colors[k].color, axis)] += colors[k].count;
+    int median = box.low;
+    for (quint64 sum = weights[median]; sum * 2 < box.weight;)
+      sum += weights[++median];
+    median = std::min(median, box.high - 1);
+
+    const int mid = int(
+        std::partition(colors.begin() + box.begin, colors.begin() + box.end,
+                       [axis, median](const Histogram::ColorCount &c) {
+                         return channelOf(c.color, axis) <= median;
+                       }) -
+        colors.begin());
+    boxes[pick] = measureBox(colors, box.begin, mid);
+    boxes.push_back(measureBox(colors, mid, box.end));
   }
-  if (size == 6) {
-    return {{0, 32, 8, 40, 2, 34},   {48, 16, 56, 24, 50, 18},
-            {12, 44, 4, 36, 14, 46}, {60, 28, 52, 20, 62, 30},
-            {3, 35, 11, 43, 1, 33},  {51, 19, 59, 27, 49, 17}};
+
+  QVector<QRgb> palette;
+  for (const ColorBox &box : boxes) {
+    quint64 red = 0, green = 0, blue = 0;
+    for (int k = box.begin; k < box.end; ++k) {
+      red += quint64(qRed(colors[k].color)) * colors[k].count;
+      green += quint64(qGreen(colors[k].color)) * colors[k].count;
+      blue += quint64(qBlue(colors[k].color)) * colors[k].count;
+    }
+    palette.append(meanColor(red, green, blue, box.weight));
   }
-  return getThresholdMatrix(2);
+  return palette;
+}
+
+/* Octree quantization. Colors are inserted down to Depth levels, so leaves
+ * stand for the top Depth bits of each channel; every node accumulates the
+ * exact sums of the colors below it. The tree is then reduced bottom-up,
+ * turning the least populated inner nodes of the deepest level into leaves,
+ * until maxColors leaves remain.
+ *
+ * Nodes live in one vector and refer to each other by index, so building
+ * the tree allocates only when the vector grows. */
+class Octree {
+public:
+  static constexpr int Depth = 6;
+
+  explicit Octree(const std::vector<Histogram::ColorCount> &colors) {
+    nodes.reserve(std::min<size_t>(colors.size() * Depth + 1, MaxNodes));
+    nodes.emplace_back();
+    inner[0].push_back(0);
+    for (const Histogram::ColorCount &c : colors)
+      insert(c);
+  }
+
+  QVector<QRgb> palette(int maxColors) {
+    for (int level = Depth - 1; level >= 0 && leaves > maxColors; --level) {
+      std::vector<int> &candidates = inner[level];
+      std::sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        return nodes[a].count != nodes[b].count
+                   ? nodes[a].count < nodes[b].count
+                   : a < b;
+      });
+      for (int i = 0; i < int(candidates.size()) && leaves > maxColors; ++i)
+        reduce(candidates[i], maxColors);
+    }
+    QVector<QRgb> result;
+    collect(0, result);
+    return result;
+  }
+
+private:
+  struct Node {
+    quint64 red = 0, green = 0, blue = 0, count = 0;
+    int children[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    bool leaf = false;
+  };
+
+  /* 1 + 8 + ... + 8^Depth. */
+  static constexpr size_t MaxNodes = ((size_t(1) << (3 * (Depth + 1))) - 1) / 7;
+
+  void insert(const Histogram::ColorCount &c) {
+    const int r = qRed(c.color), g = qGreen(c.color), b = qBlue(c.color);
+    int node = 0;
+    for (int level = 0;; ++level) {
+      Node &n = nodes[node];
+      n.red += quint64(r) * c.count;
+      n.green += quint64(g) * c.count;
+      n.blue += quint64(b) * c.count;
+      n.count += c.count;
+      if (level == Depth)
+        return;
+      const int bit = 7 - level;
+      const int octant =
+          ((r >> bit) & 1) << 2 | ((g >> bit) & 1) << 1 | ((b >> bit) & 1);
+      int child = n.children[octant];
+      if (child < 0) {
+        child = int(nodes.size());
+        nodes[node].children[octant] = child;
+        nodes.emplace_back(); // May move the nodes; n is not used below.
+        if (level + 1 == Depth) {
+          nodes[child].leaf = true;
+          ++leaves;
+        } else {
+          inner[level + 1].push_back(child);
+        }
+      }
+      node = child;
+    }
+  }
+
+  /* Makes an inner node whose children are all leaves a leaf itself. If that
+   * would leave fewer than maxColors leaves, only its least populated
+   * children are merged, into the first of them, so that exactly maxColors
+   * remain. */
+  void reduce(int node, int maxColors) {
+    Node &n = nodes[node];
+    std::vector<int> children;
+    for (int child : n.children)
+      if (child >= 0)
+        children.push_back(child);
+    const int count = int(children.size());
+    if (leaves - (count - 1) >= maxColors) {
+      leaves -= count - 1;
+      n.leaf = true;
+      return;
+    }
+
+    std::sort(children.begin(), children.end(), [this](int a, int b) {
+      return nodes[a].count != nodes[b].count ? nodes[a].count < nodes[b].count
+                                              : a < b;
+    });
+    const int merged = leaves - maxColors + 1;
+    Node &into = nodes[children[0]];
+    for (int k = 1; k < merged; ++k) {
+      const Node &from = nodes[children[k]];
+      into.red += from.red;
+      into.green += from.green;
+      into.blue += from.blue;
+      into.count += from.count;
+      std::replace(std::begin(n.children), std::end(n.children), children[k],
+                   -1);
+    }
+    leaves = maxColors;
+  }
+
+  void collect(int node, QVector<QRgb> &result) const {
+    const Node &n = nodes[node];
+    if (n.count == 0)
+      return;
+    if (n.leaf) {
+      result.append(meanColor(n.red, n.green, n.blue, n.count));
+      return;
+    }
+    for (int child : n.children)
+      if (child >= 0)
+        collect(child, result);
+  }
+
+  std::vector<Node> nodes; ///< Node 0 is the root.
+  std::array<std::vector<int>, Depth> inner; ///< Inner nodes per level.
+  int leaves = 0;
+};
+
+/* Lloyd's k-means over a weighted color histogram.
+ *
+ * Colors and centroids are stored as separate float channels. Colors are
+ * padded to a multiple of 4 with weightless entries, so the assignment
+ * kernel compares 4 colors against one centroid per step without a
+ * remainder loop. Each thread sums the colors it assigns into its own
+ * accumulators, which are added up once per iteration. */
+class KMeans {
+public:
+  KMeans(const std::vector<Histogram::ColorCount> &colors,
+         const QVector<QRgb> &palette)
+      : count(int(colors.size())), padded((count + 3) & ~3),
+        k(int(palette.size())), red(padded), green(padded), blue(padded),
+        weight(padded), assignment(padded, -1), centroidRed(k),
+        centroidGreen(k), centroidBlue(k), clusterWeight(k) {
+    for (int i = 0; i < count; ++i) {
+      red[i] = float(qRed(colors[i].color));
+      green[i] = float(qGreen(colors[i].color));
+      blue[i] = float(qBlue(colors[i].color));
+      weight[i] = colors[i].count;
+    }
+    for (int c = 0; c < k; ++c) {
+      centroidRed[c] = float(qRed(palette[c]));
+      centroidGreen[c] = float(qGreen(palette[c]));
+      centroidBlue[c] = float(qBlue(palette[c]));
+    }
+  }
+
+  /* One assignment and update step. Returns the largest squared distance a
+   * centroid moved, or a negative value if the job was cancelled. */
+  double iterate(bool &changed) {
+    const int blocks = padded / 4;
+    const long long cost = 4LL * k;
+    const int threads = Parallel::threadsFor(blocks, cost);
+    std::vector<std::vector<Sums>> partial(threads,
+                                           std::vector<Sums>(size_t(k)));
+    std::vector<char> moved(threads, 0);
+
+    const int used =
+        Parallel::forRows(blocks, cost, [&](int begin, int end, int thread) {
+          std::vector<Sums> &sums = partial[thread];
+          for (int block = begin; block < end; ++block) {
+            int nearest[4];
+            assignBlock(block * 4, nearest);
+            for (int j = 0; j < 4; ++j) {
+              const int i = block * 4 + j;
+              if (weight[i] == 0)
+                continue;
+              if (assignment[i] != nearest[j]) {
+                assignment[i] = nearest[j];
+                moved[thread] = 1;
+              }
+              Sums &s = sums[nearest[j]];
+              const double w = weight[i];
+              s.red += w * red[i];
+              s.green += w * green[i];
+              s.blue += w * blue[i];
+              s.weight += w;
+            }
+          }
+        });
+    if (used == 0)
+      return -1.0;
+
+    changed = std::find(moved.begin(), moved.end(), 1) != moved.end();
+    assigned = true;
+    double shift = 0.0;
+    for (int c = 0; c < k; ++c) {
+      Sums total;
+      for (const std::vector<Sums> &sums : partial) {
+        total.red += sums[c].red;
+        total.green += sums[c].green;
+        total.blue += sums[c].blue;
+        total.weight += sums[c].weight;
+      }
+      clusterWeight[c] = total.weight;
+      if (total.weight == 0)
+        continue; // An empty cluster keeps its centroid.
+      const float r = float(total.red / total.weight);
+      const float g = float(total.green / total.weight);
+      const float b = float(total.blue / total.weight);
+      const double dr = r - centroidRed[c], dg = g - centroidGreen[c],
+                   db = b - centroidBlue[c];
+      shift = std::max(shift, dr * dr + dg * dg + db * db);
+      centroidRed[c] = r;
+      centroidGreen[c] = g;
+      centroidBlue[c] = b;
+    }
+    return shift;
+  }
+
+  /* The rounded centroids, in their original order, without those that
+   * received no color in the last iteration. */
+  QVector<QRgb> palette() const {
+    QVector<QRgb> result;
+    for (int c = 0; c < k; ++c) {
+      if (!assigned || clusterWeight[c] > 0)
+        result.append(qRgb(qRound(centroidRed[c]), qRound(centroidGreen[c]),
+                           qRound(centroidBlue[c])));
+    }
+    return result;
+  }
+
+private:
+  struct Sums {
+    double red = 0, green = 0, blue = 0, weight = 0;
+  };
+
+  /* Finds the nearest centroid of colors first..first + 3; ties go to the
+   * lowest centroid index. */
+  void assignBlock(int first, int *nearest) const {
+#ifdef DQ_HAVE_SSE2
+    const __m128 r = _mm_loadu_ps(&red[first]);
+    const __m128 g = _mm_loadu_ps(&green[first]);
+    const __m128 b = _mm_loadu_ps(&blue[first]);
+    __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128i index = _mm_setzero_si128();
+    for (int c = 0; c < k; ++c) {
+      const __m128 dr = _mm_sub_ps(r, _mm_set1_ps(centroidRed[c]));
+      const __m128 dg = _mm_sub_ps(g, _mm_set1_ps(centroidGreen[c]));
+      const __m128 db = _mm_sub_ps(b, _mm_set1_ps(centroidBlue[c]));
+      const __m128 d = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+          _mm_mul_ps(db, db));
+      const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+      best = _mm_min_ps(d, best);
+      index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(c)),
+                           _mm_andnot_si128(closer, index));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(nearest), index);
+#else
+    for (int j = 0; j < 4; ++j) {
+      float best = std::numeric_limits<float>::max();
+      nearest[j] = 0;
+      for (int c = 0; c < k; ++c) {
+        const float dr = red[first + j] - centroidRed[c];
+        const float dg = green[first + j] - centroidGreen[c];
+        const float db = blue[first + j] - centroidBlue[c];
+        const float d = dr * dr + dg * dg + db * db;
+        if (d < best) {
+          best = d;
+          nearest[j] = c;
+        }
+      }
+    }
+#endif
+  }
+
+  const int count, padded, k;
+  std::vector<float> red, green, blue;
+  std::vector<quint32> weight;
+  std::vector<int> assignment;
+  std::vector<float> centroidRed, centroidGreen, centroidBlue;
+  std::vector<double> clusterWeight;
+  bool assigned = false; ///< Whether an iteration has run.
+};
+
+/* Error diffusion kernels spread the error of a pixel to neighbours at most
+ * DiffusionReach columns to either side and rows below. */
+constexpr int DiffusionReach = 2;
+
+struct DiffusionTap {
+  int dx;
+  int dy;
+  int weight;
+};
+
+struct DiffusionMatrix {
+  int divisor;
+  std::vector<DiffusionTap> taps;
+};
+
+const DiffusionMatrix &
+diffusionMatrix(DitheringAndQuantization::DiffusionKernel kernel) {
+  using DitheringAndQuantization::DiffusionKernel;
+  static const DiffusionMatrix floydSteinberg{
+      16, {{1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}};
+  static const DiffusionMatrix jarvisJudiceNinke{
+      48,
+      {{1, 0, 7}, {2, 0, 5},                                  //
+       {-2, 1, 3}, {-1, 1, 5}, {0, 1, 7}, {1, 1, 5}, {2, 1, 3}, //
+       {-2, 2, 1}, {-1, 2, 3}, {0, 2, 5}, {1, 2, 3}, {2, 2, 1}}};
+  static const DiffusionMatrix stucki{
+      42,
+      {{1, 0, 8}, {2, 0, 4},                                  //
+       {-2, 1, 2}, {-1, 1, 4}, {0, 1, 8}, {1, 1, 4}, {2, 1, 2}, //
+       {-2, 2, 1}, {-1, 2, 2}, {0, 2, 4}, {1, 2, 2}, {2, 2, 1}}};
+  // Atkinson diffuses only 6/8 of the error, which keeps contrast.
+  static const DiffusionMatrix atkinson{
+      8, {{1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1}}};
+  switch (kernel) {
+  case DiffusionKernel::JarvisJudiceNinke:
+    return jarvisJudiceNinke;
+  case DiffusionKernel::Stucki:
+    return stucki;
+  case DiffusionKernel::Atkinson:
+    return atkinson;
+  case DiffusionKernel::FloydSteinberg:
+    break;
+  }
+  return floydSteinberg;
+}
+
+/* Divides an accumulated error by the kernel divisor, rounding to nearest
+ * with ties away from zero, so positive and negative errors are symmetric. */
+inline int divideError(int error, int divisor) {
+  return error >= 0 ? (error + divisor / 2) / divisor
+                    : -((divisor / 2 - error) / divisor);
+}
+
+/* A quantized pixel: its color, and its index into the color table of an
+ * indexed result. */
+struct Quantized {
+  QRgb color;
+  int index;
+};
+
+/* Error diffusion of src (RGB32) into dst, RGB32 or indexed; quantize(r, g,
+ * b) returns the Quantized output for channel values in 0..255. Returns the
+ * number of threads used, 0 if the job was cancelled.
+ *
+ * Rows run as a skewed wavefront: row y processes pixel x only once row
+ * y - 1 has finished pixel x + 2 * DiffusionReach, so the errors row y reads
+ * are complete and the cells both rows write never overlap. Each row
+ * publishes its progress every ProgressStep pixels. With T threads at most T
+ * consecutive rows are in flight, and they write into the error rows of
+ * themselves and the DiffusionReach rows below, so a ring of
+ * T + DiffusionReach error rows suffices. Errors are kept as integer
+ * numerators over the kernel divisor.
+ *
+ * Serpentine scanning reverses every other row, so a row depends on the very
+ * end of the row above it; it runs on one thread. */
+template <typename Quantize>
+int diffuseErrors(const QImage &src, QImage &dst, const DiffusionMatrix &m,
+                  bool serpentine, Quantize quantize) {
+  constexpr int ProgressStep = 64;
+  const int width = src.width(), height = src.height();
+  const long long cost = qint64(width) * qint64(m.taps.size());
+  const int limit = serpentine ? 1 : 0;
+  const int slots = Parallel::threadsFor(height, cost, limit) + DiffusionReach;
+  const int stride = (width + 2 * DiffusionReach) * 3;
+  std::vector<int> errors(size_t(slots) * stride, 0);
+  std::vector<std::atomic<int>> done(height);
+  const bool indexed = dst.format() == QImage::Format_Indexed8;
+  auto errorRow = [&](int y) {
+    return errors.data() + size_t(y % slots) * stride + DiffusionReach * 3;
+  };
+
+  return Parallel::forRowsInOrder(
+      height, cost,
+      [&](int y, int, int) {
+        if (y + DiffusionReach < height) {
+          int *below = errorRow(y + DiffusionReach) - DiffusionReach * 3;
+          std::fill(below, below + stride, 0);
+        }
+        int *rows[DiffusionReach + 1];
+        for (int dy = 0; dy <= DiffusionReach; ++dy)
+          rows[dy] = errorRow(y + dy);
+
+        const bool reverse = serpentine && (y % 2 == 1);
+        const int step = reverse ? -1 : 1;
+        const QRgb *in = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+        QRgb *out =
+            indexed ? nullptr : reinterpret_cast<QRgb *>(dst.scanLine(y));
+        uchar *outIndex = indexed ? dst.scanLine(y) : nullptr;
+        int ready = y == 0 ? width : 0;
+        for (int k = 0; k < width; ++k) {
+          if (k % ProgressStep == 0 && k > 0)
+            done[y].store(k, std::memory_order_release);
+          const int need = std::min(width, k + 2 * DiffusionReach + 1);
+          while (ready < need) {
+            ready = done[y - 1].load(std::memory_order_acquire);
+            if (ready >= need)
+              break;
+            if (JobContext::cancellationRequested())
+              return;
+            std::this_thread::yield();
+          }
+
+          const int x = reverse ? width - 1 - k : k;
+          const int *e = rows[0] + x * 3;
+          const int r = std::clamp(qRed(in[x]) + divideError(e[0], m.divisor),
+                                   0, 255);
+          const int g = std::clamp(
+              qGreen(in[x]) + divideError(e[1], m.divisor), 0, 255);
+          const int b = std::clamp(
+              qBlue(in[x]) + divideError(e[2], m.divisor), 0, 255);
+          const Quantized quantized = quantize(r, g, b);
+          const QRgb q = quantized.color;
+          if (indexed)
+            outIndex[x] = uchar(quantized.index);
+          else
+            out[x] = q;
+          const int er = r - qRed(q), eg = g - qGreen(q), eb = b - qBlue(q);
+          // Errors pushed past the left or right edge land in the padding
+          // of the error rows and are never read.
+          for (const DiffusionTap &tap : m.taps) {
+            int *t = rows[tap.dy] + (x + tap.dx * step) * 3;
+            t[0] += er * tap.weight;
+            t[1] += eg * tap.weight;
+            t[2] += eb * tap.weight;
+          }
+        }
+        done[y].store(width, std::memory_order_release);
+      },
+      limit);
 }
 } // namespace
 
 namespace DitheringAndQuantization {
 
+QVector<int> thresholdMapSizes() { return {2, 3, 4, 6, 8, 16, 32, 64}; }
+
 /* --- Ordered Dithering --- */
 QImage applyOrderedDithering(const QImage &image, int thresholdMapSize,
-                             int levelsPerChannel) {
+                             int levelsPerChannel, OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyOrderedDithering", image);
   if (levelsPerChannel < 2)
     levelsPerChannel = 2; // At least 2 levels.
 
-  QVector<QVector<int>> thresholdMatrix = getThresholdMatrix(thresholdMapSize);
-  int matrixMax = thresholdMapSize * thresholdMapSize;
-  // Formula:
-  // v_norm = v / 255 * levelsPerChannel.
-  // q = floor(v_norm)
-  // frac = v_norm - q.
-  // T = (thresholdMatrix[x mod N][y mod N] + 0.5) / (matrixMax)
-  // If (frac > T) then q++.
-  // Output = clamp(q, 0, levelsPerChannel - 1) scaled back to 0-255.
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst = outputImage(
+      src.size(),
+      levelPalette(orderedDitherLevels(levelsPerChannel), format), format);
+  int threads = ditherWithTable(src, dst, thresholdMatrix(thresholdMapSize),
+                                levelsPerChannel);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+/* --- Blue-Noise Dithering --- */
+QImage applyBlueNoiseDithering(const QImage &image, int levelsPerChannel,
+                               OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyBlueNoiseDithering", image);
+  if (levelsPerChannel < 2)
+    levelsPerChannel = 2;
 
   QImage src = image.convertToFormat(QImage::Format_RGB32);
-  QImage dst(src.size(), QImage::Format_RGB32);
-  int width = src.width();
-  int height = src.height();
-
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      QColor origColor(src.pixel(x, y));
-      int newR = 0, newG = 0, newB = 0;
-      // Process each channel:
-      for (int channel = 0; channel < 3; ++channel) {
-        int v = 0;
-        if (channel == 0)
-          v = origColor.red();
-        else if (channel == 1)
-          v = origColor.green();
-        else if (channel == 2)
-          v = origColor.blue();
-
-        double v_norm = (v / 255.0) * levelsPerChannel; // value in [0, levels]
-        int q = int(floor(v_norm));
-        double frac = v_norm - q;
-        // Get threshold from matrix:
-        int i = x % thresholdMapSize;
-        int j = y % thresholdMapSize;
-        double T = (thresholdMatrix[j][i] + 0.5) / double(matrixMax);
-        if (frac > T) {
-          q++;
-        }
-        if (q < 0)
-          q = 0;
-        if (q >= levelsPerChannel)
-          q = levelsPerChannel - 1;
-        // Map q to 0..255:
-        int newVal = (levelsPerChannel > 1)
-                         ? int(q * 255.0 / (levelsPerChannel - 1))
-                         : 0;
-        if (channel == 0)
-          newR = newVal;
-        else if (channel == 1)
-          newG = newVal;
-        else if (channel == 2)
-          newB = newVal;
-      }
-      dst.setPixel(x, y, qRgb(newR, newG, newB));
-    }
-  }
+  QImage dst = outputImage(
+      src.size(),
+      levelPalette(orderedDitherLevels(levelsPerChannel), format), format);
+  const ThresholdMatrix mask{BlueNoise::MaskSize, BlueNoise::mask().data()};
+  int threads = ditherWithTable(src, dst, mask, levelsPerChannel);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
   return dst;
 }
 
 /* --- Ordered Dithering in YCbCr --- */
 QImage applyOrderedDitheringInYCbCr(const QImage &image, int thresholdMapSize,
                                     int levelsY) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyOrderedDitheringInYCbCr", image);
   if (levelsY <= 2)
     levelsY = 3;
   else if (levelsY % 2 == 0)
     levelsY = levelsY + 1;
 
-  QVector<QVector<int>> thresholdMatrix = getThresholdMatrix(thresholdMapSize);
-  int matrixSize = thresholdMapSize;
-  int matrixMax = matrixSize * matrixSize;
+  const ThresholdMatrix matrix = thresholdMatrix(thresholdMapSize);
+  const int matrixSize = matrix.size;
+  const int matrixMax = matrixSize * matrixSize;
+  std::vector<double> levelY(levelsY);
+  for (int q = 0; q < levelsY; ++q)
+    levelY[q] = q * 255.0 / (levelsY - 1);
 
   QImage src = image.convertToFormat(QImage::Format_RGB32);
   QImage dst(src.size(), QImage::Format_RGB32);
-  int width = src.width();
-  int height = src.height();
-
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      QColor origColor(src.pixel(x, y));
-      // Convert RGB to YCbCr
-      double R = origColor.red();
-      double G = origColor.green();
-      double B = origColor.blue();
-      double Y_val = 0.299 * R + 0.587 * G + 0.114 * B;
-      double Cb = 128 - 0.168736 * R - 0.331264 * G + 0.5 * B;
-      double Cr = 128 + 0.5 * R - 0.418688 * G - 0.081312 * B;
-
-      // --- Apply Ordered Dithering on the Y Channel ---
-      double y_norm = (Y_val / 255.0) * levelsY;
-      int q = int(floor(y_norm));
-      double frac = y_norm - q;
-      int i = x % matrixSize;
-      int j = y % matrixSize;
-      double T = (thresholdMatrix[j][i] + 0.5) / double(matrixMax);
-      if (frac > T)
-        q++;
-      q = std::clamp(q, 0, levelsY - 1);
-      double newY = (levelsY > 1) ? (q * 255.0 / (levelsY - 1)) : 0;
-
-      // --- Convert YCbCr back to RGB ---
-      int newR = int(newY + 1.402 * (Cr - 128));
-      int newG = int(newY - 0.344136 * (Cb - 128) - 0.714136 * (Cr - 128));
-      int newB = int(newY + 1.772 * (Cb - 128));
-      newR = std::clamp(newR, 0, 255);
-      newG = std::clamp(newG, 0, 255);
-      newB = std::clamp(newB, 0, 255);
-
-      dst.setPixel(x, y, qRgb(newR, newG, newB));
-    }
+  const int width = src.width();
+
+  // Rows are converted to YCbCr planes, Y is dithered in place, and the
+  // planes are converted back.
+  int threads = Parallel::forRows(
+      src.height(), width, [&](int begin, int end, int) {
+        std::vector<double> planes(size_t(width) * 3);
+        double *luma = planes.data(), *cb = luma + width, *cr = cb + width;
+        for (int y = begin; y < end; ++y) {
+          ColorSpace::rgbToYCbCr(
+              reinterpret_cast<const QRgb *>(src.constScanLine(y)), width,
+              ColorSpace::Channels<double>::planar(luma, cb, cr));
+          const int j = y % matrixSize;
+          for (int x = 0; x < width; ++x) {
+            double y_norm = (luma[x] / 255.0) * levelsY;
+            int q = int(floor(y_norm));
+            double frac = y_norm - q;
+            double T = (matrix.at(x % matrixSize, j) + 0.5) / double(matrixMax);
+            if (frac > T)
+              q++;
+            luma[x] = levelY[std::clamp(q, 0, levelsY - 1)];
+          }
+          ColorSpace::yCbCrToRgb(
+              ColorSpace::Channels<const double>::planar(luma, cb, cr), width,
+              reinterpret_cast<QRgb *>(dst.scanLine(y)));
+        }
+      });
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+/* --- Error Diffusion --- */
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           int levelsPerChannel, bool serpentine,
+                           OutputFormat format) {
+  Telemetry::ScopedTimer timer("DitheringAndQuantization::applyErrorDiffusion",
+                               image);
+  const int levels = std::clamp(levelsPerChannel, 2, 256);
+  std::vector<quint8> scaled(levels);
+  for (int q = 0; q < levels; ++q)
+    scaled[q] = quint8((q * 255 + (levels - 1) / 2) / (levels - 1));
+  quint8 level[256], nearest[256];
+  for (int v = 0; v < 256; ++v) {
+    level[v] = quint8((v * (levels - 1) + 127) / 255);
+    nearest[v] = scaled[level[v]];
   }
+
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst = outputImage(src.size(), levelPalette(scaled, format), format);
+  int threads = diffuseErrors(
+      src, dst, diffusionMatrix(kernel), serpentine,
+      [&level, &nearest, levels](int r, int g, int b) {
+        return Quantized{qRgb(nearest[r], nearest[g], nearest[b]),
+                         (level[r] * levels + level[g]) * levels + level[b]};
+      });
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
   return dst;
 }
 
-/* --- Popularity Quantization --- */
-QImage applyPopularityQuantization(const QImage &image, int numColors) {
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           const QVector<QRgb> &palette, bool serpentine,
+                           OutputFormat format) {
+  Telemetry::ScopedTimer timer("DitheringAndQuantization::applyErrorDiffusion",
+                               image);
   QImage src = image.convertToFormat(QImage::Format_RGB32);
-  int width = src.width();
-  int height = src.height();
+  if (palette.isEmpty())
+    return src;
 
-  // Step 1: Count frequencies of colors.
-  QMap<QRgb, int> colorFrequency;
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      QRgb pixel = src.pixel(x, y);
-      colorFrequency[pixel] += 1;
-    }
-  }
+  const NearestColorLookup lookup(palette);
+  QImage dst = outputImage(src.size(), palette, format);
+  int threads = diffuseErrors(
+      src, dst, diffusionMatrix(kernel), serpentine,
+      [&lookup, &palette](int r, int g, int b) {
+        const int i = lookup.nearestIndex(qRgb(r, g, b));
+        return Quantized{palette[i], i};
+      });
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
 
-  // Step 2: Sort colors by frequency.
-  QVector<QPair<QRgb, int>> freqList;
-  for (auto it = colorFrequency.begin(); it != colorFrequency.end(); ++it) {
-    freqList.append(qMakePair(it.key(), it.value()));
-  }
-  std::sort(freqList.begin(), freqList.end(),
-            [](const QPair<QRgb, int> &a, const QPair<QRgb, int> &b) {
-              return a.second > b.second;
-            });
+/* --- Popularity Quantization --- */
+QImage applyPopularityQuantization(const QImage &image, int numColors,
+                                   int bitsPerChannel, OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyPopularityQuantization", image);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
 
-  // Step 3: Select the top numColors.
+  // Steps 1-3: Count the colors and select the top numColors, most frequent
+  // first and ties in ascending QRgb order.
+  const std::vector<Histogram::ColorCount> top =
+      Histogram::mostFrequentColors(src, numColors, bitsPerChannel);
+  if (JobContext::cancellationRequested())
+    return QImage();
   QVector<QRgb> palette;
-  int count = qMin(numColors, freqList.size());
-  for (int i = 0; i < count; ++i) {
-    palette.append(freqList[i].first);
-  }
+  for (const Histogram::ColorCount &c : top)
+    palette.append(c.color);
   if (palette.isEmpty()) {
     return src;
   }
 
   // Step 4: For each pixel, find the nearest color in the palette.
-  QImage dst(src.size(), QImage::Format_RGB32);
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      QColor origColor(src.pixel(x, y));
-      int bestDist = 1e9;
-      QRgb bestColor = palette.first();
-      for (QRgb palColor : palette) {
-        QColor c(palColor);
-        int dr = origColor.red() - c.red();
-        int dg = origColor.green() - c.green();
-        int db = origColor.blue() - c.blue();
-        int dist = dr * dr + dg * dg + db * db;
-        if (dist < bestDist) {
-          bestDist = dist;
-          bestColor = palColor;
-        }
-      }
-      dst.setPixel(x, y, bestColor);
+  QImage dst;
+  int threads = mapToPalette(src, palette, dst, format);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+/* --- Median Cut Quantization --- */
+QImage applyMedianCutQuantization(const QImage &image, int numColors,
+                                  OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyMedianCutQuantization", image);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  std::vector<Histogram::ColorCount> colors = Histogram::colorCounts(src);
+  if (JobContext::cancellationRequested())
+    return QImage();
+  if (colors.empty() || numColors <= 0)
+    return src;
+
+  QImage dst;
+  int threads = mapToPalette(
+      src, medianCutPalette(std::move(colors), numColors), dst, format);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+/* --- Octree Quantization --- */
+QImage applyOctreeQuantization(const QImage &image, int numColors,
+                               OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyOctreeQuantization", image);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  const std::vector<Histogram::ColorCount> colors =
+      Histogram::colorCounts(src);
+  if (JobContext::cancellationRequested())
+    return QImage();
+  if (colors.empty() || numColors <= 0)
+    return src;
+
+  QImage dst;
+  int threads =
+      mapToPalette(src, Octree(colors).palette(numColors), dst, format);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+/* --- K-Means Refinement --- */
+namespace {
+/* Runs k-means on the counted colors of src (RGB32) and maps src to the
+ * result; the clock started when the call began. Sets threads to the number
+ * of threads of the mapping pass, 0 if the job was cancelled. */
+KMeansResult runKMeans(const QImage &src,
+                       const std::vector<Histogram::ColorCount> &colors,
+                       const QVector<QRgb> &initialPalette,
+                       const KMeansOptions &options, OutputFormat format,
+                       const QElapsedTimer &clock, int &threads) {
+  KMeansResult result;
+  threads = 1;
+  if (colors.empty() || initialPalette.isEmpty()) {
+    result.image = src;
+    result.palette = initialPalette;
+    return result;
+  }
+
+  KMeans kmeans(colors, initialPalette);
+  const double tolerance = options.tolerance * options.tolerance;
+  while (result.iterations < options.maxIterations) {
+    if (options.timeBudgetMs > 0 && clock.elapsed() >= options.timeBudgetMs)
+      break;
+    bool changed = false;
+    const double shift = kmeans.iterate(changed);
+    if (shift < 0) {
+      threads = 0;
+      return KMeansResult();
+    }
+    ++result.iterations;
+    if (!changed || shift <= tolerance) {
+      result.converged = true;
+      break;
     }
   }
-  return dst;
+
+  result.palette = kmeans.palette();
+  threads = mapToPalette(src, result.palette, result.image, format);
+  if (threads == 0)
+    return KMeansResult();
+  return result;
+}
+} // namespace
+
+KMeansResult refinePaletteKMeans(const QImage &image,
+                                 const QVector<QRgb> &initialPalette,
+                                 const KMeansOptions &options,
+                                 OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::refinePaletteKMeans", image);
+  QElapsedTimer clock;
+  clock.start();
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  const std::vector<Histogram::ColorCount> colors =
+      Histogram::colorCounts(src, options.bitsPerChannel);
+  if (JobContext::cancellationRequested())
+    return KMeansResult();
+
+  int threads = 0;
+  KMeansResult result =
+      runKMeans(src, colors, initialPalette, options, format, clock, threads);
+  if (threads > 0)
+    timer.setThreads(threads);
+  return result;
+}
+
+QImage applyKMeansQuantization(const QImage &image, int numColors,
+                               const KMeansOptions &options,
+                               OutputFormat format) {
+  Telemetry::ScopedTimer timer(
+      "DitheringAndQuantization::applyKMeansQuantization", image);
+  QElapsedTimer clock;
+  clock.start();
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  const std::vector<Histogram::ColorCount> colors =
+      Histogram::colorCounts(src, options.bitsPerChannel);
+  if (JobContext::cancellationRequested())
+    return QImage();
+  if (colors.empty() || numColors <= 0)
+    return src;
+
+  int threads = 0;
+  const KMeansResult result =
+      runKMeans(src, colors, medianCutPalette(colors, numColors), options,
+                format, clock, threads);
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return result.image;
 }
 
 } // namespace DitheringAndQuantization
@@ -4,22 +4,71 @@
 #include <QImage>
 #include <QVector>
 
+/**
+ * @namespace DitheringAndQuantization
+ * @brief Ordered dithering and color quantization algorithms.
+ *
+ * All functions report each row to the JobContext of the calling thread, which
+ * drives progress reporting, and return a null QImage when the job has been
+ * cancelled.
+ *
+ * Results are RGB32 by default. Functions taking an OutputFormat can instead
+ * return Format_Indexed8 images whose color table is the palette, written
+ * directly rather than converted afterwards.
+ */
 namespace DitheringAndQuantization {
+/**
+ * @brief Pixel format of the images returned by dithering and quantization.
+ */
+enum class OutputFormat {
+  RGB32, ///< QImage::Format_RGB32, like the other filters.
+  /// QImage::Format_Indexed8 with the palette as color table: a quarter of
+  /// the memory, and saved as a paletted PNG. Results that can have more
+  /// than 256 colors (e.g. more than 6 levels per channel) stay RGB32.
+  Indexed8,
+};
+
+/**
+ * @brief Returns the supported threshold matrix sizes in ascending order:
+ * 3 and 6, and the Bayer matrices of power-of-two sizes from 2 to 64.
+ */
+QVector<int> thresholdMapSizes();
+
 /**
  * @brief Applies an Ordered Dithering algorithm to a color image.
  *
  * This function applies ordered dithering to each color channel independently.
  * A threshold (Bayer) matrix of the specified size is used to decide whether to
  * round a channel value up or down based on its fractional quantization error.
+ * The result of each channel is looked up in a table precomputed per call,
+ * indexed by the matrix cell and the channel value.
  *
  * @param image The input color QImage.
- * @param thresholdMapSize The size of the threshold matrix (allowed values: 2,
- * 3, 4, or 6).
+ * @param thresholdMapSize The size of the threshold matrix, one of
+ * thresholdMapSizes(); other sizes use the 2×2 matrix. Larger matrices give
+ * smoother gradients at the same cost per pixel.
  * @param levelsPerChannel The number of quantization levels per channel.
+ * @param format The pixel format of the result.
  * @return A new QImage with the ordered dithering applied.
  */
 QImage applyOrderedDithering(const QImage &image, int thresholdMapSize,
-                             int levelsPerChannel);
+                             int levelsPerChannel,
+                             OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Applies ordered dithering with a blue-noise threshold mask.
+ *
+ * Works like applyOrderedDithering(), with the void-and-cluster mask of
+ * BlueNoise::mask() in place of a Bayer matrix: the dither pattern has no
+ * visible cross-hatch, at the same cost per pixel.
+ *
+ * @param image The input color QImage.
+ * @param levelsPerChannel The number of quantization levels per channel.
+ * @param format The pixel format of the result.
+ * @return A new QImage with the dithering applied.
+ */
+QImage applyBlueNoiseDithering(const QImage &image, int levelsPerChannel,
+                               OutputFormat format = OutputFormat::RGB32);
 
 /**
  * @brief Applies the Popularity Color Quantization algorithm to a color image.
@@ -28,21 +77,134 @@ QImage applyOrderedDithering(const QImage &image, int thresholdMapSize,
  * specified number) and then maps each pixel to the nearest color in the
  * resulting palette (using Euclidean distance in RGB space).
  *
+ * The colors are counted with Histogram::mostFrequentColors(). Ties between
+ * equally frequent colors go to the lower QRgb value.
+ *
  * @param image The input color QImage.
  * @param numColors The number of colors to reduce the image to.
+ * @param bitsPerChannel 8 counts exact colors. Fewer bits (e.g. 5 or 6)
+ * pre-bin similar colors, so that the palette consists of the centres of the
+ * most popular bins; counting is then cache friendly, and noisy photos with
+ * few exactly repeated colors still yield a representative palette.
+ * @param format The pixel format of the result; Indexed8 needs numColors of
+ * at most 256.
  * @return A new QImage with the popularity quantization applied.
  */
-QImage applyPopularityQuantization(const QImage &image, int numColors);
+QImage applyPopularityQuantization(const QImage &image, int numColors,
+                                   int bitsPerChannel = 8,
+                                   OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Applies the Median Cut Color Quantization algorithm to a color image.
+ *
+ * The colors of the image are counted with Histogram::colorCounts(). Starting
+ * from a box holding all of them, the box with the largest range in one
+ * channel is split at the pixel-weighted median of that channel, until there
+ * are numColors boxes. The palette consists of the weighted mean color of each
+ * box, so that smooth gradients are covered evenly rather than only by their
+ * most frequent shades. Pixels are then mapped to the nearest palette color.
+ *
+ * @param image The input color QImage.
+ * @param numColors The maximum number of colors of the result.
+ * @param format The pixel format of the result.
+ * @return A new QImage with the median cut quantization applied.
+ */
+QImage applyMedianCutQuantization(const QImage &image, int numColors,
+                                  OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Applies Octree Color Quantization to a color image.
+ *
+ * The colors of the image, counted with Histogram::colorCounts(), are
+ * inserted into an octree six levels deep whose nodes sum the colors below
+ * them. The least populated branches of the deepest level are merged first,
+ * until numColors leaves remain; the palette is the mean color of each leaf.
+ * Pixels are then mapped to the nearest palette color.
+ *
+ * @param image The input color QImage.
+ * @param numColors The maximum number of colors of the result.
+ * @param format The pixel format of the result.
+ * @return A new QImage with the octree quantization applied.
+ */
+QImage applyOctreeQuantization(const QImage &image, int numColors,
+                               OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Stopping criteria of refinePaletteKMeans().
+ */
+struct KMeansOptions {
+  int maxIterations = 20; ///< Upper bound on the number of iterations.
+  /// Converged once no centroid moves further than this, in 8-bit units.
+  double tolerance = 0.5;
+  /// Stops before the next iteration once this many milliseconds have
+  /// passed since the call; 0 for no limit.
+  int timeBudgetMs = 0;
+  /// Bits per channel of the color histogram, as for
+  /// applyPopularityQuantization(); fewer bits make iterations cheaper on
+  /// images with many distinct colors.
+  int bitsPerChannel = 8;
+};
+
+/**
+ * @brief The outcome of refinePaletteKMeans().
+ */
+struct KMeansResult {
+  QImage image;           ///< The image mapped to the palette.
+  QVector<QRgb> palette;  ///< The refined palette.
+  int iterations = 0;     ///< Iterations run.
+  bool converged = false; ///< False if stopped by a limit.
+};
+
+/**
+ * @brief Refines a palette with k-means (Lloyd's algorithm) and maps the
+ * image to it.
+ *
+ * Each iteration assigns every color of the image to its nearest palette
+ * color and moves each palette color to the mean of the colors assigned to
+ * it. Iterations run on the weighted color histogram of
+ * Histogram::colorCounts(), so their cost depends on the number of distinct
+ * colors times the palette size, not on the number of pixels. The
+ * assignment is vectorized with SSE2 where available and split across
+ * threads.
+ *
+ * Palette colors that attract no color are dropped from the result; the
+ * others keep their order.
+ *
+ * @param image The input color QImage.
+ * @param initialPalette The starting palette, e.g. from median cut.
+ * @param options When to stop.
+ * @param format The pixel format of the mapped image.
+ * @return The refined palette and mapped image; a null image if the job was
+ * cancelled.
+ */
+KMeansResult refinePaletteKMeans(const QImage &image,
+                                 const QVector<QRgb> &initialPalette,
+                                 const KMeansOptions &options = {},
+                                 OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Quantizes a color image with a median cut palette refined by
+ * refinePaletteKMeans().
+ * @param image The input color QImage.
+ * @param numColors The maximum number of colors of the result.
+ * @param options When to stop refining.
+ * @param format The pixel format of the result.
+ * @return A new QImage with the quantization applied.
+ */
+QImage applyKMeansQuantization(const QImage &image, int numColors,
+                               const KMeansOptions &options = {},
+                               OutputFormat format = OutputFormat::RGB32);
 
 /**
  * @brief Converts an image from RGB to YCbCr, applies ordered dithering on the
  * Y channel, and then converts the result back to RGB.
  *
- * The dithering algorithm uses a threshold matrix (Bayer-like) of size 3×3.
- * The Y channel is quantized to the specified number of levels (default is 8).
- * The Cb and Cr channels are left unchanged.
+ * The dithering algorithm uses a threshold matrix (Bayer-like) of the given
+ * size. The Y channel is quantized to the specified number of levels (default
+ * is 8). The Cb and Cr channels are left unchanged.
  *
  * @param image The input RGB QImage.
+ * @param thresholdMapSize As for applyOrderedDithering().
  * @param levelsY The number of quantization levels for the Y channel (default
  * 3).
  * @return A new QImage with the ordered dithering applied on the Y channel.
@@ -50,6 +212,56 @@ QImage applyPopularityQuantization(const QImage &image, int numColors);
 QImage applyOrderedDitheringInYCbCr(const QImage &image, int thresholdMapSize,
                                     int levelsY = 3);
 
+/**
+ * @brief Error diffusion kernels, by how far they spread the error of a
+ * pixel.
+ */
+enum class DiffusionKernel {
+  FloydSteinberg,    ///< 4 neighbours, the classic.
+  JarvisJudiceNinke, ///< 12 neighbours over two rows; smoother, slower.
+  Stucki,            ///< 12 neighbours, sharper weights than Jarvis.
+  Atkinson,          ///< 6 neighbours, diffusing only 3/4 of the error.
+};
+
+/**
+ * @brief Applies error diffusion dithering, quantizing each channel to a
+ * number of evenly spaced levels.
+ *
+ * Each pixel is rounded to the nearest level and its rounding error is
+ * spread to the unprocessed neighbours with the weights of the kernel. Rows
+ * are processed in parallel as a skewed wavefront, each row trailing the one
+ * above it by a few pixels, with only a few rows of errors in memory.
+ *
+ * @param image The input color QImage.
+ * @param kernel The error diffusion kernel.
+ * @param levelsPerChannel The number of levels per channel, 2 to 256.
+ * @param serpentine Scan every other row right to left, which avoids the
+ * directional artifacts of always scanning left to right. Serpentine rows
+ * depend on the whole row above, so they are processed on one thread.
+ * @param format The pixel format of the result.
+ * @return A new QImage with the error diffusion applied.
+ */
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           int levelsPerChannel, bool serpentine = false,
+                           OutputFormat format = OutputFormat::RGB32);
+
+/**
+ * @brief Applies error diffusion dithering against a palette: each pixel is
+ * replaced by the nearest palette color.
+ * @param image The input color QImage.
+ * @param kernel The error diffusion kernel.
+ * @param palette The output colors, e.g. from a quantizer; should not be
+ * empty.
+ * @param serpentine As for the overload with levels.
+ * @param format The pixel format of the result; Indexed8 needs a palette of
+ * at most 256 colors.
+ * @return A new QImage with the error diffusion applied.
+ */
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           const QVector<QRgb> &palette,
+                           bool serpentine = false,
+                           OutputFormat format = OutputFormat::RGB32);
+
 } // namespace DitheringAndQuantization
 
 #endif // DITHERINGANDQUANTIZATION_H
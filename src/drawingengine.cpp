@@ -4,41 +4,164 @@
 #include <algorithm>
 #include <queue>
 
-/* ---------- low‑level helpers ---------------------------------------- */
-static inline void setPixelSafe(QImage &im, int x, int y, const QColor &c) {
-  if (x >= 0 && x < im.width() && y >= 0 && y < im.height())
-    im.setPixel(x, y, c.rgb());
-}
+/* ---------- raster target ------------------------------------------- */
+namespace {
+
+/*
+ * The pixels of an image, captured once per primitive: plotting addresses
+ * the scan lines through the base pointer and stride instead of going
+ * through QImage::pixel()/setPixel() for every pixel. Images that are not
+ * RGB32 or ARGB32 are drawn on a 32-bit copy that is converted back when
+ * the target goes out of scope.
+ */
+class RasterTarget {
+public:
+  explicit RasterTarget(QImage &im) : image(im), format(im.format()) {
+    if (!image.isNull() && format != QImage::Format_RGB32 &&
+        format != QImage::Format_ARGB32)
+      image = image.convertToFormat(image.hasAlphaChannel()
+                                        ? QImage::Format_ARGB32
+                                        : QImage::Format_RGB32);
+    base = image.bits();
+    stride = image.bytesPerLine();
+    w = image.width();
+    h = image.height();
+  }
+  ~RasterTarget() {
+    if (image.format() != format)
+      image = image.convertToFormat(format);
+  }
+  RasterTarget(const RasterTarget &) = delete;
+  RasterTarget &operator=(const RasterTarget &) = delete;
 
-static inline void blend(QImage &im, int x, int y, double a, const QColor &c) {
-  if (x < 0 || y < 0 || x >= im.width() || y >= im.height())
-    return;
-  QRgb bg = im.pixel(x, y);
-  int r = int(qRed(bg) * (1 - a) + c.red() * a);
-  int g = int(qGreen(bg) * (1 - a) + c.green() * a);
-  int b = int(qBlue(bg) * (1 - a) + c.blue() * a);
-  im.setPixel(x, y, qRgb(r, g, b));
-}
+  int width() const { return w; }
+  int height() const { return h; }
+
+  bool contains(int x, int y) const {
+    return unsigned(x) < unsigned(w) && unsigned(y) < unsigned(h);
+  }
+  bool contains(const QPoint &p) const { return contains(p.x(), p.y()); }
+
+  QRgb *row(int y) const {
+    return reinterpret_cast<QRgb *>(base + qsizetype(y) * stride);
+  }
+
+  /* plot() and blend() skip pixels off the canvas; the unchecked variants
+     are for primitives that have been clipped already */
+  void plot(int x, int y, QRgb c) const {
+    if (contains(x, y))
+      plotUnchecked(x, y, c);
+  }
+  void plotUnchecked(int x, int y, QRgb c) const { row(y)[x] = c; }
+
+  /* weight: coverage of c in 0..256, see coverage() */
+  void blend(int x, int y, int weight, QRgb c) const {
+    if (contains(x, y))
+      blendUnchecked(x, y, weight, c);
+  }
+  void blendUnchecked(int x, int y, int weight, QRgb c) const {
+    QRgb &p = row(y)[x];
+    p = mix(p, c, weight);
+  }
+
+  /* Mixes red and blue, then green, in two 32-bit multiplies; the result is
+     opaque. */
+  static QRgb mix(QRgb bg, QRgb c, int weight) {
+    uint rb = ((bg & 0xff00ff) * uint(256 - weight) +
+               (c & 0xff00ff) * uint(weight)) >>
+              8;
+    uint g = ((bg & 0xff00) * uint(256 - weight) +
+              (c & 0xff00) * uint(weight)) >>
+             8;
+    return 0xff000000 | (rb & 0xff00ff) | (g & 0xff00);
+  }
+
+private:
+  QImage &image;
+  QImage::Format format;
+  uchar *base;
+  qsizetype stride;
+  int w, h;
+};
+
+/* alpha in 0..1 as a blending weight in 0..256 */
+inline int coverage(double a) { return int(a * 256.0 + 0.5); }
+
+} // namespace
 
 /* integer part helpers */
-static inline int iPart(double x) { return int(std::floor(x)); }
-static inline double fPart(double x) { return x - std::floor(x); }
+static inline int iPart(double x) {
+  int i = int(x); // truncates; std::floor() is a library call without SSE4.1
+  return x < i ? i - 1 : i;
+}
+static inline double fPart(double x) { return x - iPart(x); }
 static inline double rfPart(double x) { return 1.0 - fPart(x); }
 
 /* ---------- DDA line -------------------------------------------------- */
-void drawLineDDA(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
+static void lineDDA(const RasterTarget &t, int x0, int y0, int x1, int y1,
+                    QRgb rgb) {
   int dx = x1 - x0, dy = y1 - y0, steps = std::max(std::abs(dx), std::abs(dy));
   if (!steps) {
-    setPixelSafe(im, x0, y0, c);
+    t.plot(x0, y0, rgb);
+    return;
+  }
+  /* Step i plots (x0 + dx * i / steps, y0 + dy * i / steps), each rounded
+     to the nearest pixel, halves upwards. The fractions are tracked exactly
+     in integers: ex / (2 * steps) is the distance travelled from x, plus one
+     half (minus a bit when stepping down, so that halves round up). */
+  int sx = dx < 0 ? -1 : 1, sy = dy < 0 ? -1 : 1;
+  int ax = 2 * std::abs(dx), ay = 2 * std::abs(dy), two = 2 * steps;
+  qint64 bx = dx < 0 ? steps - 1 : steps, by = dy < 0 ? steps - 1 : steps;
+  auto at = [&](int i) {
+    return QPoint(x0 + sx * int((bx + qint64(ax) * i) / two),
+                  y0 + sy * int((by + qint64(ay) * i) / two));
+  };
+
+  /* Clip to the canvas grown by a pixel, which holds every step that rounds
+     onto the canvas, then drop the steps at either end that round outside.
+     The pixels left form one run on the canvas. */
+  QPointF A, B;
+  if (!liangBarskyClip(QRect(-1, -1, t.width() + 2, t.height() + 2),
+                       QPointF(x0, y0), QPointF(x1, y1), A, B))
     return;
+  bool alongX = std::abs(dx) == steps;
+  double ta = alongX ? std::abs(A.x() - x0) : std::abs(A.y() - y0);
+  double tb = alongX ? std::abs(B.x() - x0) : std::abs(B.y() - y0);
+  int first = std::max(int(std::floor(ta)), 0);
+  int last = std::min(int(std::ceil(tb)), steps);
+  while (first <= last && !t.contains(at(first)))
+    ++first;
+  while (last >= first && !t.contains(at(last)))
+    --last;
+  if (first > last)
+    return;
+
+  QPoint p = at(first);
+  int x = p.x(), y = p.y();
+  int ex = int((bx + qint64(ax) * first) % two);
+  int ey = int((by + qint64(ay) * first) % two);
+  for (int i = first; i <= last; ++i) {
+    t.plotUnchecked(x, y, rgb);
+    if ((ex += ax) >= two) {
+      ex -= two;
+      x += sx;
+    }
+    if ((ey += ay) >= two) {
+      ey -= two;
+      y += sy;
+    }
   }
-  double x = x0, y = y0, ix = dx / double(steps), iy = dy / double(steps);
-  for (int i = 0; i <= steps; ++i, x += ix, y += iy)
-    setPixelSafe(im, int(std::round(x)), int(std::round(y)), c);
+}
+
+void drawLineDDA(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
+  RasterTarget t(im);
+  lineDDA(t, x0, y0, x1, y1, c.rgb());
 }
 
 /* ---------- Xiaolin‑Wu line ------------------------------------------ */
 void drawLineWu(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
+  RasterTarget t(im);
+  const QRgb rgb = c.rgb();
   bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
   if (steep) {
     std::swap(x0, y0);
@@ -51,19 +174,19 @@ void drawLineWu(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
 
   double dx = x1 - x0, dy = y1 - y0, grad = dx ? dy / dx : 0.0;
 
-  auto plot = [&](int x, int y, double a) {
+  auto plot = [&](int x, int y, int a) {
     if (steep)
-      blend(im, y, x, a, c);
+      t.blend(y, x, a, rgb);
     else
-      blend(im, x, y, a, c);
+      t.blend(x, y, a, rgb);
   };
 
   /* first end */
   double xEnd = std::round(x0), yEnd = y0 + grad * (xEnd - x0);
   double xGap = rfPart(x0 + 0.5);
   int ix = int(xEnd), iy = iPart(yEnd);
-  plot(ix, iy, rfPart(yEnd) * xGap);
-  plot(ix, iy + 1, fPart(yEnd) * xGap);
+  plot(ix, iy, coverage(rfPart(yEnd) * xGap));
+  plot(ix, iy + 1, coverage(fPart(yEnd) * xGap));
 
   double intery = yEnd + grad;
 
@@ -72,68 +195,207 @@ void drawLineWu(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
   yEnd = y1 + grad * (xEnd - x1);
   xGap = fPart(x1 + 0.5);
   int ix2 = int(xEnd), iy2 = iPart(yEnd);
-  plot(ix2, iy2, rfPart(yEnd) * xGap);
-  plot(ix2, iy2 + 1, fPart(yEnd) * xGap);
-
-  /* main loop */
-  for (int x = ix + 1; x < ix2; ++x) {
-    plot(x, iPart(intery), rfPart(intery));
-    plot(x, iPart(intery) + 1, fPart(intery));
-    intery += grad;
+  plot(ix2, iy2, coverage(rfPart(yEnd) * xGap));
+  plot(ix2, iy2 + 1, coverage(fPart(yEnd) * xGap));
+
+  /* main loop, over the columns on the canvas only. The columns whose pixel
+     pair lies wholly on the canvas form one run, which is blended without
+     bounds checks; the rows are evaluated per column rather than
+     accumulated so that the run's ends, found by testing columns, are
+     exactly the rows blended. */
+  const int cols = steep ? t.height() : t.width();
+  const int rows = steep ? t.width() : t.height();
+  auto interyAt = [&](int x) { return intery + grad * (x - (ix + 1)); };
+  int xa = std::max(ix + 1, 0), xb = std::min(ix2 - 1, cols - 1);
+  QPointF A, B;
+  if (xa > xb || rows <= 0 ||
+      !liangBarskyClip(QRect(xa, -2, xb - xa + 1, rows + 3),
+                       QPointF(xa, interyAt(xa)), QPointF(xb, interyAt(xb)),
+                       A, B))
+    return;
+  xa = std::max(xa, int(std::floor(A.x())));
+  xb = std::min(xb, int(std::ceil(B.x())));
+
+  auto inside = [&](int x) {
+    return unsigned(iPart(interyAt(x))) < unsigned(rows - 1);
+  };
+  auto column = [&](int x) {
+    double yf = interyAt(x);
+    int y = iPart(yf), a = coverage(yf - y);
+    plot(x, y, 256 - a);
+    plot(x, y + 1, a);
+  };
+  for (; xa <= xb && !inside(xa); ++xa)
+    column(xa);
+  for (; xb >= xa && !inside(xb); --xb)
+    column(xb);
+  if (steep) {
+    for (int x = xa; x <= xb; ++x) {
+      double yf = interyAt(x);
+      int y = iPart(yf), a = coverage(yf - y);
+      QRgb *line = t.row(x);
+      line[y] = RasterTarget::mix(line[y], rgb, 256 - a);
+      line[y + 1] = RasterTarget::mix(line[y + 1], rgb, a);
+    }
+  } else {
+    for (int x = xa; x <= xb; ++x) {
+      double yf = interyAt(x);
+      int y = iPart(yf), a = coverage(yf - y);
+      t.blendUnchecked(x, y, 256 - a, rgb);
+      t.blendUnchecked(x, y + 1, a, rgb);
+    }
   }
 }
 
-/* ---------- Mid‑point circle (aliased) ------------------------------- */
-void drawCircleMidpoint(QImage &im, int xc, int yc, int r, const QColor &col) {
-  int x = 0, y = r, d = 1 - r;
-  while (x <= y) {
-    setPixelSafe(im, xc + x, yc + y, col);
-    setPixelSafe(im, xc - x, yc + y, col);
-    setPixelSafe(im, xc + x, yc - y, col);
-    setPixelSafe(im, xc - x, yc - y, col);
-    setPixelSafe(im, xc + y, yc + x, col);
-    setPixelSafe(im, xc - y, yc + x, col);
-    setPixelSafe(im, xc + y, yc - x, col);
-    setPixelSafe(im, xc - y, yc - x, col);
-    if (d < 0)
-      d += 2 * x + 3;
-    else {
-      d += 2 * (x - y) + 5;
-      --y;
+/* ---------- octant arcs ----------------------------------------------- */
+/*
+ * The circles are rasterized as an arc of n offsets in one octant, arc(k) =
+ * (u, v) with u and v each monotone in k, which is mirrored into the eight
+ * octants. The mirrored arcs are monotone too, so the part of each that lies
+ * on the canvas is a single run of indices. It is found by bisection and
+ * plotted without bounds checks; off-canvas octants cost nothing.
+ */
+
+/* first k in [lo, hi) for which pred(k) holds, pred being false then true */
+template <typename Pred> static int firstIndex(int lo, int hi, Pred pred) {
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (pred(mid))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+/* narrows [begin, end) to the indices whose coordinate c(k) is in
+   0..size-1, c being monotone */
+template <typename Coord>
+static void clipRun(int &begin, int &end, int size, Coord c) {
+  if (begin >= end)
+    return;
+  if (c(begin) <= c(end - 1)) {
+    begin = firstIndex(begin, end, [&](int k) { return c(k) >= 0; });
+    end = firstIndex(begin, end, [&](int k) { return c(k) >= size; });
+  } else {
+    begin = firstIndex(begin, end, [&](int k) { return c(k) < size; });
+    end = firstIndex(begin, end, [&](int k) { return c(k) < 0; });
+  }
+}
+
+/* calls plot(x, y, k) for every pixel of the eight mirror images of arc
+   that lies on the canvas, octant by octant */
+template <typename Arc, typename Plot>
+static void plotOctants(const RasterTarget &t, int xc, int yc, int n, Arc arc,
+                        Plot plot) {
+  for (int o = 0; o < 8; ++o) {
+    const int sx = o & 1 ? -1 : 1, sy = o & 2 ? -1 : 1;
+    const bool swapped = o & 4;
+    auto place = [&](const QPoint &p) {
+      return swapped ? QPoint(xc + sx * p.y(), yc + sy * p.x())
+                     : QPoint(xc + sx * p.x(), yc + sy * p.y());
+    };
+    int begin = 0, end = n;
+    clipRun(begin, end, t.width(), [&](int k) { return place(arc(k)).x(); });
+    clipRun(begin, end, t.height(), [&](int k) { return place(arc(k)).y(); });
+    for (int k = begin; k < end; ++k) {
+      const QPoint p = place(arc(k));
+      plot(p.x(), p.y(), k);
     }
-    ++x;
   }
 }
 
-/* ---------- Xiaolin‑Wu anti‑aliased circle --------------------------- */
-static inline void circlePlot(QImage &im, int xc, int yc, int x, int y,
-                              double a, const QColor &c) {
-  blend(im, xc + x, yc + y, a, c);
-  blend(im, xc - x, yc + y, a, c);
-  blend(im, xc + x, yc - y, a, c);
-  blend(im, xc - x, yc - y, a, c);
-  blend(im, xc + y, yc + x, a, c);
-  blend(im, xc - y, yc + x, a, c);
-  blend(im, xc + y, yc - x, a, c);
-  blend(im, xc - y, yc - x, a, c);
+/* whether any pixel within distance r of (xc, yc) is on the canvas */
+static bool circleOnCanvas(const RasterTarget &t, int xc, int yc, int r) {
+  return xc + r >= 0 && xc - r < t.width() && yc + r >= 0 &&
+         yc - r < t.height();
 }
 
+/*
+ * The mid-point circle's octant from (0, r) to the diagonal. The decision
+ * variable keeps row y at column x while x² + (y - 1/2)² < r², so arc(x) is
+ * on the largest such row: (2y - 1)² < 4(r² - x²). Clipping bisects over
+ * that closed form; plotting asks for consecutive columns, which step the
+ * decision variable from the previous one instead.
+ */
+struct MidpointArc {
+  int r; // >= 0
+  /* the last column returned, its row and its decision variable
+     (x + 1)² + y² - y - r² */
+  mutable int x = -2, y = 0;
+  mutable qint64 d = 0;
+
+  QPoint operator()(int k) const {
+    if (k == x + 1) {
+      if (d < 0)
+        d += 2 * x + 3;
+      else {
+        d += 2 * (x - y) + 5;
+        --y;
+      }
+    } else {
+      y = row(k);
+      d = qint64(k + 1) * (k + 1) + qint64(y) * y - y - qint64(r) * r;
+    }
+    x = k;
+    return QPoint(x, y);
+  }
+  int row(int k) const {
+    const quint64 m = 4 * (quint64(r) * quint64(r) - quint64(k) * quint64(k));
+    if (m == 0)
+      return 0;
+    quint64 s = quint64(std::sqrt(double(m - 1))); // isqrt(m - 1)
+    while (s * s > m - 1)
+      --s;
+    while ((s + 1) * (s + 1) <= m - 1)
+      ++s;
+    return int((s + 1) / 2);
+  }
+  /* the number of columns up to the diagonal */
+  int size() const {
+    return firstIndex(0, r + 1, [&](int k) { return k > row(k); });
+  }
+};
+
+/* ---------- Mid‑point circle (aliased) ------------------------------- */
+void drawCircleMidpoint(QImage &im, int xc, int yc, int r, const QColor &col) {
+  if (r < 0)
+    return;
+  RasterTarget t(im);
+  if (!circleOnCanvas(t, xc, yc, r))
+    return;
+  const QRgb rgb = col.rgb();
+  const MidpointArc arc{r};
+  plotOctants(t, xc, yc, arc.size(), arc,
+              [&](int x, int y, int) { t.plotUnchecked(x, y, rgb); });
+}
+
+/* ---------- Xiaolin‑Wu anti‑aliased circle --------------------------- */
 void drawCircleWu(QImage &im, int xc, int yc, int r, const QColor &col) {
   if (r <= 0)
     return;
-  double x = r, y = 0.0;
-  double err = 0.0;
-
-  while (x >= y) {
-    double xReal = std::sqrt(r * r - y * y);
-    double xCeil = std::ceil(xReal);
-    double D = xCeil - xReal;
-
-    circlePlot(im, xc, yc, int(xCeil), int(y), 1.0 - D, col);
-    circlePlot(im, xc, yc, int(xCeil) - 1, int(y), D, col);
+  RasterTarget t(im);
+  if (!circleOnCanvas(t, xc, yc, r))
+    return;
+  const QRgb rgb = col.rgb();
+
+  /* row y of the quadrant: the pixel right of the exact edge, and the one
+     left of it, weighted by how far the edge is from each. Rows are only
+     evaluated where they land on the canvas. */
+  auto edge = [&](int y) { return std::sqrt(double(r) * r - double(y) * y); };
+  auto outer = [&](int y) { return QPoint(int(std::ceil(edge(y))), y); };
+  auto inner = [&](int y) { return QPoint(int(std::ceil(edge(y))) - 1, y); };
+  auto weight = [&](int y) {
+    double xReal = edge(y);
+    return coverage(std::ceil(xReal) - xReal);
+  };
 
-    ++y;
-  }
+  plotOctants(t, xc, yc, r + 1, outer, [&](int x, int y, int k) {
+    t.blendUnchecked(x, y, 256 - weight(k), rgb);
+  });
+  plotOctants(t, xc, yc, r + 1, inner, [&](int x, int y, int k) {
+    t.blendUnchecked(x, y, weight(k), rgb);
+  });
 }
 
 /* ---------- Half-circle --------------------------- */
@@ -145,68 +407,53 @@ static inline bool outsideHalf(int x, int y, int xc, int yc, double nx,
 /* Mid-point (aliased) */
 void drawHalfCircleMidpoint(QImage &im, int xc, int yc, int r, double nx,
                             double ny, const QColor &col) {
-  int x = 0, y = r, d = 1 - r;
-  while (x <= y) {
-    auto trySet = [&](int px, int py) {
-      if (outsideHalf(px, py, xc, yc, nx, ny))
-        setPixelSafe(im, px, py, col);
-    };
-    trySet(xc + x, yc + y);
-    trySet(xc - x, yc + y);
-    trySet(xc + x, yc - y);
-    trySet(xc - x, yc - y);
-    trySet(xc + y, yc + x);
-    trySet(xc - y, yc + x);
-    trySet(xc + y, yc - x);
-    trySet(xc - y, yc - x);
-
-    d < 0 ? d += 2 * x + 3 : (d += 2 * (x - y) + 5, --y);
-    ++x;
-  }
+  if (r < 0)
+    return;
+  RasterTarget t(im);
+  if (!circleOnCanvas(t, xc, yc, r))
+    return;
+  const QRgb rgb = col.rgb();
+  const MidpointArc arc{r};
+  plotOctants(t, xc, yc, arc.size(), arc, [&](int x, int y, int) {
+    if (outsideHalf(x, y, xc, yc, nx, ny))
+      t.plotUnchecked(x, y, rgb);
+  });
 }
 
 /* Wu (antialiased)*/
-static inline void halfCirclePlotAA(QImage &im, int xc, int yc, int x, int y,
-                                    double a, double nx, double ny,
-                                    const QColor &c) {
-  auto tryBlend = [&](int px, int py, double alpha) {
-    if ((px - xc) * nx + (py - yc) * ny >= 0)
-      blend(im, px, py, alpha, c);
-  };
-
-  tryBlend(xc + x, yc + y, a);
-  tryBlend(xc - x, yc + y, a);
-  tryBlend(xc + x, yc - y, a);
-  tryBlend(xc - x, yc - y, a);
-  tryBlend(xc + y, yc + x, a);
-  tryBlend(xc - y, yc + x, a);
-  tryBlend(xc + y, yc - x, a);
-  tryBlend(xc - y, yc - x, a);
-}
-
 void drawHalfCircleWu(QImage &im, int xc, int yc, int r, double nx, double ny,
                       const QColor &col) {
   if (r <= 0)
     return;
-
-  for (int y = 0; y <= r; ++y) {
-    /* exactly the same math as the full-circle Wu */
-    double xReal = std::sqrt(r * r - y * y);
-    int xInt = int(std::floor(xReal));
-    double D = xReal - xInt; // fractional part
-
-    /* left pixel (xInt) gets weight 1-D, right one (xInt+1) gets D */
-    halfCirclePlotAA(im, xc, yc, xInt + 1, y, D, nx, ny, col);
-    halfCirclePlotAA(im, xc, yc, xInt, y, 1.0 - D, nx, ny, col);
-  }
+  RasterTarget t(im);
+  if (!circleOnCanvas(t, xc, yc, r + 1))
+    return;
+  const QRgb rgb = col.rgb();
+
+  /* exactly the same math as the full-circle Wu */
+  auto edge = [&](int y) { return std::sqrt(double(r) * r - double(y) * y); };
+  auto right = [&](int y) { return QPoint(iPart(edge(y)) + 1, y); };
+  auto left = [&](int y) { return QPoint(iPart(edge(y)), y); };
+  auto D = [&](int y) { return coverage(fPart(edge(y))); };
+
+  /* left pixel (xInt) gets weight 1-D, right one (xInt+1) gets D */
+  plotOctants(t, xc, yc, r + 1, right, [&](int x, int y, int k) {
+    if (outsideHalf(x, y, xc, yc, nx, ny))
+      t.blendUnchecked(x, y, D(k), rgb);
+  });
+  plotOctants(t, xc, yc, r + 1, left, [&](int x, int y, int k) {
+    if (outsideHalf(x, y, xc, yc, nx, ny))
+      t.blendUnchecked(x, y, 256 - D(k), rgb);
+  });
 }
 
 /* ---------- free‑hand ------------------------------------------------- */
 void drawFreehandPen(QImage &im, const QVector<QPoint> &pts,
                      const QColor &col) {
+  RasterTarget t(im);
   for (int i = 1; i < pts.size(); ++i)
-    drawLineDDA(im, pts[i - 1].x(), pts[i - 1].y(), pts[i].x(), pts[i].y(),
-                col);
+    lineDDA(t, pts[i - 1].x(), pts[i - 1].y(), pts[i].x(), pts[i].y(),
+            col.rgb());
 }
 
 /* ================================================================ */
@@ -274,13 +521,19 @@ static void bucketSortEdges(const QVector<QPoint> &P,
     e.x = a.x();
     e.invSlope = double(b.x() - a.x()) / double(b.y() - a.y());
 
+    /* clip to the rows of the canvas: edges above it start at row 0 */
     int k = a.y();
+    if (e.yMax <= 0 || k >= ET.size())
+      continue;
+    if (k < 0) {
+      e.x += e.invSlope * -k;
+      k = 0;
+    }
     if (k < yMin)
       yMin = k;
     if (e.yMax > yMax)
       yMax = e.yMax;
-    if (k >= 0 && k < ET.size())
-      ET[k].append(e);
+    ET[k].append(e);
   }
 }
 
@@ -288,14 +541,20 @@ static void scanlineFill(QImage &img, const QVector<QPoint> &P,
                          const QColor *colour, const QImage *pattern) {
   if (P.size() < 3)
     return;
-  int H = img.height();
+  RasterTarget t(img);
+  int W = t.width(), H = t.height();
+  /* RGB32 pixels are stored opaque, as QImage::setPixel() does */
+  const QRgb opaque = img.format() == QImage::Format_RGB32 ? 0xff000000 : 0;
+  QImage tile;
+  if (pattern)
+    tile = pattern->convertToFormat(QImage::Format_ARGB32);
   QVector<QVector<EdgeRec>> ET(H);
   int yMin, yMax;
   bucketSortEdges(P, ET, yMin, yMax);
 
   QVector<EdgeRec> AET;
 
-  for (int y = yMin; y <= yMax; ++y) {
+  for (int y = yMin; y <= std::min(yMax, H - 1); ++y) {
     AET += ET[y];
 
     for (int i = AET.size() - 1; i >= 0; --i)
@@ -306,17 +565,18 @@ static void scanlineFill(QImage &img, const QVector<QPoint> &P,
               [](const EdgeRec &a, const EdgeRec &b) { return a.x < b.x; });
 
     for (int i = 0; i + 1 < AET.size(); i += 2) {
-      int x1 = int(std::ceil(AET[i].x));
-      int x2 = int(std::floor(AET[i + 1].x));
-      for (int x = x1; x <= x2; ++x) {
-        if (x < 0 || x >= img.width() || y < 0 || y >= H)
-          continue;
-        if (colour)
-          img.setPixel(x, y, colour->rgb());
-        else {
-          QRgb p = pattern->pixel(x % pattern->width(), y % pattern->height());
-          img.setPixel(x, y, p);
-        }
+      int x1 = std::max(int(std::ceil(AET[i].x)), 0);
+      int x2 = std::min(int(std::floor(AET[i + 1].x)), W - 1);
+      if (x1 > x2)
+        continue;
+      QRgb *line = t.row(y);
+      if (colour) {
+        std::fill(line + x1, line + x2 + 1, colour->rgb());
+      } else {
+        const QRgb *src = reinterpret_cast<const QRgb *>(
+            tile.constScanLine(y % tile.height()));
+        for (int x = x1; x <= x2; ++x)
+          line[x] = src[x % tile.width()] | opaque;
       }
     }
 
@@ -331,10 +591,22 @@ void fillSeedScanline(QImage &img, int sx, int sy, const QColor *fillCol,
   if (sx < 0 || sy < 0 || sx >= img.width() || sy >= img.height())
     return;
 
-  const QRgb target = img.pixel(sx, sy);
-  if ((fillCol && target == fillCol->rgb()) ||
-      (pattern &&
-       target == pattern->pixel(sx % pattern->width(), sy % pattern->height())))
+  RasterTarget t(img);
+  const int W = t.width();
+  const QRgb opaque = img.format() == QImage::Format_RGB32 ? 0xff000000 : 0;
+  QImage tile;
+  if (pattern)
+    tile = pattern->convertToFormat(QImage::Format_ARGB32);
+  auto fillAt = [&](int x, int y) {
+    if (fillCol)
+      return fillCol->rgb();
+    return reinterpret_cast<const QRgb *>(
+               tile.constScanLine(y % tile.height()))[x % tile.width()] |
+           opaque;
+  };
+
+  const QRgb target = t.row(sy)[sx];
+  if (target == fillAt(sx, sy))
     return;
 
   struct Span {
@@ -344,16 +616,7 @@ void fillSeedScanline(QImage &img, int sx, int sy, const QColor *fillCol,
   q.push({sx, sx, sy});
 
   auto isTarget = [&](int x, int y) {
-    return x >= 0 && x < img.width() && y >= 0 && y < img.height() &&
-           img.pixel(x, y) == target;
-  };
-
-  auto setPixel = [&](int x, int y) {
-    if (fillCol)
-      img.setPixel(x, y, fillCol->rgb());
-    else
-      img.setPixel(x, y,
-                   pattern->pixel(x % pattern->width(), y % pattern->height()));
+    return t.contains(x, y) && t.row(y)[x] == target;
   };
 
   while (!q.empty()) {
@@ -363,11 +626,12 @@ void fillSeedScanline(QImage &img, int sx, int sy, const QColor *fillCol,
     int xL = s.xL, xR = s.xR, y = s.y;
     while (xL - 1 >= 0 && isTarget(xL - 1, y))
       --xL;
-    while (xR + 1 < img.width() && isTarget(xR + 1, y))
+    while (xR + 1 < W && isTarget(xR + 1, y))
       ++xR;
 
+    QRgb *line = t.row(y);
     for (int x = xL; x <= xR; ++x)
-      setPixel(x, y);
+      line[x] = fillAt(x, y);
 
     for (int dir : {-1, +1}) {
       int ny = y + dir;
@@ -1,5 +1,6 @@
 #include "drawingwidget.h"
 #include "drawingengine.h"
+#include "telemetry.h"
 #include <QColorDialog>
 #include <QFileDialog>
 #include <QHBoxLayout>
@@ -9,7 +10,6 @@
 #include <QToolButton>
 #include <cmath>
 
-QList<RectangleShape *> gClipRects;
 
 namespace {
 static constexpr const char *kClipEnabled =
@@ -311,6 +311,7 @@ QPoint DrawingWidget::mapToCanvas(const QPoint &p) const {
 }
 
 void DrawingWidget::redrawAllShapes() {
+  Telemetry::ScopedTimer timer("DrawingWidget::redrawAllShapes", canvas);
   canvas.fill(Qt::white);
   for (auto *s : shapes)
     s->draw(canvas);
@@ -111,6 +111,4 @@ private:
   void redrawAllShapes();
 };
 
-extern QList<RectangleShape *> gClipRects;
-
 #endif
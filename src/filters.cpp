@@ -1,63 +1,82 @@
 #include "filters.h"
+#include "histogram.h"
+#include "jobcontext.h"
+#include "parallel.h"
+#include "telemetry.h"
 #include <QtMath>
 #include <algorithm>
+#include <array>
+#include <vector>
+
+namespace {
+/* Applies a per-pixel color mapping. An indexed image keeps its pixels and
+ * only has its color table mapped, so it stays a quarter of the size and is
+ * never expanded; other images are converted to RGB32 first. */
+template <typename Map> QImage mapColors(const QImage &image, Map map) {
+  if (image.format() == QImage::Format_Indexed8) {
+    QImage result = image;
+    QVector<QRgb> table = result.colorTable();
+    for (QRgb &color : table)
+      color = map(color);
+    result.setColorTable(table);
+    return result;
+  }
+
+  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  for (int y = 0; y < result.height(); ++y) {
+    if (!JobContext::reportRow(y, result.height()))
+      return QImage();
+    for (int x = 0; x < result.width(); ++x)
+      result.setPixel(x, y, map(result.pixel(x, y)));
+  }
+  return result;
+}
+} // namespace
 
 namespace Filters {
 //--------------------//
 // Functional Filters //
 //--------------------//
 QImage invert(const QImage &image) {
-  QImage result = image.convertToFormat(QImage::Format_RGB32);
-  for (int y = 0; y < result.height(); ++y) {
-    for (int x = 0; x < result.width(); ++x) {
-      QRgb pixel = result.pixel(x, y);
-      int red = 255 - qRed(pixel);
-      int green = 255 - qGreen(pixel);
-      int blue = 255 - qBlue(pixel);
-      result.setPixel(x, y, qRgb(red, green, blue));
-    }
-  }
-  return result;
+  Telemetry::ScopedTimer timer("Filters::invert", image);
+  return mapColors(image, [](QRgb pixel) {
+    int red = 255 - qRed(pixel);
+    int green = 255 - qGreen(pixel);
+    int blue = 255 - qBlue(pixel);
+    return qRgb(red, green, blue);
+  });
 }
 
 QImage adjustBrightness(const QImage &image, int delta) {
-  QImage result = image.convertToFormat(QImage::Format_RGB32);
-  for (int y = 0; y < result.height(); ++y) {
-    for (int x = 0; x < result.width(); ++x) {
-      QRgb pixel = result.pixel(x, y);
-      int red = qBound(0, qRed(pixel) + delta, 255);
-      int green = qBound(0, qGreen(pixel) + delta, 255);
-      int blue = qBound(0, qBlue(pixel) + delta, 255);
-      result.setPixel(x, y, qRgb(red, green, blue));
-    }
-  }
-  return result;
+  Telemetry::ScopedTimer timer("Filters::adjustBrightness", image);
+  return mapColors(image, [delta](QRgb pixel) {
+    int red = qBound(0, qRed(pixel) + delta, 255);
+    int green = qBound(0, qGreen(pixel) + delta, 255);
+    int blue = qBound(0, qBlue(pixel) + delta, 255);
+    return qRgb(red, green, blue);
+  });
 }
 
 QImage adjustContrast(const QImage &image, double factor) {
+  Telemetry::ScopedTimer timer("Filters::adjustContrast", image);
   // factor > 1 -> higher contrast, factor < 1 -> lower contrast
-  QImage result = image.convertToFormat(QImage::Format_RGB32);
-  double midpoint = 128.0;
-  for (int y = 0; y < result.height(); ++y) {
-    for (int x = 0; x < result.width(); ++x) {
-      QRgb pixel = result.pixel(x, y);
-      int red = qBound(
-          0, static_cast<int>((qRed(pixel) - midpoint) * factor + midpoint),
-          255);
-      int green = qBound(
-          0, static_cast<int>((qGreen(pixel) - midpoint) * factor + midpoint),
-          255);
-      int blue = qBound(
-          0, static_cast<int>((qBlue(pixel) - midpoint) * factor + midpoint),
-          255);
-      result.setPixel(x, y, qRgb(red, green, blue));
-    }
-  }
-  return result;
+  const double midpoint = 128.0;
+  return mapColors(image, [factor, midpoint](QRgb pixel) {
+    int red = qBound(
+        0, static_cast<int>((qRed(pixel) - midpoint) * factor + midpoint),
+        255);
+    int green = qBound(
+        0, static_cast<int>((qGreen(pixel) - midpoint) * factor + midpoint),
+        255);
+    int blue = qBound(
+        0, static_cast<int>((qBlue(pixel) - midpoint) * factor + midpoint),
+        255);
+    return qRgb(red, green, blue);
+  });
 }
 
 QImage adjustGamma(const QImage &image, double gammaValue) {
-  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  Telemetry::ScopedTimer timer("Filters::adjustGamma", image);
   // Precompute a lookup table
   unsigned char gammaLUT[256];
   for (int i = 0; i < 256; ++i) {
@@ -65,16 +84,24 @@ QImage adjustGamma(const QImage &image, double gammaValue) {
         0, static_cast<int>(255.0 * qPow(i / 255.0, 1.0 / gammaValue)), 255);
   }
 
-  for (int y = 0; y < result.height(); ++y) {
-    for (int x = 0; x < result.width(); ++x) {
-      QRgb pixel = result.pixel(x, y);
-      int red = gammaLUT[qRed(pixel)];
-      int green = gammaLUT[qGreen(pixel)];
-      int blue = gammaLUT[qBlue(pixel)];
-      result.setPixel(x, y, qRgb(red, green, blue));
-    }
-  }
-  return result;
+  return mapColors(image, [&gammaLUT](QRgb pixel) {
+    int red = gammaLUT[qRed(pixel)];
+    int green = gammaLUT[qGreen(pixel)];
+    int blue = gammaLUT[qBlue(pixel)];
+    return qRgb(red, green, blue);
+  });
+}
+
+QImage applyLookupTable(const QImage &image, const QVector<int> &lut) {
+  Telemetry::ScopedTimer timer("Filters::applyLookupTable", image);
+  unsigned char table[256];
+  for (int i = 0; i < 256; ++i)
+    table[i] = qBound(0, lut.value(i, i), 255);
+
+  return mapColors(image, [&table](QRgb pixel) {
+    return qRgb(table[qRed(pixel)], table[qGreen(pixel)],
+                table[qBlue(pixel)]);
+  });
 }
 
 //------------------//
@@ -82,6 +109,7 @@ QImage adjustGamma(const QImage &image, double gammaValue) {
 //------------------//
 
 QImage blur3x3(const QImage &image) {
+  Telemetry::ScopedTimer timer("Filters::blur3x3", image);
   // Simple box blur kernel
   // 1 1 1
   // 1 1 1
@@ -91,6 +119,7 @@ QImage blur3x3(const QImage &image) {
 }
 
 QImage gaussianBlur3x3(const QImage &image) {
+  Telemetry::ScopedTimer timer("Filters::gaussianBlur3x3", image);
   // Basic 3x3 Gaussian kernel
   // 1 2 1
   // 2 4 2
@@ -100,6 +129,7 @@ QImage gaussianBlur3x3(const QImage &image) {
 }
 
 QImage sharpen3x3(const QImage &image) {
+  Telemetry::ScopedTimer timer("Filters::sharpen3x3", image);
   // A common sharpen kernel
   //  0 -1  0
   // -1  5 -1
@@ -109,6 +139,7 @@ QImage sharpen3x3(const QImage &image) {
 }
 
 QImage edgeDetect3x3(const QImage &image) {
+  Telemetry::ScopedTimer timer("Filters::edgeDetect3x3", image);
   // A simple edge detection kernel
   //  0  1  0
   //  1 -4  1
@@ -118,6 +149,7 @@ QImage edgeDetect3x3(const QImage &image) {
 }
 
 QImage emboss3x3(const QImage &image) {
+  Telemetry::ScopedTimer timer("Filters::emboss3x3", image);
   // A basic emboss kernel (with offset for midpoint)
   // -2 -1  0
   // -1  1  1
@@ -134,6 +166,7 @@ QImage emboss3x3(const QImage &image) {
 QImage applyConvolution(const QImage &image,
                         const QVector<QVector<int>> &kernel, int divisor,
                         int offset, int anchorX, int anchorY) {
+  Telemetry::ScopedTimer timer("Filters::applyConvolution", image);
   QImage src = image.convertToFormat(QImage::Format_RGB32);
   QImage dst(src.size(), QImage::Format_RGB32);
 
@@ -148,6 +181,8 @@ QImage applyConvolution(const QImage &image,
 
   // Loop over every pixel.
   for (int y = 0; y < src.height(); y++) {
+    if (!JobContext::reportRow(y, src.height()))
+      return QImage();
     for (int x = 0; x < src.width(); x++) {
       int sumR = 0, sumG = 0, sumB = 0;
       // Loop over kernel rows and columns.
@@ -183,17 +218,25 @@ QImage applyConvolution(const QImage &image,
 //---------------------------//
 
 QImage applyMedianFilter(const QImage &image, int kernelSize) {
-  QImage result(image.size(), image.format());
+  Telemetry::ScopedTimer timer("Filters::applyMedianFilter", image);
+  // Pixels of indexed images are palette indices, which setPixel() cannot
+  // take as colors; other formats, Grayscale8 in particular, are kept.
+  QImage src = image.colorCount() > 0
+                   ? image.convertToFormat(QImage::Format_RGB32)
+                   : image;
+  QImage result(src.size(), src.format());
   int radius = kernelSize / 2;
-  for (int y = 0; y < image.height(); ++y) {
-    for (int x = 0; x < image.width(); ++x) {
+  for (int y = 0; y < src.height(); ++y) {
+    if (!JobContext::reportRow(y, src.height()))
+      return QImage();
+    for (int x = 0; x < src.width(); ++x) {
       QVector<int> window;
       for (int j = -radius; j <= radius; ++j) {
         for (int i = -radius; i <= radius; ++i) {
           int nx = x + i;
           int ny = y + j;
-          if (nx >= 0 && nx < image.width() && ny >= 0 && ny < image.height()) {
-            int intensity = qGray(image.pixel(nx, ny));
+          if (nx >= 0 && nx < src.width() && ny >= 0 && ny < src.height()) {
+            int intensity = qGray(src.pixel(nx, ny));
             window.append(intensity);
           }
         }
@@ -207,6 +250,7 @@ QImage applyMedianFilter(const QImage &image, int kernelSize) {
 }
 
 QImage applyErosionFilter(const QImage &image, int kernelSize) {
+  Telemetry::ScopedTimer timer("Filters::applyErosionFilter", image);
   if (kernelSize % 2 == 0) {
     kernelSize++;
   }
@@ -218,6 +262,8 @@ QImage applyErosionFilter(const QImage &image, int kernelSize) {
   int height = src.height();
 
   for (int y = 0; y < height; ++y) {
+    if (!JobContext::reportRow(y, height))
+      return QImage();
     for (int x = 0; x < width; ++x) {
       int minR = 255, minG = 255, minB = 255;
       for (int dy = -radius; dy <= radius; ++dy) {
@@ -237,6 +283,7 @@ QImage applyErosionFilter(const QImage &image, int kernelSize) {
 }
 
 QImage applyDilationFilter(const QImage &image, int kernelSize) {
+  Telemetry::ScopedTimer timer("Filters::applyDilationFilter", image);
   if (kernelSize % 2 == 0) {
     kernelSize++;
   }
@@ -248,6 +295,8 @@ QImage applyDilationFilter(const QImage &image, int kernelSize) {
   int height = src.height();
 
   for (int y = 0; y < height; ++y) {
+    if (!JobContext::reportRow(y, height))
+      return QImage();
     for (int x = 0; x < width; ++x) {
       int maxR = 0, maxG = 0, maxB = 0;
       for (int dy = -radius; dy <= radius; ++dy) {
@@ -266,4 +315,203 @@ QImage applyDilationFilter(const QImage &image, int kernelSize) {
   return dst;
 }
 
+//------------------------//
+// Histogram Equalization //
+//------------------------//
+
+namespace {
+using Lut = std::array<quint8, 256>;
+
+/* Clips the bins at limit and spreads the excess evenly over all bins; the
+ * remainder goes to bins at regular steps, as in the usual CLAHE. */
+void clipHistogram(Histogram::Bins &bins, quint64 limit) {
+  quint64 excess = 0;
+  for (quint64 &count : bins) {
+    if (count > limit) {
+      excess += count - limit;
+      count = limit;
+    }
+  }
+  const quint64 perBin = excess / 256;
+  const quint64 remainder = excess % 256;
+  for (quint64 &count : bins)
+    count += perBin;
+  if (remainder > 0) {
+    const quint64 step = 256 / remainder;
+    for (quint64 v = 0, given = 0; v < 256 && given < remainder;
+         v += step, ++given)
+      ++bins[v];
+  }
+}
+
+/* Scales the channels so that the pixel's luma becomes mapped. */
+inline QRgb scaleLuma(QRgb pixel, int luma, int mapped) {
+  if (luma == 0)
+    return qRgb(mapped, mapped, mapped);
+  auto scale = [&](int c) {
+    return std::min(255, (c * mapped + luma / 2) / luma);
+  };
+  return qRgb(scale(qRed(pixel)), scale(qGreen(pixel)), scale(qBlue(pixel)));
+}
+
+/* The CLAHE tile mapping: the scaled cumulative distribution. */
+Lut cumulativeLut(const Histogram::Bins &bins, quint64 pixels) {
+  Lut lut;
+  quint64 cdf = 0;
+  for (int v = 0; v < 256; ++v) {
+    cdf += bins[v];
+    lut[v] = quint8(std::min<quint64>(255, (cdf * 255 + pixels / 2) / pixels));
+  }
+  return lut;
+}
+} // namespace
+
+QImage equalizeHistogram(const QImage &image, HistogramMode mode) {
+  Telemetry::ScopedTimer timer("Filters::equalizeHistogram", image);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+
+  const Histogram::Counts counts = Histogram::compute(src);
+  if (JobContext::cancellationRequested())
+    return QImage();
+  const bool luminance = mode == HistogramMode::Luminance;
+  Lut luts[3];
+  for (int c = 0; c < (luminance ? 1 : 3); ++c)
+    luts[c] = Histogram::equalizationLut(
+        counts[luminance ? Histogram::Luma : Histogram::Channel(c)]);
+
+  // Single mapping pass.
+  const int width = src.width();
+  int threads = Parallel::forRows(
+      src.height(), width, [&](int begin, int end, int) {
+        for (int y = begin; y < end; ++y) {
+          const QRgb *in =
+              reinterpret_cast<const QRgb *>(src.constScanLine(y));
+          QRgb *out = reinterpret_cast<QRgb *>(dst.scanLine(y));
+          for (int x = 0; x < width; ++x) {
+            if (luminance) {
+              int luma = qGray(in[x]);
+              out[x] = scaleLuma(in[x], luma, luts[0][luma]);
+            } else {
+              out[x] = qRgb(luts[0][qRed(in[x])], luts[1][qGreen(in[x])],
+                            luts[2][qBlue(in[x])]);
+            }
+          }
+        }
+      });
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
+QImage applyCLAHE(const QImage &image, int tilesX, int tilesY,
+                  double clipLimit, HistogramMode mode) {
+  Telemetry::ScopedTimer timer("Filters::applyCLAHE", image);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  const int width = src.width(), height = src.height();
+  if (width == 0 || height == 0)
+    return dst;
+  tilesX = std::clamp(tilesX, 1, width);
+  tilesY = std::clamp(tilesY, 1, height);
+  clipLimit = std::max(1.0, clipLimit);
+
+  // Tile i covers columns [i * width / tilesX, (i + 1) * width / tilesX).
+  auto tileStart = [](int i, int tiles, int size) {
+    return int(qint64(i) * size / tiles);
+  };
+
+  // One mapping per tile and channel (a single one in luminance mode).
+  const int channels = mode == HistogramMode::Luminance ? 1 : 3;
+  std::vector<Lut> maps(size_t(tilesX) * tilesY * channels);
+  auto mapAt = [&](int tx, int ty, int c) -> const Lut & {
+    return maps[(size_t(ty) * tilesX + tx) * channels + c];
+  };
+
+  const qint64 tilePixels = qint64(width) * height / (tilesX * tilesY);
+  int threads = Parallel::forRows(
+      tilesX * tilesY, std::max<qint64>(1, tilePixels),
+      [&](int begin, int end, int) {
+        for (int t = begin; t < end; ++t) {
+          const int tx = t % tilesX, ty = t / tilesX;
+          const int x0 = tileStart(tx, tilesX, width);
+          const int y0 = tileStart(ty, tilesY, height);
+          const QRect rect(x0, y0, tileStart(tx + 1, tilesX, width) - x0,
+                           tileStart(ty + 1, tilesY, height) - y0);
+          Histogram::Counts counts;
+          for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const QRgb *line =
+                reinterpret_cast<const QRgb *>(src.constScanLine(y));
+            for (int x = rect.left(); x <= rect.right(); ++x)
+              counts.add(line[x]);
+          }
+          const quint64 limit = std::max<quint64>(
+              1, quint64(clipLimit * counts.pixels / 256.0));
+          for (int c = 0; c < channels; ++c) {
+            Histogram::Bins bins =
+                counts[channels == 1 ? Histogram::Luma : Histogram::Channel(c)];
+            clipHistogram(bins, limit);
+            maps[size_t(t) * channels + c] = cumulativeLut(bins, counts.pixels);
+          }
+        }
+      });
+  if (threads == 0)
+    return QImage();
+
+  // Neighbouring tile centers and the interpolation weight along one axis.
+  struct Span {
+    int lo, hi;
+    float weight; ///< Weight of hi.
+  };
+  auto spans = [](int size, int tiles) {
+    std::vector<Span> result(size);
+    for (int i = 0; i < size; ++i) {
+      float g = (i + 0.5f) * tiles / size - 0.5f;
+      if (g <= 0) {
+        result[i] = {0, 0, 0.0f};
+      } else if (g >= tiles - 1) {
+        result[i] = {tiles - 1, tiles - 1, 0.0f};
+      } else {
+        int lo = int(g);
+        result[i] = {lo, lo + 1, g - lo};
+      }
+    }
+    return result;
+  };
+  const std::vector<Span> columns = spans(width, tilesX);
+  const std::vector<Span> rows = spans(height, tilesY);
+
+  // Single mapping pass.
+  threads = Parallel::forRows(height, width, [&](int begin, int end, int) {
+    for (int y = begin; y < end; ++y) {
+      const Span &sy = rows[y];
+      const QRgb *in = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+      QRgb *out = reinterpret_cast<QRgb *>(dst.scanLine(y));
+      for (int x = 0; x < width; ++x) {
+        const Span &sx = columns[x];
+        auto interpolate = [&](int c, int v) {
+          float top = mapAt(sx.lo, sy.lo, c)[v] * (1 - sx.weight) +
+                      mapAt(sx.hi, sy.lo, c)[v] * sx.weight;
+          float bottom = mapAt(sx.lo, sy.hi, c)[v] * (1 - sx.weight) +
+                         mapAt(sx.hi, sy.hi, c)[v] * sx.weight;
+          return int(top * (1 - sy.weight) + bottom * sy.weight + 0.5f);
+        };
+        if (channels == 1) {
+          int luma = qGray(in[x]);
+          out[x] = scaleLuma(in[x], luma, interpolate(0, luma));
+        } else {
+          out[x] = qRgb(interpolate(0, qRed(in[x])),
+                        interpolate(1, qGreen(in[x])),
+                        interpolate(2, qBlue(in[x])));
+        }
+      }
+    }
+  });
+  if (threads == 0)
+    return QImage();
+  timer.setThreads(threads);
+  return dst;
+}
+
 } // namespace Filters
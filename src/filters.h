@@ -2,11 +2,20 @@
 #define FILTERS_H
 
 #include <QImage>
+#include <QVector>
 
 /**
  * @namespace Filters
  * @brief Contains various image processing filters, including functional
  * adjustments and convolution-based effects.
+ *
+ * All filters report each row to the JobContext of the calling thread, which
+ * drives progress reporting, and return a null QImage when the job has been
+ * cancelled.
+ *
+ * The point filters (invert, brightness, contrast, gamma and lookup tables)
+ * return Format_Indexed8 images as indexed images, with only their color
+ * table transformed. The other filters convert their input to RGB32.
  */
 namespace Filters {
 
@@ -60,6 +69,16 @@ QImage adjustContrast(const QImage &image, double factor);
  */
 QImage adjustGamma(const QImage &image, double gammaValue);
 
+/**
+ * @brief Maps the red, green and blue channels through a lookup table, e.g.
+ * a curve drawn in the functional editor.
+ * @param image The input image.
+ * @param lut 256 output values, indexed by the input value. Values outside
+ * 0..255 are clamped.
+ * @return A new image with the table applied.
+ */
+QImage applyLookupTable(const QImage &image, const QVector<int> &lut);
+
 /**
  * @brief Applies a simple box blur filter.
  * @param image The input image.
@@ -119,6 +138,48 @@ QImage applyErosionFilter(const QImage &image, int kernelSize = 3);
  */
 QImage applyDilationFilter(const QImage &image, int kernelSize = 3);
 
+/**
+ * @brief Which histograms drive histogram equalization.
+ */
+enum class HistogramMode {
+  /// One mapping from the luma histogram. Each pixel's channels are scaled
+  /// by the ratio of its mapped to its original luma, which keeps hues.
+  Luminance,
+  /// An independent mapping per channel; may shift hues.
+  PerChannel,
+};
+
+/**
+ * @brief Applies global histogram equalization.
+ * @param image The input image.
+ * @param mode Which histograms the mapping is built from.
+ * @return A new RGB32 image whose histogram is spread over 0..255.
+ */
+QImage equalizeHistogram(const QImage &image,
+                         HistogramMode mode = HistogramMode::Luminance);
+
+/**
+ * @brief Applies contrast-limited adaptive histogram equalization (CLAHE).
+ *
+ * The image is divided into tilesX x tilesY tiles, each with its own
+ * equalization mapping. Histogram bins above clipLimit times the mean bin
+ * count are clipped and the excess is redistributed over all bins, which
+ * limits noise amplification. Each pixel is mapped by bilinear
+ * interpolation between the mappings of the four nearest tile centers.
+ *
+ * @param image The input image.
+ * @param tilesX Number of tiles horizontally.
+ * @param tilesY Number of tiles vertically.
+ * @param clipLimit Clip limit relative to the mean bin count (>= 1). Lower
+ * values amplify contrast less; large values approach plain per-tile
+ * equalization.
+ * @param mode Which histograms the mappings are built from.
+ * @return A new RGB32 image.
+ */
+QImage applyCLAHE(const QImage &image, int tilesX = 8, int tilesY = 8,
+                  double clipLimit = 2.0,
+                  HistogramMode mode = HistogramMode::Luminance);
+
 } // namespace Filters
 
 #endif // FILTERS_H
@@ -0,0 +1,257 @@
+#include "histogram.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace Histogram {
+namespace {
+/* Budget for the per-thread color counters; a full 24-bit histogram takes
+ * 64 MB, so it is counted by at most four threads. */
+constexpr qint64 MaxCounterBytes = qint64(256) << 20;
+/* Counters summed per band of the merge pass. */
+constexpr int MergeBandBins = 1 << 14;
+
+/* Orders by count, descending, then by color, ascending. */
+inline bool moreFrequent(const ColorCount &a, const ColorCount &b) {
+  return a.count != b.count ? a.count > b.count : a.color < b.color;
+}
+
+/* Keeps the best `limit` colors seen so far; the worst of them is on top. */
+class TopColors {
+public:
+  explicit TopColors(int limit) : limit(limit) {
+    // Most images have far fewer distinct colors than a large limit.
+    heap.reserve(std::min(limit, 1 << 16));
+  }
+
+  void offer(const ColorCount &c) {
+    if (int(heap.size()) < limit) {
+      heap.push_back(c);
+      std::push_heap(heap.begin(), heap.end(), moreFrequent);
+    } else if (moreFrequent(c, heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), moreFrequent);
+      heap.back() = c;
+      std::push_heap(heap.begin(), heap.end(), moreFrequent);
+    }
+  }
+
+  const std::vector<ColorCount> &colors() const { return heap; }
+
+private:
+  int limit;
+  std::vector<ColorCount> heap;
+};
+
+/* Flat color counters, one array per counting thread. */
+class ColorCounters {
+public:
+  explicit ColorCounters(int bitsPerChannel)
+      : bits(std::clamp(bitsPerChannel, 1, 8)), shift(8 - bits),
+        bins(1 << (3 * bits)), bandBins(std::min(bins, MergeBandBins)) {}
+
+  /* Counts the pixels of the image; false if the job was cancelled. */
+  bool count(const QImage &image) {
+    const QImage src = image.format() == QImage::Format_RGB32 ||
+                               image.format() == QImage::Format_ARGB32
+                           ? image
+                           : image.convertToFormat(QImage::Format_RGB32);
+    if (src.isNull())
+      return false;
+    const int width = src.width(), height = src.height();
+
+    // Every thread allocates (and so first touches) its own counters.
+    const int limit =
+        int(std::max<qint64>(1, MaxCounterBytes / (qint64(bins) * 4)));
+    partial.resize(Parallel::threadsFor(height, width, limit));
+    return Parallel::forRows(
+               height, width,
+               [&](int begin, int end, int thread) {
+                 std::unique_ptr<quint32[]> &counts = partial[thread];
+                 if (!counts)
+                   counts.reset(new quint32[bins]());
+                 quint32 *c = counts.get();
+                 for (int y = begin; y < end; ++y) {
+                   const QRgb *line =
+                       reinterpret_cast<const QRgb *>(src.constScanLine(y));
+                   for (int x = 0; x < width; ++x)
+                     ++c[binOf(line[x])];
+                 }
+               },
+               limit) != 0;
+  }
+
+  int mergeBands() const { return bins / bandBins; }
+  int mergeThreads() const {
+    return Parallel::threadsFor(mergeBands(), mergeCost());
+  }
+
+  /* Sums the counters in parallel bands and calls
+   * visit(bin, count, thread, band) for every non-empty bin, in ascending
+   * order within a band. False if the job was cancelled. */
+  template <typename Visit> bool merge(Visit visit) const {
+    return Parallel::forRows(
+               mergeBands(), mergeCost(),
+               [&](int begin, int end, int thread) {
+                 for (int band = begin; band < end; ++band) {
+                   for (int bin = band * bandBins; bin < (band + 1) * bandBins;
+                        ++bin) {
+                     quint32 n = 0;
+                     for (const std::unique_ptr<quint32[]> &counts : partial)
+                       n += counts ? counts[bin] : 0;
+                     if (n > 0)
+                       visit(bin, n, thread, band);
+                   }
+                 }
+               }) != 0;
+  }
+
+  /* The color representing a bin: the color itself at 8 bits, otherwise
+   * the centre of the bin. */
+  QRgb color(int bin) const {
+    const int mask = (1 << bits) - 1;
+    const int centre = shift > 0 ? 1 << (shift - 1) : 0;
+    return qRgb((((bin >> (2 * bits)) & mask) << shift) | centre,
+                (((bin >> bits) & mask) << shift) | centre,
+                ((bin & mask) << shift) | centre);
+  }
+
+private:
+  int binOf(QRgb p) const {
+    return ((qRed(p) >> shift) << (2 * bits)) |
+           ((qGreen(p) >> shift) << bits) | (qBlue(p) >> shift);
+  }
+  long long mergeCost() const {
+    return qint64(bandBins) * qint64(std::max<size_t>(1, partial.size()));
+  }
+
+  const int bits, shift, bins, bandBins;
+  std::vector<std::unique_ptr<quint32[]>> partial;
+};
+} // namespace
+
+void Counts::merge(const Counts &other) {
+  for (int c = 0; c < ChannelCount; ++c)
+    for (int v = 0; v < 256; ++v)
+      bins[c][v] += other.bins[c][v];
+  pixels += other.pixels;
+}
+
+Counts compute(const QImage &image, const QRect &region) {
+  const bool gray = image.format() == QImage::Format_Grayscale8;
+  const QImage src = gray || image.format() == QImage::Format_RGB32 ||
+                             image.format() == QImage::Format_ARGB32
+                         ? image
+                         : image.convertToFormat(QImage::Format_RGB32);
+  const QRect area =
+      region.isNull() ? src.rect() : region.intersected(src.rect());
+  Counts total;
+  if (area.isEmpty())
+    return total;
+
+  const int x0 = area.left(), width = area.width();
+  const int threads = Parallel::threadsFor(area.height(), width);
+  std::vector<Counts> local(threads);
+
+  Parallel::forRows(
+      area.height(), width, [&](int begin, int end, int thread) {
+        Counts &counts = local[thread];
+        for (int y = area.top() + begin; y < area.top() + end; ++y) {
+          if (gray) {
+            const uchar *line = src.constScanLine(y) + x0;
+            for (int x = 0; x < width; ++x) {
+              uchar v = line[x];
+              ++counts.bins[Red][v];
+              ++counts.bins[Green][v];
+              ++counts.bins[Blue][v];
+              ++counts.bins[Luma][v];
+            }
+            counts.pixels += width;
+          } else {
+            const QRgb *line =
+                reinterpret_cast<const QRgb *>(src.constScanLine(y)) + x0;
+            for (int x = 0; x < width; ++x)
+              counts.add(line[x]);
+          }
+        }
+      });
+
+  for (const Counts &counts : local)
+    total.merge(counts);
+  return total;
+}
+
+std::vector<ColorCount> mostFrequentColors(const QImage &image, int count,
+                                           int bitsPerChannel) {
+  ColorCounters counters(bitsPerChannel);
+  if (count <= 0 || !counters.count(image))
+    return {};
+
+  // Sum the partial counters and select the most frequent bins, each
+  // thread keeping its own top list for the bins it merged.
+  std::vector<TopColors> top(counters.mergeThreads(), TopColors(count));
+  bool done = counters.merge([&](int bin, quint32 n, int thread, int) {
+    top[thread].offer({counters.color(bin), n});
+  });
+  if (!done)
+    return {};
+
+  TopColors best(count);
+  for (const TopColors &t : top)
+    for (const ColorCount &c : t.colors())
+      best.offer(c);
+  std::vector<ColorCount> result = best.colors();
+  std::sort(result.begin(), result.end(), moreFrequent);
+  return result;
+}
+
+std::vector<ColorCount> colorCounts(const QImage &image, int bitsPerChannel) {
+  ColorCounters counters(bitsPerChannel);
+  if (!counters.count(image))
+    return {};
+
+  // Collected per band, so that concatenating the bands keeps the colors in
+  // ascending order.
+  std::vector<std::vector<ColorCount>> bands(counters.mergeBands());
+  bool done = counters.merge([&](int bin, quint32 n, int, int band) {
+    bands[band].push_back({counters.color(bin), n});
+  });
+  if (!done)
+    return {};
+
+  size_t total = 0;
+  for (const std::vector<ColorCount> &band : bands)
+    total += band.size();
+  std::vector<ColorCount> result;
+  result.reserve(total);
+  for (const std::vector<ColorCount> &band : bands)
+    result.insert(result.end(), band.begin(), band.end());
+  return result;
+}
+
+std::array<quint8, 256> equalizationLut(const Bins &bins) {
+  std::array<quint8, 256> lut;
+  quint64 cdf[256];
+  quint64 sum = 0;
+  for (int v = 0; v < 256; ++v)
+    cdf[v] = sum += bins[v];
+
+  quint64 cdfMin = 0;
+  for (int v = 0; v < 256 && cdfMin == 0; ++v)
+    cdfMin = cdf[v];
+
+  const quint64 total = sum;
+  for (int v = 0; v < 256; ++v) {
+    if (total == cdfMin) {
+      lut[v] = quint8(v); // A single value: nothing to spread.
+    } else {
+      quint64 above = cdf[v] > cdfMin ? cdf[v] - cdfMin : 0;
+      lut[v] = quint8((above * 255 + (total - cdfMin) / 2) /
+                      (total - cdfMin));
+    }
+  }
+  return lut;
+}
+
+} // namespace Histogram
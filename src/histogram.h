@@ -0,0 +1,106 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QImage>
+#include <QRect>
+#include <QtGlobal>
+#include <array>
+#include <vector>
+
+/**
+ * @namespace Histogram
+ * @brief 8-bit histograms of the red, green, blue and luma channels, and
+ * histograms of whole colors.
+ *
+ * Histograms of large images are built in parallel: every thread counts its
+ * rows into a local histogram and the locals are merged at the end, so no
+ * counter is shared between threads.
+ */
+namespace Histogram {
+
+enum Channel { Red, Green, Blue, Luma, ChannelCount };
+
+using Bins = std::array<quint64, 256>;
+
+/**
+ * @brief Counts of all four channels of a set of pixels.
+ */
+struct Counts {
+  std::array<Bins, ChannelCount> bins{};
+  quint64 pixels = 0;
+
+  const Bins &operator[](Channel channel) const { return bins[channel]; }
+
+  /** @brief Adds the counts of another histogram. */
+  void merge(const Counts &other);
+
+  /** @brief Counts one pixel. Luma is qGray(). */
+  void add(QRgb pixel) {
+    ++bins[Red][qRed(pixel)];
+    ++bins[Green][qGreen(pixel)];
+    ++bins[Blue][qBlue(pixel)];
+    ++bins[Luma][qGray(pixel)];
+    ++pixels;
+  }
+};
+
+/**
+ * @brief Computes the histograms of an image or a region of it.
+ * @param image The image.
+ * @param region The pixels to count; a null rectangle counts all of them.
+ * @return The counts. They are incomplete if the job was cancelled.
+ */
+Counts compute(const QImage &image, const QRect &region = QRect());
+
+/**
+ * @brief Builds the classic histogram equalization mapping, which spreads
+ * the cumulative distribution of the bins evenly over 0..255.
+ */
+std::array<quint8, 256> equalizationLut(const Bins &bins);
+
+/**
+ * @brief A color and the number of pixels that have it.
+ */
+struct ColorCount {
+  QRgb color;
+  quint32 count;
+};
+
+/**
+ * @brief Finds the most frequent colors of an image.
+ *
+ * Colors are counted in a flat array of 2^(3 * bitsPerChannel) counters,
+ * indexed by the color itself; at 8 bits per channel every 24-bit color has
+ * its own counter. Each thread counts into its own array (the number of
+ * threads is limited so that the arrays stay within a fixed memory budget),
+ * and the arrays are summed while the most frequent colors are selected with
+ * a bounded heap, so the colors are never sorted as a whole.
+ *
+ * With fewer bits per channel, colors are pre-binned: each bin counts all
+ * colors sharing the top bits of every channel and is represented by the
+ * color at its centre. This trades exactness for a histogram that fits in
+ * cache.
+ *
+ * Alpha is ignored.
+ *
+ * @param image The image.
+ * @param count The maximum number of colors to return.
+ * @param bitsPerChannel Bits kept per channel, 1 to 8.
+ * @return Up to count colors, most frequent first; colors with the same
+ * count are in ascending QRgb order. Empty if the job was cancelled.
+ */
+std::vector<ColorCount> mostFrequentColors(const QImage &image, int count,
+                                           int bitsPerChannel = 8);
+
+/**
+ * @brief Counts every color of an image, in the same way as
+ * mostFrequentColors().
+ * @return The colors that occur, with their counts, in ascending QRgb order.
+ * Empty if the job was cancelled.
+ */
+std::vector<ColorCount> colorCounts(const QImage &image,
+                                    int bitsPerChannel = 8);
+
+} // namespace Histogram
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,128 @@
+#include "imagehistory.h"
+#include <cstdlib>
+
+ImageHistory::ImageHistory(int checkpointInterval, qint64 memoryBudget)
+    : interval(qMax(1, checkpointInterval)), budget(memoryBudget) {}
+
+void ImageHistory::reset(const QImage &original) {
+  steps.clear();
+  checkpoints.clear();
+  position = 0;
+  currentImage = original;
+  if (!original.isNull())
+    checkpoints.insert(0, original);
+}
+
+QImage ImageHistory::apply(const QString &label, const Operation &op) {
+  push(label, op, op(currentImage));
+  return currentImage;
+}
+
+void ImageHistory::push(const QString &label, const Operation &op,
+                        const QImage &result) {
+  // A new step invalidates everything that was undone.
+  steps.resize(position);
+  while (!checkpoints.isEmpty() && checkpoints.lastKey() > position)
+    checkpoints.remove(checkpoints.lastKey());
+
+  steps.append({label, op});
+  ++position;
+  currentImage = result;
+  if (position % interval == 0)
+    storeCheckpoint(position, currentImage);
+}
+
+QImage ImageHistory::undo() {
+  if (!canUndo())
+    return currentImage;
+  moveTo(position - 1, replayTo(position - 1).run());
+  return currentImage;
+}
+
+QImage ImageHistory::redo() {
+  if (!canRedo())
+    return currentImage;
+  moveTo(position + 1, replayTo(position + 1).run());
+  return currentImage;
+}
+
+ImageHistory::Replay ImageHistory::replayTo(int target) const {
+  Replay replay;
+  int from = position;
+  replay.image = currentImage;
+  if (target < position) {
+    // Nearest checkpoint at or before target. Step 0 always exists.
+    auto it = checkpoints.upperBound(target);
+    --it;
+    from = it.key();
+    replay.image = it.value();
+  }
+  for (int i = from; i < target; ++i)
+    replay.ops.append(steps[i].op);
+  return replay;
+}
+
+void ImageHistory::moveTo(int target, const QImage &image) {
+  position = target;
+  currentImage = image;
+  if (position % interval == 0 && !checkpoints.contains(position))
+    storeCheckpoint(position, currentImage);
+}
+
+QImage ImageHistory::Replay::run() const {
+  QImage result = image;
+  for (const Operation &op : ops) {
+    result = op(result);
+    if (result.isNull())
+      break;
+  }
+  return result;
+}
+
+QString ImageHistory::undoLabel() const {
+  return canUndo() ? steps[position - 1].label : QString();
+}
+
+QString ImageHistory::redoLabel() const {
+  return canRedo() ? steps[position].label : QString();
+}
+
+void ImageHistory::setCheckpointInterval(int stepCount) {
+  interval = qMax(1, stepCount);
+}
+
+void ImageHistory::setMemoryBudget(qint64 bytes) {
+  budget = bytes;
+  enforceBudget();
+}
+
+qint64 ImageHistory::checkpointBytes() const {
+  qint64 total = 0;
+  for (auto it = checkpoints.cbegin(); it != checkpoints.cend(); ++it) {
+    // The original is owned by the caller as well, so it is not counted.
+    if (it.key() != 0)
+      total += it.value().sizeInBytes();
+  }
+  return total;
+}
+
+void ImageHistory::storeCheckpoint(int step, const QImage &image) {
+  checkpoints.insert(step, image);
+  enforceBudget();
+}
+
+void ImageHistory::enforceBudget() {
+  while (checkpoints.size() > 1 && checkpointBytes() > budget) {
+    // Evict the checkpoint farthest from where the user currently is, since
+    // it is the least likely to be needed by the next undo.
+    int victim = -1;
+    for (auto it = checkpoints.cbegin(); it != checkpoints.cend(); ++it) {
+      if (it.key() == 0)
+        continue;
+      if (victim < 0 ||
+          std::abs(it.key() - position) > std::abs(victim - position))
+        victim = it.key();
+    }
+    checkpoints.remove(victim);
+  }
+}
@@ -0,0 +1,152 @@
+#ifndef IMAGEHISTORY_H
+#define IMAGEHISTORY_H
+
+#include <QImage>
+#include <QMap>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief The ImageHistory class
+ *
+ * Non-destructive undo/redo history of the operations applied to an image.
+ *
+ * Every applied operation is recorded as a step. Instead of keeping a full
+ * copy of the image after each step, a full-image checkpoint is cached every
+ * checkpointInterval() steps. Undo restores the nearest checkpoint at or
+ * before the target step and replays the remaining operations; redo replays
+ * a single step on top of the current image.
+ *
+ * Checkpoints are kept within memoryBudget() bytes. When the budget is
+ * exceeded, the checkpoints farthest from the current position are evicted
+ * first. The original image (step 0) is always kept.
+ *
+ * Operations must be pure functions of their input image, since they may be
+ * replayed any number of times.
+ */
+class ImageHistory {
+public:
+  using Operation = std::function<QImage(const QImage &)>;
+
+  /**
+   * @brief What it takes to compute the image at some step: a cached image
+   * and the operations to apply to it. Holds copies, so it can run on
+   * another thread while the history changes.
+   */
+  struct Replay {
+    QImage image;
+    QVector<Operation> ops;
+
+    /**
+     * @brief Applies the operations in order. Returns a null image if an
+     * operation does, e.g. when its job was cancelled.
+     */
+    QImage run() const;
+  };
+
+  /**
+   * @brief Constructs an empty history.
+   * @param checkpointInterval Number of steps between cached checkpoints.
+   * @param memoryBudget Maximum number of bytes used by cached checkpoints.
+   */
+  explicit ImageHistory(int checkpointInterval = 5,
+                        qint64 memoryBudget = qint64(1024) * 1024 * 1024);
+
+  /**
+   * @brief Clears the history and starts over from the given image.
+   * @param original The image at step 0.
+   */
+  void reset(const QImage &original);
+
+  /**
+   * @brief Applies an operation to the current image and records it.
+   *
+   * Any steps that were undone are discarded.
+   *
+   * @param label A human-readable name of the operation.
+   * @param op The operation to apply.
+   * @return The new current image.
+   */
+  QImage apply(const QString &label, const Operation &op);
+
+  /**
+   * @brief Records an operation whose result was computed elsewhere.
+   * @param label A human-readable name of the operation.
+   * @param op The operation, used if the step has to be replayed.
+   * @param result The result of applying op to current().
+   */
+  void push(const QString &label, const Operation &op, const QImage &result);
+
+  /**
+   * @brief Steps one operation back.
+   * @return The image after the undo.
+   */
+  QImage undo();
+
+  /**
+   * @brief Re-applies the last undone operation.
+   * @return The image after the redo.
+   */
+  QImage redo();
+
+  /**
+   * @brief Returns how to compute the image after target steps: from the
+   * current image when moving forward, otherwise from the nearest
+   * checkpoint at or before target.
+   *
+   * Together with moveTo(), this is undo() and redo() split in two, so that
+   * the replay can run in the background.
+   *
+   * @param target A step in 0 .. stepCount().
+   */
+  Replay replayTo(int target) const;
+
+  /**
+   * @brief Moves to target steps, with image the result of replayTo(target)
+   * on the unchanged history.
+   */
+  void moveTo(int target, const QImage &image);
+
+  bool canUndo() const { return position > 0; }
+  bool canRedo() const { return position < steps.size(); }
+
+  /** @brief Label of the operation undo() would revert. */
+  QString undoLabel() const;
+  /** @brief Label of the operation redo() would re-apply. */
+  QString redoLabel() const;
+
+  QImage current() const { return currentImage; }
+  /** @brief Number of steps applied to current(). */
+  int currentStep() const { return position; }
+  /** @brief Number of recorded steps, undone ones included. */
+  int stepCount() const { return steps.size(); }
+  bool isEmpty() const { return currentImage.isNull(); }
+
+  int checkpointInterval() const { return interval; }
+  void setCheckpointInterval(int steps);
+
+  qint64 memoryBudget() const { return budget; }
+  void setMemoryBudget(qint64 bytes);
+
+  /** @brief Number of bytes currently held by cached checkpoints. */
+  qint64 checkpointBytes() const;
+
+private:
+  struct Step {
+    QString label;
+    Operation op;
+  };
+
+  void storeCheckpoint(int step, const QImage &image);
+  void enforceBudget();
+
+  QVector<Step> steps;
+  QMap<int, QImage> checkpoints; ///< Step index -> image after that step.
+  QImage currentImage;
+  int position = 0; ///< Number of steps applied to currentImage.
+  int interval;
+  qint64 budget;
+};
+
+#endif // IMAGEHISTORY_H
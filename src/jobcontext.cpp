@@ -0,0 +1,25 @@
+#include "jobcontext.h"
+#include <algorithm>
+
+namespace {
+thread_local JobContext *currentContext = nullptr;
+} // namespace
+
+JobContext *JobContext::current() { return currentContext; }
+
+JobContext::Scope::Scope(JobContext *ctx) : previous(currentContext) {
+  currentContext = ctx;
+}
+
+JobContext::Scope::~Scope() { currentContext = previous; }
+
+bool JobContext::advance(int row, int rows) {
+  if (isCancelled())
+    return false;
+  if (progress) {
+    int band = std::max(1, rows / ProgressBands);
+    if (row % band == 0)
+      progress(double(row) / rows);
+  }
+  return true;
+}
@@ -0,0 +1,104 @@
+#ifndef JOBCONTEXT_H
+#define JOBCONTEXT_H
+
+#include "telemetry.h"
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief The JobContext class
+ *
+ * Cooperative cancellation and progress reporting for long-running image
+ * operations.
+ *
+ * A context is installed for the calling thread with JobContext::Scope. The
+ * processing functions in Filters and DitheringAndQuantization call
+ * JobContext::reportRow() once per row: it bails them out early, returning a
+ * null QImage, once the job has been cancelled from another thread, and
+ * forwards the progress to the optional callback once per band of rows.
+ * Without an installed context the call is a single null check. While
+ * Telemetry recording is enabled, it also times the row bands.
+ */
+class JobContext {
+public:
+  /**
+   * @brief Receives the progress of the running operation in [0, 1]. Called
+   * on the worker thread.
+   */
+  using ProgressCallback = std::function<void(double fraction)>;
+
+  /** @brief Number of progress reports per pass over an image. */
+  static constexpr int ProgressBands = 100;
+
+  JobContext() = default;
+  JobContext(const JobContext &) = delete;
+  JobContext &operator=(const JobContext &) = delete;
+
+  /** @brief Requests the job to stop. Safe to call from any thread. */
+  void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+  bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+  /** @brief Sets the progress callback. Must be set before the job starts. */
+  void setProgressCallback(ProgressCallback callback) {
+    progress = std::move(callback);
+  }
+
+  /**
+   * @brief Forwards a progress fraction to the callback, if any. Used by
+   * loops that do not visit rows in order (see Parallel); callers must not
+   * invoke it concurrently.
+   */
+  void reportProgress(double fraction) {
+    if (progress)
+      progress(fraction);
+  }
+
+  /** @brief The context installed for the calling thread, or nullptr. */
+  static JobContext *current();
+
+  /**
+   * @brief Returns true when the job running on the calling thread has been
+   * cancelled.
+   */
+  static bool cancellationRequested() {
+    JobContext *ctx = current();
+    return ctx && ctx->isCancelled();
+  }
+
+  /**
+   * @brief Called by row loops before processing a row.
+   * @param row The row about to be processed.
+   * @param rows The total number of rows of the pass.
+   * @return false when the job has been cancelled and the loop should stop.
+   */
+  static bool reportRow(int row, int rows) {
+    if (Telemetry::isEnabled())
+      Telemetry::rowBand(row, rows);
+    JobContext *ctx = current();
+    return !ctx || ctx->advance(row, rows);
+  }
+
+  /**
+   * @brief Installs a context for the calling thread for the lifetime of the
+   * scope, restoring the previous one afterwards.
+   */
+  class Scope {
+  public:
+    explicit Scope(JobContext *ctx);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    JobContext *previous;
+  };
+
+private:
+  bool advance(int row, int rows);
+
+  std::atomic<bool> cancelled{false};
+  ProgressCallback progress;
+};
+
+#endif // JOBCONTEXT_H
@@ -1,21 +1,59 @@
 #include "mainwindow.h"
 #include "ditheringandquantization.h"
 #include "filters.h"
+#include "parallel.h"
+#include "rawimage.h"
+#include "tiledimageview.h"
 #include "ui_mainwindow.h"
 
 #include <QColor>
 #include <QDebug>
+#include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QInputDialog>
+#include <QJsonArray>
+#include <QKeySequence>
 #include <QMessageBox>
-#include <QPixmap>
-#include <QResizeEvent>
+#include <QProgressDialog>
 #include <QStackedWidget>
+#include <QThreadPool>
 #include <QToolBar>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+
+namespace {
+Operations::Operation makeOperation(const QString &type,
+                                    const QJsonObject &params = {}) {
+  return Operations::Operation{type, params};
+}
+
+QImage loadImageFile(const QString &path) {
+  return RawImage::isRawImage(path) ? RawImage::load(path) : QImage(path);
+}
+
+bool saveImageFile(const QImage &image, const QString &path) {
+  return RawImage::isRawImage(path) ? RawImage::save(image, path)
+                                    : image.save(path);
+}
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow) {
   ui->setupUi(this);
 
+  // Both image views show the same region: zooming or panning one follows
+  // in the other.
+  ui->viewOriginal->setPlaceholderText(tr("Original Image"));
+  ui->viewFiltered->setPlaceholderText(tr("Filtered Image"));
+  connect(ui->viewOriginal, &TiledImageView::viewChanged, ui->viewFiltered,
+          &TiledImageView::setView);
+  connect(ui->viewFiltered, &TiledImageView::viewChanged, ui->viewOriginal,
+          &TiledImageView::setView);
+
   // Create a stacked widget to switch between filter mode and drawing mode.
   modeStack = new QStackedWidget(this);
 
@@ -82,22 +120,61 @@ MainWindow::MainWindow(QWidget *parent)
   connect(dqWidget,
           &DitheringQuantizationWidget::applyOrderedDitheringRequested, this,
           &MainWindow::onApplyOrderedDithering);
+  connect(dqWidget,
+          &DitheringQuantizationWidget::applyBlueNoiseDitheringRequested, this,
+          &MainWindow::onApplyBlueNoiseDithering);
   connect(dqWidget,
           &DitheringQuantizationWidget::applyOrderedDitheringYCbCrRequested,
           this, &MainWindow::onApplyOrderedDitheringYCbCr);
+  connect(dqWidget, &DitheringQuantizationWidget::applyErrorDiffusionRequested,
+          this, &MainWindow::onApplyErrorDiffusion);
   connect(dqWidget,
           &DitheringQuantizationWidget::applyPopularityQuantizationRequested,
           this, &MainWindow::onApplyPopularityQuantization);
+  connect(dqWidget,
+          &DitheringQuantizationWidget::applyMedianCutQuantizationRequested,
+          this, &MainWindow::onApplyMedianCutQuantization);
+  connect(dqWidget,
+          &DitheringQuantizationWidget::applyOctreeQuantizationRequested, this,
+          &MainWindow::onApplyOctreeQuantization);
 
   connect(functionalEditor, &FunctionalEditorDock::functionApplied, this,
           &MainWindow::onDockFunctionApplied);
   connect(convolutionEditor, &ConvolutionEditorWidget::applyConvolutionFilter,
           this, &MainWindow::onApplyConvolutionFilter);
 
+  performanceDock = new PerformanceDock(this);
+  addDockWidget(Qt::BottomDockWidgetArea, performanceDock);
+  performanceDock->hide();
+
   // Connect menu actions for file operations.
   auto viewMenu = menuBar()->addMenu("View");
   viewMenu->addAction(filterDock->toggleViewAction());
   viewMenu->addAction(dqWidget->toggleViewAction());
+  viewMenu->addAction(performanceDock->toggleViewAction());
+
+  // histogram menu actions
+  auto histogramMenu = menuBar()->addMenu(tr("Histogram"));
+  connect(histogramMenu->addAction(tr("Equalize (Luminance)")),
+          &QAction::triggered, this, [this]() {
+            onEqualizeHistogram(Filters::HistogramMode::Luminance);
+          });
+  connect(histogramMenu->addAction(tr("Equalize (Per Channel)")),
+          &QAction::triggered, this, [this]() {
+            onEqualizeHistogram(Filters::HistogramMode::PerChannel);
+          });
+  connect(histogramMenu->addAction(tr("Adaptive Equalization (CLAHE)...")),
+          &QAction::triggered, this, &MainWindow::onApplyCLAHE);
+
+  // Every applied operation is recorded; the recording can be saved as a
+  // macro and replayed here or with ImageFilteringCli --macro.
+  auto macroMenu = menuBar()->addMenu(tr("Macro"));
+  connect(macroMenu->addAction(tr("Save Recorded Macro...")),
+          &QAction::triggered, this, &MainWindow::saveMacro);
+  connect(macroMenu->addAction(tr("Replay Macro...")), &QAction::triggered,
+          this, &MainWindow::replayMacro);
+  connect(macroMenu->addAction(tr("Replay Macro on Folder...")),
+          &QAction::triggered, this, &MainWindow::replayMacroOnFolder);
 
   // texture menu actions
   auto textureMenu = menuBar()->addMenu("Textures");
@@ -113,6 +190,27 @@ MainWindow::MainWindow(QWidget *parent)
   connect(ui->actionReset_Image, &QAction::triggered, this,
           &MainWindow::on_btnReset_clicked);
 
+  // Undo/redo of the applied filters.
+  undoAction = ui->menuImage_Filtering_App->addAction(tr("Undo"));
+  undoAction->setShortcut(QKeySequence::Undo);
+  redoAction = ui->menuImage_Filtering_App->addAction(tr("Redo"));
+  redoAction->setShortcut(QKeySequence::Redo);
+  connect(undoAction, &QAction::triggered, this, &MainWindow::undo);
+  connect(redoAction, &QAction::triggered, this, &MainWindow::redo);
+  updateHistoryActions();
+
+  // Progress bar and cancel button for the running filter job, shown only
+  // while one runs.
+  jobProgress = new QProgressBar(this);
+  jobProgress->setRange(0, 1000);
+  jobProgress->setMaximumWidth(240);
+  statusBar()->addPermanentWidget(jobProgress);
+  cancelButton = new QPushButton(tr("Cancel"), this);
+  statusBar()->addPermanentWidget(cancelButton);
+  setJobRunning(false);
+  connect(cancelButton, &QPushButton::clicked, this,
+          &MainWindow::cancelActiveJob);
+
   connect(this, &MainWindow::imageLoaded, this,
           [this]() { statusBar()->showMessage(tr("Image loaded"), 3000); });
 }
@@ -138,21 +236,46 @@ void MainWindow::loadTexture() {
     static_cast<CylinderWidget*>(cylinderPage)->loadTexture(fn);
 }
 
-MainWindow::~MainWindow() { delete ui; }
+MainWindow::~MainWindow() {
+  cancelActiveJob();
+  // Cancelled jobs stop at their next row; wait so that none of them
+  // reports progress to a deleted window.
+  for (QFuture<QImage> &future : jobFutures)
+    future.waitForFinished();
+  delete ui;
+}
 
 void MainWindow::on_btnLoad_clicked() {
   QString fileName = QFileDialog::getOpenFileName(
-      this, tr("Open Image"), "", tr("Image Files (*.png *.jpg *.bmp)"));
+      this, tr("Open Image"), "",
+      tr("Image Files (*.png *.jpg *.bmp *.rawimg)"));
   if (fileName.isEmpty())
     return;
 
-  // Load the image
-  if (!originalImage.load(fileName)) {
+  // Images this large are better streamed than edited in memory.
+  QSize size = QImageReader(fileName).size();
+  if (qint64(size.width()) * size.height() > LargeImagePixels &&
+      QMessageBox::question(
+          this, tr("Large Image"),
+          tr("This image has %1 megapixels and may not fit in memory. "
+             "ImageFilteringCli --stream can filter it in strips instead.\n\n"
+             "Load it anyway?")
+              .arg(qint64(size.width()) * size.height() / 1000000)) !=
+          QMessageBox::Yes)
+    return;
+
+  // Load the image; raw images are mapped rather than decoded.
+  originalImage = loadImageFile(fileName);
+  if (originalImage.isNull()) {
     QMessageBox::critical(this, tr("Error"), tr("Could not load image."));
     return;
   }
 
+  cancelActiveJob();
   filteredImage = originalImage; // Start with same as original
+  history.reset(originalImage);
+  recordedSteps.clear();
+  updateHistoryActions();
   displayImages();
   emit imageLoaded();
 }
@@ -164,11 +287,12 @@ void MainWindow::on_btnSave_clicked() {
   }
   QString fileName = QFileDialog::getSaveFileName(
       this, tr("Save Image"), "",
-      tr("PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp)"));
+      tr("PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp);;"
+         "Raw image (*.rawimg)"));
   if (fileName.isEmpty())
     return;
 
-  if (!filteredImage.save(fileName)) {
+  if (!saveImageFile(filteredImage, fileName)) {
     QMessageBox::critical(this, tr("Error"), tr("Could not save image."));
   }
 }
@@ -178,12 +302,14 @@ void MainWindow::on_btnReset_clicked() {
     QMessageBox::warning(this, tr("Warning"), tr("No image loaded."));
     return;
   }
-  // Revert to the original
-  filteredImage = originalImage;
+  // Revert to the original. Recorded as a step so the reset can be undone.
+  QImage original = originalImage;
+  applyOperation(
+      tr("Reset"), [original](const QImage &) { return original; },
+      RecordedStep{{}, true});
   ui->sliderBrightness->setSliderPosition(0);
   ui->sliderContrast->setSliderPosition(100);
   ui->sliderGamma->setSliderPosition(100);
-  displayImages();
 }
 
 void MainWindow::on_btnGray_clicked() {
@@ -194,32 +320,322 @@ void MainWindow::on_btnGray_clicked() {
                                  "like to convert it to grayscale first?"),
                               QMessageBox::Yes | QMessageBox::No);
     if (ret == QMessageBox::Yes) {
-      filteredImage = filteredImage.convertToFormat(QImage::Format_Grayscale8);
-      displayImages();
+      applyOperation(tr("Convert to Grayscale"), {makeOperation("gray")});
     } else {
       return;
     }
   }
 }
 
+void MainWindow::undo() {
+  // Repeated presses go on from where a running undo or redo is heading.
+  int step = historyTarget >= 0 ? historyTarget : history.currentStep();
+  if (step > 0)
+    moveInHistory(step - 1);
+}
+
+void MainWindow::redo() {
+  int step = historyTarget >= 0 ? historyTarget : history.currentStep();
+  if (step < history.stepCount())
+    moveInHistory(step + 1);
+}
+
+void MainWindow::moveInHistory(int target) {
+  cancelActiveJob();
+  ImageHistory::Replay replay = history.replayTo(target);
+  auto finish = [this, target](const QImage &image) {
+    history.moveTo(target, image);
+    filteredImage = image;
+    updateHistoryActions();
+    displayImages();
+  };
+  // Checkpoint hits need no replay.
+  if (replay.ops.isEmpty()) {
+    finish(replay.image);
+    return;
+  }
+  runJob(target < history.currentStep() ? tr("Undoing") : tr("Redoing"),
+         [replay]() { return replay.run(); }, finish);
+  historyTarget = target;
+}
+
+void MainWindow::applyOperation(const QString &label,
+                                const QVector<Operations::Operation> &ops) {
+  applyOperation(
+      label,
+      [ops](const QImage &image) { return Operations::applyAll(image, ops); },
+      RecordedStep{ops, false});
+}
+
+void MainWindow::applyOperation(const QString &label,
+                                const ImageHistory::Operation &op,
+                                const RecordedStep &recorded) {
+  if (filteredImage.isNull()) {
+    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
+    return;
+  }
+
+  QImage input = filteredImage;
+  runJob(tr("Applying %1").arg(label), [op, input]() { return op(input); },
+         [this, label, op, recorded](const QImage &result) {
+           recordedSteps.resize(history.currentStep());
+           history.push(label, op, result);
+           recordedSteps.append(recorded);
+           filteredImage = result;
+           updateHistoryActions();
+           displayImages();
+         });
+}
+
+void MainWindow::runJob(const QString &status,
+                        const std::function<QImage()> &work,
+                        const std::function<void(const QImage &)> &finish) {
+  // Supersede whatever is still running; its result will be dropped.
+  cancelActiveJob();
+
+  auto job = std::make_shared<JobContext>();
+  activeJob = job;
+  quint64 generation = jobGeneration;
+
+  // Progress arrives on the worker thread; hop to the GUI thread and drop
+  // reports of jobs that were superseded in the meantime.
+  job->setProgressCallback([this, generation](double fraction) {
+    QMetaObject::invokeMethod(
+        this,
+        [this, generation, fraction]() {
+          if (generation == jobGeneration)
+            updateJobProgress(fraction);
+        },
+        Qt::QueuedConnection);
+  });
+
+  auto *watcher = new QFutureWatcher<QImage>(this);
+  connect(watcher, &QFutureWatcher<QImage>::finished, this,
+          [this, watcher, job, generation, finish]() {
+            watcher->deleteLater();
+            if (job->isCancelled() || generation != jobGeneration)
+              return;
+            activeJob.reset();
+            historyTarget = -1;
+            setJobRunning(false);
+            statusBar()->clearMessage();
+
+            QImage result = watcher->result();
+            if (!result.isNull())
+              finish(result);
+          });
+  QFuture<QImage> future = QtConcurrent::run([job, work]() {
+    JobContext::Scope scope(job.get());
+    return work();
+  });
+  jobFutures.erase(std::remove_if(jobFutures.begin(), jobFutures.end(),
+                                  [](const QFuture<QImage> &f) {
+                                    return f.isFinished();
+                                  }),
+                   jobFutures.end());
+  jobFutures.append(future);
+  watcher->setFuture(future);
+
+  setJobRunning(true);
+  statusBar()->showMessage(tr("%1...").arg(status));
+}
+
+void MainWindow::cancelActiveJob() {
+  if (!activeJob)
+    return;
+  activeJob->cancel();
+  activeJob.reset();
+  historyTarget = -1;
+  ++jobGeneration;
+  setJobRunning(false);
+  statusBar()->showMessage(tr("Cancelled"), 2000);
+}
+
+void MainWindow::setJobRunning(bool running) {
+  if (running) {
+    jobTimer.start();
+    jobProgress->setValue(0);
+    jobProgress->setFormat(tr("%p%"));
+  }
+  jobProgress->setVisible(running);
+  cancelButton->setVisible(running);
+}
+
+void MainWindow::updateJobProgress(double fraction) {
+  jobProgress->setValue(int(fraction * jobProgress->maximum()));
+
+  // Wait for a few percent before extrapolating, the first rows are noisy.
+  if (fraction < 0.02) {
+    jobProgress->setFormat(tr("%p%"));
+    return;
+  }
+  qint64 elapsed = jobTimer.elapsed();
+  qint64 remaining = qint64(elapsed * (1.0 - fraction) / fraction) / 1000;
+  jobProgress->setFormat(tr("%p% - ETA %1:%2")
+                             .arg(remaining / 60)
+                             .arg(remaining % 60, 2, 10, QLatin1Char('0')));
+}
+
+void MainWindow::updateHistoryActions() {
+  undoAction->setEnabled(history.canUndo());
+  redoAction->setEnabled(history.canRedo());
+  undoAction->setText(history.canUndo()
+                          ? tr("Undo %1").arg(history.undoLabel())
+                          : tr("Undo"));
+  redoAction->setText(history.canRedo()
+                          ? tr("Redo %1").arg(history.redoLabel())
+                          : tr("Redo"));
+}
+
+QVector<Operations::Operation> MainWindow::recordedMacro() const {
+  QVector<Operations::Operation> ops;
+  for (int i = 0; i < history.currentStep() && i < recordedSteps.size(); ++i) {
+    if (recordedSteps[i].reset)
+      ops.clear();
+    ops += recordedSteps[i].operations;
+  }
+  return ops;
+}
+
+void MainWindow::saveMacro() {
+  QVector<Operations::Operation> ops = recordedMacro();
+  if (ops.isEmpty()) {
+    QMessageBox::warning(this, tr("Warning"),
+                         tr("No operations have been applied yet."));
+    return;
+  }
+  QString fileName = QFileDialog::getSaveFileName(
+      this, tr("Save Macro"), "", tr("Macro (*.json)"));
+  if (fileName.isEmpty())
+    return;
+  QString error;
+  if (!Operations::saveMacro(fileName, ops, &error))
+    QMessageBox::critical(this, tr("Error"), error);
+  else
+    statusBar()->showMessage(tr("Saved a macro of %n operation(s)", "",
+                                ops.size()),
+                             3000);
+}
+
+void MainWindow::replayMacro() {
+  if (filteredImage.isNull()) {
+    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
+    return;
+  }
+  QString fileName = QFileDialog::getOpenFileName(
+      this, tr("Replay Macro"), "", tr("Macro (*.json)"));
+  if (fileName.isEmpty())
+    return;
+  QVector<Operations::Operation> ops;
+  QString error;
+  if (!Operations::loadMacro(fileName, ops, &error)) {
+    QMessageBox::critical(this, tr("Error"), error);
+    return;
+  }
+  applyOperation(tr("Macro %1").arg(QFileInfo(fileName).completeBaseName()),
+                 ops);
+}
+
+void MainWindow::replayMacroOnFolder() {
+  QString macroName = QFileDialog::getOpenFileName(
+      this, tr("Replay Macro on Folder"), "", tr("Macro (*.json)"));
+  if (macroName.isEmpty())
+    return;
+  QVector<Operations::Operation> ops;
+  QString error;
+  if (!Operations::loadMacro(macroName, ops, &error)) {
+    QMessageBox::critical(this, tr("Error"), error);
+    return;
+  }
+  QString inputDir =
+      QFileDialog::getExistingDirectory(this, tr("Input Folder"));
+  if (inputDir.isEmpty())
+    return;
+  QString outputDir =
+      QFileDialog::getExistingDirectory(this, tr("Output Folder"));
+  if (outputDir.isEmpty())
+    return;
+  if (QDir(inputDir) == QDir(outputDir)) {
+    QMessageBox::warning(this, tr("Warning"),
+                         tr("The output folder must differ from the input "
+                            "folder."));
+    return;
+  }
+
+  QStringList files;
+  QDir dir(inputDir);
+  const QStringList names = dir.entryList(
+      {"*.png", "*.jpg", "*.jpeg", "*.bmp", "*.rawimg"}, QDir::Files,
+      QDir::Name);
+  for (const QString &name : names)
+    files.append(dir.filePath(name));
+  if (files.isEmpty()) {
+    QMessageBox::warning(this, tr("Warning"),
+                         tr("The folder contains no images."));
+    return;
+  }
+
+  // Each image is an independent task on the global thread pool. The
+  // filters inside run serially or in parallel depending on their size,
+  // sharing the cores with the other tasks instead of each using all.
+  const int tasks = std::max(
+      1, std::min(int(files.size()),
+                  QThreadPool::globalInstance()->maxThreadCount()));
+  const int budget = std::max(1, Parallel::maxThreads() / tasks);
+  auto process = [ops, outputDir, budget](const QString &path) {
+    Parallel::ThreadBudget threads(budget);
+    QImage image = loadImageFile(path);
+    QImage result =
+        image.isNull() ? QImage() : Operations::applyAll(image, ops);
+    QString target = QDir(outputDir).filePath(QFileInfo(path).fileName());
+    return !result.isNull() && saveImageFile(result, target);
+  };
+
+  auto *progress = new QProgressDialog(tr("Replaying macro..."), tr("Cancel"),
+                                       0, int(files.size()), this);
+  progress->setWindowModality(Qt::WindowModal);
+  progress->setAttribute(Qt::WA_DeleteOnClose);
+  auto *watcher = new QFutureWatcher<bool>(this);
+  connect(watcher, &QFutureWatcher<bool>::progressValueChanged, progress,
+          &QProgressDialog::setValue);
+  connect(progress, &QProgressDialog::canceled, watcher,
+          &QFutureWatcher<bool>::cancel);
+  connect(watcher, &QFutureWatcher<bool>::finished, this,
+          [this, watcher, progress]() {
+            watcher->deleteLater();
+            progress->close();
+            if (watcher->isCanceled()) {
+              statusBar()->showMessage(tr("Cancelled"), 2000);
+              return;
+            }
+            const QList<bool> results = watcher->future().results();
+            int failed = int(results.count(false));
+            if (failed > 0)
+              QMessageBox::warning(this, tr("Warning"),
+                                   tr("%1 of %2 images could not be "
+                                      "processed.")
+                                       .arg(failed)
+                                       .arg(results.size()));
+            else
+              statusBar()->showMessage(
+                  tr("Processed %n image(s)", "", int(results.size())),
+                  3000);
+          });
+  watcher->setFuture(QtConcurrent::mapped(files, process));
+  progress->show();
+}
+
 void MainWindow::onDockFunctionApplied(const QVector<int> &lut) {
   if (filteredImage.isNull()) {
     QMessageBox::warning(this, "Warning", "No image to apply function to.");
     return;
   }
 
-  QImage result = filteredImage.convertToFormat(QImage::Format_RGB32);
-  for (int y = 0; y < result.height(); ++y) {
-    for (int x = 0; x < result.width(); ++x) {
-      QRgb pixel = result.pixel(x, y);
-      int r = lut[qRed(pixel)];
-      int g = lut[qGreen(pixel)];
-      int b = lut[qBlue(pixel)];
-      result.setPixel(x, y, qRgb(r, g, b));
-    }
-  }
-  filteredImage = result;
-  displayImages();
+  QJsonArray values;
+  for (int v : lut)
+    values.append(v);
+  applyOperation(tr("Functional Filter"),
+                 {makeOperation("lut", {{"lut", values}})});
 }
 
 void MainWindow::onApplyConvolutionFilter() {
@@ -229,55 +645,77 @@ void MainWindow::onApplyConvolutionFilter() {
   int offset = convEditor->getOffset();
   QPair<int, int> anchor = convEditor->getAnchor();
 
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
+  QJsonArray rows;
+  for (const QVector<int> &row : kernel) {
+    QJsonArray values;
+    for (int v : row)
+      values.append(v);
+    rows.append(values);
   }
+  QJsonObject params{{"kernel", rows},
+                     {"divisor", divisor},
+                     {"offset", offset},
+                     {"anchorX", anchor.first},
+                     {"anchorY", anchor.second}};
+  applyOperation(tr("Convolution"), {makeOperation("conv", params)});
+}
 
-  filteredImage = Filters::applyConvolution(
-      filteredImage, kernel, divisor, offset, anchor.first, anchor.second);
-  displayImages();
+Operations::Operation
+MainWindow::makePaletteOperation(const QString &type,
+                                 QJsonObject params) const {
+  if (dqWidget->indexedOutput())
+    params["indexed"] = true;
+  return makeOperation(type, params);
 }
 
 void MainWindow::onApplyOrderedDithering(int thresholdMapSize,
                                          int levelsPerChannel) {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = DitheringAndQuantization::applyOrderedDithering(
-      filteredImage, thresholdMapSize, levelsPerChannel);
-  displayImages();
+  applyOperation(tr("Ordered Dithering"),
+                 {makePaletteOperation("dither",
+                                       {{"mapSize", thresholdMapSize},
+                                        {"levels", levelsPerChannel}})});
+}
+
+void MainWindow::onApplyBlueNoiseDithering(int levelsPerChannel) {
+  applyOperation(tr("Blue-Noise Dithering"),
+                 {makePaletteOperation("dither-bluenoise",
+                                       {{"levels", levelsPerChannel}})});
 }
 
 void MainWindow::onApplyOrderedDitheringYCbCr(int thresholdMapSize,
                                               int levelsPerChannel) {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = DitheringAndQuantization::applyOrderedDitheringInYCbCr(
-      filteredImage, thresholdMapSize, levelsPerChannel);
-  displayImages();
+  applyOperation(tr("Ordered Dithering in YCbCr"),
+                 {makeOperation("dither-ycbcr",
+                                {{"mapSize", thresholdMapSize},
+                                 {"levels", levelsPerChannel}})});
+}
+
+void MainWindow::onApplyErrorDiffusion(const QString &kernel,
+                                       int levelsPerChannel, bool serpentine) {
+  QJsonObject params{{"kernel", kernel}, {"levels", levelsPerChannel}};
+  if (serpentine)
+    params["serpentine"] = true;
+  applyOperation(tr("Error Diffusion"),
+                 {makePaletteOperation("diffuse", params)});
 }
 
 void MainWindow::onApplyPopularityQuantization(int numColors) {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = DitheringAndQuantization::applyPopularityQuantization(
-      filteredImage, numColors);
-  displayImages();
+  applyOperation(tr("Popularity Quantization"),
+                 {makePaletteOperation("popularity", {{"colors", numColors}})});
+}
+
+void MainWindow::onApplyMedianCutQuantization(int numColors) {
+  applyOperation(tr("Median Cut Quantization"),
+                 {makePaletteOperation("mediancut", {{"colors", numColors}})});
+}
+
+void MainWindow::onApplyOctreeQuantization(int numColors) {
+  applyOperation(tr("Octree Quantization"),
+                 {makePaletteOperation("octree", {{"colors", numColors}})});
 }
 
 void MainWindow::on_btnInvert_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = Filters::invert(filteredImage);
-  displayImages();
+  applyOperation(tr("Invert"), {makeOperation("invert")});
 }
 
 void MainWindow::on_btnGenerateInvert_clicked() {
@@ -285,15 +723,9 @@ void MainWindow::on_btnGenerateInvert_clicked() {
 }
 
 void MainWindow::on_btnBrightness_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-
-  filteredImage =
-      Filters::adjustBrightness(filteredImage, ui->sliderBrightness->value());
-
-  displayImages();
+  int delta = ui->sliderBrightness->value();
+  applyOperation(tr("Brightness"),
+                 {makeOperation("brightness", {{"delta", delta}})});
 }
 
 void MainWindow::on_btnGenerateBrightness_clicked() {
@@ -302,15 +734,9 @@ void MainWindow::on_btnGenerateBrightness_clicked() {
 }
 
 void MainWindow::on_btnContrast_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-
-  filteredImage = Filters::adjustContrast(filteredImage,
-                                          ui->sliderContrast->value() / 100.0);
-
-  displayImages();
+  double factor = ui->sliderContrast->value() / 100.0;
+  applyOperation(tr("Contrast"),
+                 {makeOperation("contrast", {{"factor", factor}})});
 }
 
 void MainWindow::on_btnGenerateContrast_clicked() {
@@ -319,60 +745,54 @@ void MainWindow::on_btnGenerateContrast_clicked() {
 }
 
 void MainWindow::on_btnGamma_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-
-  filteredImage =
-      Filters::adjustGamma(filteredImage, ui->sliderGamma->value() / 100.0);
-
-  displayImages();
+  double gamma = ui->sliderGamma->value() / 100.0;
+  applyOperation(tr("Gamma"), {makeOperation("gamma", {{"gamma", gamma}})});
 }
 
 void MainWindow::on_btnBlur_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = Filters::blur3x3(filteredImage);
-  displayImages();
+  applyOperation(tr("Blur"), {makeOperation("blur")});
 }
 
 void MainWindow::on_btnGauss_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = Filters::gaussianBlur3x3(filteredImage);
-  displayImages();
+  applyOperation(tr("Gaussian Blur"), {makeOperation("gauss")});
 }
 
 void MainWindow::on_btnSharpen_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = Filters::sharpen3x3(filteredImage);
-  displayImages();
+  applyOperation(tr("Sharpen"), {makeOperation("sharpen")});
 }
 
 void MainWindow::on_btnEdge_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-  filteredImage = Filters::edgeDetect3x3(filteredImage);
-  displayImages();
+  applyOperation(tr("Edge Detection"), {makeOperation("edge")});
 }
 
 void MainWindow::on_btnEmboss_clicked() {
+  applyOperation(tr("Emboss"), {makeOperation("emboss")});
+}
+
+void MainWindow::onEqualizeHistogram(Filters::HistogramMode mode) {
+  QString name = mode == Filters::HistogramMode::PerChannel ? "rgb" : "luma";
+  applyOperation(tr("Histogram Equalization"),
+                 {makeOperation("equalize", {{"mode", name}})});
+}
+
+void MainWindow::onApplyCLAHE() {
   if (filteredImage.isNull()) {
     QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
     return;
   }
-  filteredImage = Filters::emboss3x3(filteredImage);
-  displayImages();
+  bool ok = false;
+  int tiles = QInputDialog::getInt(this, tr("CLAHE"), tr("Tiles per side:"),
+                                   8, 1, 64, 1, &ok);
+  if (!ok)
+    return;
+  double clipLimit = QInputDialog::getDouble(
+      this, tr("CLAHE"), tr("Clip limit:"), 2.0, 1.0, 64.0, 1, &ok);
+  if (!ok)
+    return;
+  applyOperation(tr("CLAHE"),
+                 {makeOperation("clahe", {{"tiles", tiles},
+                                          {"clipLimit", clipLimit},
+                                          {"mode", "luma"}})});
 }
 
 void MainWindow::on_btnMedian_clicked() {
@@ -381,6 +801,9 @@ void MainWindow::on_btnMedian_clicked() {
     return;
   }
 
+  // The conversion is folded into the same job, so that it cannot be
+  // superseded by the median itself.
+  bool toGray = false;
   if (filteredImage.format() != QImage::Format_Grayscale8) {
     int ret =
         QMessageBox::question(this, tr("Convert to Grayscale?"),
@@ -388,46 +811,28 @@ void MainWindow::on_btnMedian_clicked() {
                                  "like to convert it to grayscale first?"),
                               QMessageBox::Yes | QMessageBox::No);
     if (ret == QMessageBox::Yes) {
-      filteredImage = filteredImage.convertToFormat(QImage::Format_Grayscale8);
+      toGray = true;
     } else {
       return;
     }
   }
 
-  filteredImage = Filters::applyMedianFilter(filteredImage, 3);
-  displayImages();
+  QVector<Operations::Operation> ops;
+  if (toGray)
+    ops.append(makeOperation("gray"));
+  ops.append(makeOperation("median", {{"size", 3}}));
+  applyOperation(tr("Median"), ops);
 }
 
 void MainWindow::on_btnErosion_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-
-  filteredImage = Filters::applyErosionFilter(filteredImage, 3);
-  displayImages();
+  applyOperation(tr("Erosion"), {makeOperation("erode", {{"size", 3}})});
 }
 
 void MainWindow::on_btnDilation_clicked() {
-  if (filteredImage.isNull()) {
-    QMessageBox::warning(this, tr("Warning"), tr("No image to filter."));
-    return;
-  }
-
-  filteredImage = Filters::applyDilationFilter(filteredImage, 3);
-  displayImages();
+  applyOperation(tr("Dilation"), {makeOperation("dilate", {{"size", 3}})});
 }
 
 void MainWindow::displayImages() {
-  if (!originalImage.isNull()) {
-    ui->labelOriginal->setPixmap(QPixmap::fromImage(originalImage));
-  }
-  if (!filteredImage.isNull()) {
-    ui->labelFiltered->setPixmap(QPixmap::fromImage(filteredImage));
-  }
-}
-
-void MainWindow::resizeEvent(QResizeEvent *event) {
-  QMainWindow::resizeEvent(event);
-  displayImages();
+  ui->viewOriginal->setImage(originalImage);
+  ui->viewFiltered->setImage(filteredImage);
 }
@@ -4,13 +4,24 @@
 #include "ConvolutionEditorWidget.h"
 #include "DitheringAndQuantizationWidget.h"
 #include "FunctionalEditorDock.h"
+#include "PerformanceDock.h"
 #include "drawingwidget.h"
+#include "filters.h"
 #include "cubewidget.h"
 #include "cylinderwidget.h"
+#include "imagehistory.h"
+#include "jobcontext.h"
+#include "operations.h"
 #include <QImage>
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMainWindow>
+#include <QProgressBar>
+#include <QPushButton>
 #include <QStackedWidget>
 #include <QTabWidget>
+#include <functional>
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -25,9 +36,6 @@ public:
   MainWindow(QWidget *parent = nullptr);
   ~MainWindow();
 
-protected:
-  void resizeEvent(QResizeEvent *event) override;
-
 signals:
   void imageLoaded();
 
@@ -37,6 +45,9 @@ private slots:
   void on_btnSave_clicked();
   void on_btnReset_clicked();
   void on_btnGray_clicked();
+  void undo();
+  void redo();
+  void cancelActiveJob();
 
   // Filter actions
   void on_btnInvert_clicked();
@@ -58,8 +69,20 @@ private slots:
   void onDockFunctionApplied(const QVector<int> &lut);
   void onApplyConvolutionFilter();
   void onApplyOrderedDithering(int thresholdMapSize, int levelsPerChannel);
+  void onApplyBlueNoiseDithering(int levelsPerChannel);
   void onApplyOrderedDitheringYCbCr(int thresholdMapSize, int levelsPerChannel);
+  void onApplyErrorDiffusion(const QString &kernel, int levelsPerChannel,
+                             bool serpentine);
   void onApplyPopularityQuantization(int numColors);
+  void onApplyMedianCutQuantization(int numColors);
+  void onApplyOctreeQuantization(int numColors);
+  void onEqualizeHistogram(Filters::HistogramMode mode);
+  void onApplyCLAHE();
+
+  // Macro recording and replay
+  void saveMacro();
+  void replayMacro();
+  void replayMacroOnFolder();
 
   // Mode switching actions
   void switchToFilterMode();
@@ -71,15 +94,45 @@ private slots:
   void loadTexture();
 
 private:
+  /** @brief Above this many pixels, loading asks first (see Streaming). */
+  static constexpr qint64 LargeImagePixels = qint64(1) << 28;
+
+  /**
+   * @brief The operations recorded for one history step. A reset step
+   * restarts the macro from the original image.
+   */
+  struct RecordedStep {
+    QVector<Operations::Operation> operations;
+    bool reset = false;
+  };
+
   Ui::MainWindow *ui;
   QImage originalImage;
   QImage filteredImage;
+  ImageHistory history;
+  QVector<RecordedStep> recordedSteps; ///< Parallel to the history steps.
+  QAction *undoAction;
+  QAction *redoAction;
+
+  // Background execution of filter jobs.
+  std::shared_ptr<JobContext> activeJob; ///< Null when no job is running.
+  quint64 jobGeneration = 0; ///< Bumped whenever a job is superseded.
+  /// The history step a running undo or redo job moves to, -1 if none.
+  int historyTarget = -1;
+  /// Jobs that may still be running, superseded ones included. Their
+  /// progress callbacks post to this window, so the destructor waits for
+  /// them after cancelling.
+  QList<QFuture<QImage>> jobFutures;
+  QPushButton *cancelButton;
+  QProgressBar *jobProgress; ///< Progress and ETA of the running job.
+  QElapsedTimer jobTimer;
 
   // Existing filtering tools:
   QTabWidget *filterEditorTabs;
   FunctionalEditorDock *functionalEditor;
   ConvolutionEditorWidget *convolutionEditor;
   DitheringQuantizationWidget *dqWidget;
+  PerformanceDock *performanceDock;
 
   // New drawing widget and mode switching:
   QStackedWidget *modeStack;  // Central widget that switches modes.
@@ -89,6 +142,55 @@ private:
   CylinderWidget *cylinderPage;
 
   void displayImages();
+
+  /**
+   * @brief Runs an operation on the filtered image in a worker thread and
+   * records it in the undo history once it finishes.
+   *
+   * A job that is still running when a new one is requested is cancelled and
+   * its result discarded, so the newest request always wins.
+   *
+   * @param label Name of the operation shown in the Undo/Redo actions.
+   * @param op The operation to apply.
+   * @param recorded What the step contributes to a recorded macro.
+   */
+  void applyOperation(const QString &label, const ImageHistory::Operation &op,
+                      const RecordedStep &recorded);
+
+  /**
+   * @brief Runs work in a worker thread with progress and cancellation, and
+   * passes a non-null result to finish on the GUI thread. Supersedes the
+   * running job, if any.
+   * @param status Status bar text while the job runs.
+   */
+  void runJob(const QString &status, const std::function<QImage()> &work,
+              const std::function<void(const QImage &)> &finish);
+
+  /**
+   * @brief Undoes or redoes up to the given history step. The replay runs
+   * as a job; the history moves once it finishes.
+   */
+  void moveInHistory(int target);
+
+  /**
+   * @brief Applies a chain of operations as one step and records it for
+   * macros.
+   */
+  void applyOperation(const QString &label,
+                      const QVector<Operations::Operation> &ops);
+
+  /**
+   * @brief Builds a dithering or quantization operation, indexed if the
+   * dock asks for indexed output.
+   */
+  Operations::Operation makePaletteOperation(const QString &type,
+                                             QJsonObject params) const;
+
+  /** @brief The operations that lead from the original to the current image. */
+  QVector<Operations::Operation> recordedMacro() const;
+  void updateHistoryActions();
+  void updateJobProgress(double fraction);
+  void setJobRunning(bool running);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,173 @@
+#include "nearestcolor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+inline int distance(const int *c, const std::array<int, 3> &p) {
+  const int dr = c[0] - p[0], dg = c[1] - p[1], db = c[2] - p[2];
+  return dr * dr + dg * dg + db * db;
+}
+} // namespace
+
+struct NearestColorLookup::Cell {
+  bool useTree = false;
+  std::vector<int> candidates; ///< Palette indices in ascending order.
+};
+
+NearestColorLookup::NearestColorLookup(const QVector<QRgb> &palette)
+    : colors(palette), cells(new std::atomic<const Cell *>[CellCount]) {
+  for (int key = 0; key < CellCount; ++key)
+    cells[key].store(nullptr, std::memory_order_relaxed);
+
+  channels.reserve(colors.size());
+  for (QRgb color : colors)
+    channels.push_back({qRed(color), qGreen(color), qBlue(color)});
+
+  std::vector<int> indices(colors.size());
+  for (int i = 0; i < int(indices.size()); ++i)
+    indices[i] = i;
+  nodes.reserve(indices.size());
+  root = buildTree(indices, 0, int(indices.size()));
+}
+
+NearestColorLookup::~NearestColorLookup() {
+  for (int key = 0; key < CellCount; ++key)
+    delete cells[key].load(std::memory_order_relaxed);
+}
+
+int NearestColorLookup::buildTree(std::vector<int> &indices, int begin,
+                                  int end) {
+  if (begin >= end)
+    return -1;
+
+  // Split on the channel with the largest spread, at the median.
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  for (int i = begin; i < end; ++i) {
+    for (int a = 0; a < 3; ++a) {
+      lo[a] = std::min(lo[a], channels[indices[i]][a]);
+      hi[a] = std::max(hi[a], channels[indices[i]][a]);
+    }
+  }
+  int axis = 0;
+  for (int a = 1; a < 3; ++a)
+    if (hi[a] - lo[a] > hi[axis] - lo[axis])
+      axis = a;
+
+  const int mid = (begin + end) / 2;
+  std::nth_element(indices.begin() + begin, indices.begin() + mid,
+                   indices.begin() + end, [&](int a, int b) {
+                     return channels[a][axis] != channels[b][axis]
+                                ? channels[a][axis] < channels[b][axis]
+                                : a < b;
+                   });
+
+  const int node = int(nodes.size());
+  nodes.push_back({indices[mid], axis, -1, -1});
+  const int left = buildTree(indices, begin, mid);
+  const int right = buildTree(indices, mid + 1, end);
+  nodes[node].left = left;
+  nodes[node].right = right;
+  return node;
+}
+
+void NearestColorLookup::searchTree(int n, const int *c, int &best,
+                                    int &bestDist) const {
+  const Node &node = nodes[n];
+  const std::array<int, 3> &p = channels[node.index];
+  const int d = distance(c, p);
+  if (d < bestDist || (d == bestDist && node.index < best)) {
+    best = node.index;
+    bestDist = d;
+  }
+
+  // The far side can only hold colors at least diff away; equal distances
+  // are still visited, since a lower index there wins the tie.
+  const int diff = c[node.axis] - p[node.axis];
+  const int nearSide = diff < 0 ? node.left : node.right;
+  const int farSide = diff < 0 ? node.right : node.left;
+  if (nearSide >= 0)
+    searchTree(nearSide, c, best, bestDist);
+  if (farSide >= 0 && diff * diff <= bestDist)
+    searchTree(farSide, c, best, bestDist);
+}
+
+const NearestColorLookup::Cell *NearestColorLookup::fillCell(int key) const {
+  constexpr int CellSize = 1 << (8 - CellBits);
+  const int lo[3] = {(key >> (2 * CellBits)) * CellSize,
+                     ((key >> CellBits) & ((1 << CellBits) - 1)) * CellSize,
+                     (key & ((1 << CellBits) - 1)) * CellSize};
+
+  // Every color in the cell has a palette color within the smallest
+  // farthest-corner distance of any palette color, so only palette colors
+  // whose box distance is within that bound can be nearest.
+  int bound = INT_MAX;
+  for (const std::array<int, 3> &p : channels) {
+    int far = 0;
+    for (int a = 0; a < 3; ++a) {
+      int d = std::max(std::abs(p[a] - lo[a]),
+                       std::abs(p[a] - (lo[a] + CellSize - 1)));
+      far += d * d;
+    }
+    bound = std::min(bound, far);
+  }
+
+  auto *cell = new Cell;
+  for (int i = 0; i < int(channels.size()); ++i) {
+    int near = 0;
+    for (int a = 0; a < 3; ++a) {
+      int v = channels[i][a];
+      int d = v < lo[a] ? lo[a] - v : std::max(0, v - (lo[a] + CellSize - 1));
+      near += d * d;
+    }
+    if (near <= bound)
+      cell->candidates.push_back(i);
+  }
+  if (int(cell->candidates.size()) > MaxCellCandidates) {
+    cell->useTree = true;
+    cell->candidates.clear();
+    cell->candidates.shrink_to_fit();
+  }
+
+  const Cell *expected = nullptr;
+  if (!cells[key].compare_exchange_strong(expected, cell,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+    delete cell; // Another thread filled it first, with the same list.
+    return expected;
+  }
+  return cell;
+}
+
+int NearestColorLookup::nearestIndex(QRgb color) const {
+  if (colors.isEmpty())
+    return -1;
+  const int c[3] = {qRed(color), qGreen(color), qBlue(color)};
+  constexpr int Shift = 8 - CellBits;
+  const int key = ((c[0] >> Shift) << (2 * CellBits)) |
+                  ((c[1] >> Shift) << CellBits) | (c[2] >> Shift);
+  const Cell *cell = cells[key].load(std::memory_order_acquire);
+  if (!cell)
+    cell = fillCell(key);
+
+  int best = -1, bestDist = INT_MAX;
+  if (cell->useTree) {
+    searchTree(root, c, best, bestDist);
+    return best;
+  }
+  // Candidates are in palette order, so the first of equal distances wins.
+  const std::vector<int> &candidates = cell->candidates;
+  best = candidates[0];
+  if (candidates.size() == 1)
+    return best;
+  bestDist = distance(c, channels[best]);
+  for (size_t i = 1; i < candidates.size(); ++i) {
+    int d = distance(c, channels[candidates[i]]);
+    if (d < bestDist) {
+      bestDist = d;
+      best = candidates[i];
+    }
+  }
+  return best;
+}
@@ -0,0 +1,81 @@
+#ifndef NEARESTCOLOR_H
+#define NEARESTCOLOR_H
+
+#include <QRgb>
+#include <QVector>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The NearestColorLookup class
+ *
+ * Finds the palette color nearest to a given color, by Euclidean distance
+ * in RGB, with the same result as an exhaustive search over the palette:
+ * when several palette colors are equally near, the one with the lowest
+ * index wins.
+ *
+ * Two structures answer the queries:
+ * - An inverse colormap of 32×32×32 cells, keyed by the top 5 bits of each
+ *   channel. A cell lists, in palette order, only the palette colors that
+ *   can be nearest to some color inside it, usually a handful; a cell with a
+ *   single candidate answers without computing any distance. Cells are
+ *   filled lazily on first use, so images with few distinct colors only pay
+ *   for the cells they touch.
+ * - A k-d tree over the palette, used for cells whose candidate list stays
+ *   long (colors far from a dense palette).
+ *
+ * Lookups are thread-safe: cells are published atomically, and two threads
+ * racing to fill the same cell compute identical lists, one of which is
+ * dropped.
+ */
+class NearestColorLookup {
+public:
+  /**
+   * @brief Prepares lookups into a palette. Alpha is ignored.
+   * @param palette The palette colors; should not be empty.
+   */
+  explicit NearestColorLookup(const QVector<QRgb> &palette);
+  ~NearestColorLookup();
+
+  NearestColorLookup(const NearestColorLookup &) = delete;
+  NearestColorLookup &operator=(const NearestColorLookup &) = delete;
+
+  /**
+   * @brief Returns the index of the palette color nearest to color, or -1
+   * if the palette is empty.
+   */
+  int nearestIndex(QRgb color) const;
+
+  /** @brief Returns the palette color nearest to color. */
+  QRgb nearest(QRgb color) const { return colors[nearestIndex(color)]; }
+
+  const QVector<QRgb> &palette() const { return colors; }
+
+private:
+  struct Cell;
+  struct Node {
+    int index; ///< Palette index of the splitting color.
+    int axis;  ///< 0 = red, 1 = green, 2 = blue.
+    int left;  ///< Node index of the lower half, -1 if none.
+    int right; ///< Node index of the upper half, -1 if none.
+  };
+
+  /* Candidate lists longer than this are searched in the tree instead. */
+  static constexpr int MaxCellCandidates = 24;
+  static constexpr int CellBits = 5;
+  static constexpr int CellCount = 1 << (3 * CellBits);
+
+  int buildTree(std::vector<int> &indices, int begin, int end);
+  void searchTree(int node, const int *c, int &best, int &bestDist) const;
+  const Cell *fillCell(int key) const;
+
+  QVector<QRgb> colors;
+  std::vector<std::array<int, 3>> channels; ///< Palette as r, g, b.
+  std::vector<Node> nodes;
+  int root = -1;
+  mutable std::unique_ptr<std::atomic<const Cell *>[]> cells;
+};
+
+#endif // NEARESTCOLOR_H
@@ -0,0 +1,605 @@
+#include "operations.h"
+#include "ditheringandquantization.h"
+#include "filters.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+namespace {
+struct TypeInfo {
+  const char *name;
+  bool takesArgument;
+};
+
+const TypeInfo kTypes[] = {
+    {"invert", false},      {"gray", false},       {"brightness", true},
+    {"contrast", true},     {"gamma", true},       {"blur", false},
+    {"gauss", false},       {"sharpen", false},    {"edge", false},
+    {"emboss", false},      {"conv", true},        {"median", true},
+    {"erode", true},        {"dilate", true},      {"dither", true},
+    {"dither-ycbcr", true}, {"dither-bluenoise", true},
+    {"diffuse", true},      {"popularity", true},  {"mediancut", true},
+    {"octree", true},       {"kmeans", true},      {"equalize", true},
+    {"clahe", true},        {"lut", true},
+};
+
+/* Upper bound of "colors": an image cannot have more distinct colors, and
+ * the quantizers allocate per-color tables of this size. */
+constexpr int MaxColors = 1 << 24;
+/* Bounds of "levels" per channel; the dithers allocate a table per level. */
+constexpr int MinLevels = 2;
+constexpr int MaxLevels = 256;
+/* Upper bound of the CLAHE "tiles" per side, as in the application. Each
+ * tile has its own lookup tables. */
+constexpr int MaxTiles = 64;
+/* Upper bound of the neighborhood "size" of median, erode and dilate; the
+ * cost per pixel grows with its square. */
+constexpr int MaxKernelSize = 31;
+
+/* Operations that reduce the image to a palette, and so take "indexed". */
+const char *const kPaletteTypes[] = {
+    "dither",    "dither-bluenoise", "diffuse", "popularity",
+    "mediancut", "octree",           "kmeans",
+};
+
+/* Names of the error diffusion kernels in "diffuse" parameters. */
+const struct {
+  const char *name;
+  DitheringAndQuantization::DiffusionKernel kernel;
+} kDiffusionKernels[] = {
+    {"fs", DitheringAndQuantization::DiffusionKernel::FloydSteinberg},
+    {"jjn", DitheringAndQuantization::DiffusionKernel::JarvisJudiceNinke},
+    {"stucki", DitheringAndQuantization::DiffusionKernel::Stucki},
+    {"atkinson", DitheringAndQuantization::DiffusionKernel::Atkinson},
+};
+
+bool findDiffusionKernel(const QString &name,
+                         DitheringAndQuantization::DiffusionKernel *kernel) {
+  for (const auto &entry : kDiffusionKernels) {
+    if (name == QLatin1String(entry.name)) {
+      if (kernel)
+        *kernel = entry.kernel;
+      return true;
+    }
+  }
+  return false;
+}
+
+const TypeInfo *findType(const QString &type) {
+  for (const TypeInfo &info : kTypes) {
+    if (type == QLatin1String(info.name))
+      return &info;
+  }
+  return nullptr;
+}
+
+bool fail(QString *error, const QString &message) {
+  if (error)
+    *error = message;
+  return false;
+}
+
+/* Parses "N:L" into two positive integers. */
+bool parsePair(const QString &text, int &first, int &second) {
+  QStringList parts = text.split(':');
+  if (parts.size() != 2)
+    return false;
+  bool ok1 = false, ok2 = false;
+  first = parts[0].toInt(&ok1);
+  second = parts[1].toInt(&ok2);
+  return ok1 && ok2 && first > 0 && second > 0;
+}
+
+/* Reads a kernel file (see Operations::fromOption) into JSON parameters. */
+bool readKernelFile(const QString &path, QJsonObject &params, QString *error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    return fail(error, QStringLiteral("cannot open kernel file %1").arg(path));
+
+  QVector<QVector<int>> kernel;
+  bool hasDivisor = false;
+  int divisor = 1, offset = 0, anchorX = -1, anchorY = -1;
+
+  QTextStream in(&file);
+  while (!in.atEnd()) {
+    QString line = in.readLine().trimmed();
+    if (line.isEmpty() || line.startsWith('#'))
+      continue;
+    QStringList words = line.split(' ', Qt::SkipEmptyParts);
+    if (words[0] == QLatin1String("divisor") && words.size() == 2) {
+      divisor = words[1].toInt();
+      hasDivisor = true;
+    } else if (words[0] == QLatin1String("offset") && words.size() == 2) {
+      offset = words[1].toInt();
+    } else if (words[0] == QLatin1String("anchor") && words.size() == 3) {
+      anchorX = words[1].toInt();
+      anchorY = words[2].toInt();
+    } else {
+      QVector<int> row;
+      for (const QString &word : words) {
+        bool ok = false;
+        row.append(word.toInt(&ok));
+        if (!ok)
+          return fail(error,
+                      QStringLiteral("invalid kernel value '%1'").arg(word));
+      }
+      if (!kernel.isEmpty() && row.size() != kernel[0].size())
+        return fail(error, QStringLiteral("kernel rows differ in length"));
+      kernel.append(row);
+    }
+  }
+  if (kernel.isEmpty())
+    return fail(error, QStringLiteral("kernel file %1 is empty").arg(path));
+
+  QJsonArray rows;
+  int sum = 0;
+  for (const QVector<int> &row : kernel) {
+    QJsonArray values;
+    for (int v : row) {
+      values.append(v);
+      sum += v;
+    }
+    rows.append(values);
+  }
+  if (!hasDivisor)
+    divisor = sum != 0 ? sum : 1;
+
+  params["kernel"] = rows;
+  params["divisor"] = divisor;
+  params["offset"] = offset;
+  params["anchorX"] = anchorX >= 0 ? anchorX : int(kernel[0].size()) / 2;
+  params["anchorY"] = anchorY >= 0 ? anchorY : int(kernel.size()) / 2;
+  return true;
+}
+
+/* Reads a LUT file of 256 whitespace-separated values into parameters. */
+bool readLutFile(const QString &path, QJsonObject &params, QString *error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    return fail(error, QStringLiteral("cannot open LUT file %1").arg(path));
+  QJsonArray values;
+  QTextStream in(&file);
+  while (!in.atEnd()) {
+    QString word;
+    in >> word;
+    if (word.isEmpty())
+      continue;
+    bool ok = false;
+    int v = word.toInt(&ok);
+    if (!ok || v < 0 || v > 255)
+      return fail(error, QStringLiteral("invalid LUT value '%1'").arg(word));
+    values.append(v);
+  }
+  if (values.size() != 256)
+    return fail(error, QStringLiteral("LUT file %1 has %2 values, not 256")
+                           .arg(path)
+                           .arg(values.size()));
+  params["lut"] = values;
+  return true;
+}
+
+/* Checks that the parameters are complete and in range, so that operations
+ * read from a macro file cannot crash the filters. */
+bool validate(const Operations::Operation &op, QString *error) {
+  const QJsonObject &p = op.params;
+  const QString &t = op.type;
+  auto number = [&](const char *key) { return p[key].isDouble(); };
+  auto positive = [&](const char *key) {
+    return number(key) && p[key].toInt() > 0;
+  };
+  auto inRange = [&](const char *key, int lo, int hi) {
+    return number(key) && p[key].toInt() >= lo && p[key].toInt() <= hi;
+  };
+  auto colors = [&]() { return inRange("colors", 1, MaxColors); };
+  auto levels = [&]() { return inRange("levels", MinLevels, MaxLevels); };
+  const QString mode = p["mode"].toString();
+  const bool knownMode =
+      mode == QLatin1String("luma") || mode == QLatin1String("rgb");
+  bool ok = true;
+
+  if (t == QLatin1String("brightness")) {
+    ok = number("delta");
+  } else if (t == QLatin1String("contrast")) {
+    ok = number("factor");
+  } else if (t == QLatin1String("gamma")) {
+    ok = number("gamma") && p["gamma"].toDouble() > 0;
+  } else if (t == QLatin1String("conv")) {
+    const QJsonArray rows = p["kernel"].toArray();
+    ok = !rows.isEmpty() && number("divisor") && p["divisor"].toInt() != 0 &&
+         number("offset") && number("anchorX") && number("anchorY");
+    int width = ok ? rows.first().toArray().size() : 0;
+    for (const QJsonValue &row : rows)
+      ok = ok && width > 0 && row.toArray().size() == width;
+    ok = ok && p["anchorX"].toInt() >= 0 && p["anchorX"].toInt() < width &&
+         p["anchorY"].toInt() >= 0 && p["anchorY"].toInt() < rows.size();
+  } else if (t == QLatin1String("median") || t == QLatin1String("erode") ||
+             t == QLatin1String("dilate")) {
+    ok = inRange("size", 1, MaxKernelSize);
+  } else if (t == QLatin1String("dither") ||
+             t == QLatin1String("dither-ycbcr")) {
+    ok = number("mapSize") && levels() &&
+         DitheringAndQuantization::thresholdMapSizes().contains(
+             p["mapSize"].toInt());
+  } else if (t == QLatin1String("dither-bluenoise")) {
+    ok = levels();
+  } else if (t == QLatin1String("diffuse")) {
+    ok = findDiffusionKernel(p["kernel"].toString(), nullptr) &&
+         levels() && (!p.contains("serpentine") || p["serpentine"].isBool());
+  } else if (t == QLatin1String("popularity")) {
+    ok = colors() &&
+         (!p.contains("bits") || (positive("bits") && p["bits"].toInt() <= 8));
+  } else if (t == QLatin1String("mediancut") || t == QLatin1String("octree")) {
+    ok = colors();
+  } else if (t == QLatin1String("kmeans")) {
+    ok = colors() &&
+         (!p.contains("iterations") || positive("iterations"));
+  } else if (t == QLatin1String("equalize")) {
+    ok = knownMode;
+  } else if (t == QLatin1String("clahe")) {
+    ok = inRange("tiles", 1, MaxTiles) && number("clipLimit") &&
+         p["clipLimit"].toDouble() >= 1.0 && knownMode;
+  } else if (t == QLatin1String("lut")) {
+    const QJsonArray values = p["lut"].toArray();
+    ok = values.size() == 256;
+    for (const QJsonValue &v : values)
+      ok = ok && v.isDouble() && v.toInt() >= 0 && v.toInt() <= 255;
+  }
+
+  ok = ok && (!p.contains("indexed") ||
+              (Operations::producesPalette(t) && p["indexed"].isBool()));
+
+  if (!ok && p["colors"].toDouble() > MaxColors)
+    return fail(error, QStringLiteral("%1 takes at most %2 colors")
+                           .arg(op.type)
+                           .arg(MaxColors));
+  if (!ok)
+    return fail(error,
+                QStringLiteral("invalid parameters for %1").arg(op.type));
+  return true;
+}
+
+QVector<QVector<int>> kernelFromJson(const QJsonArray &rows) {
+  QVector<QVector<int>> kernel;
+  for (const QJsonValue &row : rows) {
+    QVector<int> values;
+    for (const QJsonValue &v : row.toArray())
+      values.append(v.toInt());
+    kernel.append(values);
+  }
+  return kernel;
+}
+} // namespace
+
+namespace Operations {
+
+QStringList types() {
+  QStringList names;
+  for (const TypeInfo &info : kTypes)
+    names.append(QLatin1String(info.name));
+  return names;
+}
+
+bool takesArgument(const QString &type) {
+  const TypeInfo *info = findType(type);
+  return info && info->takesArgument;
+}
+
+bool producesPalette(const QString &type) {
+  for (const char *name : kPaletteTypes) {
+    if (type == QLatin1String(name))
+      return true;
+  }
+  return false;
+}
+
+bool fromOption(const QString &type, const QString &argument, Operation &op,
+                QString *error) {
+  if (!findType(type))
+    return fail(error, QStringLiteral("unknown operation '%1'").arg(type));
+
+  op.type = type;
+  op.params = QJsonObject();
+  bool ok = true;
+
+  if (type == QLatin1String("brightness")) {
+    op.params["delta"] = argument.toInt(&ok);
+  } else if (type == QLatin1String("contrast")) {
+    op.params["factor"] = argument.toDouble(&ok);
+  } else if (type == QLatin1String("gamma")) {
+    double gamma = argument.toDouble(&ok);
+    ok = ok && gamma > 0;
+    op.params["gamma"] = gamma;
+  } else if (type == QLatin1String("conv")) {
+    return readKernelFile(argument, op.params, error);
+  } else if (type == QLatin1String("median") ||
+             type == QLatin1String("erode") ||
+             type == QLatin1String("dilate")) {
+    int size = argument.toInt(&ok);
+    ok = ok && size > 0 && size <= MaxKernelSize;
+    op.params["size"] = size;
+  } else if (type == QLatin1String("dither") ||
+             type == QLatin1String("dither-ycbcr")) {
+    int mapSize = 0, levels = 0;
+    ok = parsePair(argument, mapSize, levels) && levels >= MinLevels &&
+         levels <= MaxLevels &&
+         DitheringAndQuantization::thresholdMapSizes().contains(mapSize);
+    op.params["mapSize"] = mapSize;
+    op.params["levels"] = levels;
+  } else if (type == QLatin1String("dither-bluenoise")) {
+    int levels = argument.toInt(&ok);
+    ok = ok && levels >= MinLevels && levels <= MaxLevels;
+    op.params["levels"] = levels;
+  } else if (type == QLatin1String("diffuse")) {
+    // "kernel:levels" or "kernel:levels:serpentine"
+    QStringList parts = argument.split(':');
+    int levels = parts.size() >= 2 ? parts[1].toInt(&ok) : 0;
+    ok = ok && (parts.size() == 2 ||
+                (parts.size() == 3 && parts[2] == QLatin1String("serpentine")));
+    ok = ok && findDiffusionKernel(parts[0], nullptr) &&
+         levels >= MinLevels && levels <= MaxLevels;
+    op.params["kernel"] = parts[0];
+    op.params["levels"] = levels;
+    if (parts.size() == 3)
+      op.params["serpentine"] = true;
+  } else if (type == QLatin1String("popularity")) {
+    // "colors" or "colors:bits"
+    QStringList parts = argument.split(':');
+    int colors = parts[0].toInt(&ok);
+    int bits = 8;
+    if (ok && parts.size() == 2)
+      bits = parts[1].toInt(&ok);
+    ok = ok && parts.size() <= 2 && colors > 0 && colors <= MaxColors &&
+         bits > 0 && bits <= 8;
+    op.params["colors"] = colors;
+    if (bits != 8)
+      op.params["bits"] = bits;
+  } else if (type == QLatin1String("mediancut") ||
+             type == QLatin1String("octree")) {
+    int colors = argument.toInt(&ok);
+    ok = ok && colors > 0 && colors <= MaxColors;
+    op.params["colors"] = colors;
+  } else if (type == QLatin1String("kmeans")) {
+    // "colors" or "colors:iterations"
+    QStringList parts = argument.split(':');
+    int colors = parts[0].toInt(&ok);
+    int iterations = DitheringAndQuantization::KMeansOptions().maxIterations;
+    if (ok && parts.size() == 2)
+      iterations = parts[1].toInt(&ok);
+    ok = ok && parts.size() <= 2 && colors > 0 && colors <= MaxColors &&
+         iterations > 0;
+    op.params["colors"] = colors;
+    if (parts.size() == 2)
+      op.params["iterations"] = iterations;
+  } else if (type == QLatin1String("equalize")) {
+    ok = argument == QLatin1String("luma") || argument == QLatin1String("rgb");
+    op.params["mode"] = argument;
+  } else if (type == QLatin1String("lut")) {
+    return readLutFile(argument, op.params, error);
+  } else if (type == QLatin1String("clahe")) {
+    QStringList parts = argument.split(':');
+    bool ok1 = false, ok2 = parts.size() == 2;
+    int tiles = parts.value(0).toInt(&ok1);
+    double clip = ok2 ? parts[1].toDouble(&ok2) : 0.0;
+    ok = ok1 && ok2 && tiles > 0 && tiles <= MaxTiles && clip >= 1.0;
+    op.params["tiles"] = tiles;
+    op.params["clipLimit"] = clip;
+    op.params["mode"] = QStringLiteral("luma");
+  }
+
+  if (!ok)
+    return fail(error, QStringLiteral("invalid argument '%1' for %2")
+                           .arg(argument, type));
+  return true;
+}
+
+QString describe(const Operation &op) {
+  const QJsonObject &p = op.params;
+  if (op.type == QLatin1String("brightness"))
+    return QStringLiteral("brightness %1").arg(p["delta"].toInt());
+  if (op.type == QLatin1String("contrast"))
+    return QStringLiteral("contrast %1").arg(p["factor"].toDouble());
+  if (op.type == QLatin1String("gamma"))
+    return QStringLiteral("gamma %1").arg(p["gamma"].toDouble());
+  if (op.type == QLatin1String("conv"))
+    return QStringLiteral("conv %1x%2")
+        .arg(p["kernel"].toArray().first().toArray().size())
+        .arg(p["kernel"].toArray().size());
+  if (op.type == QLatin1String("median") || op.type == QLatin1String("erode") ||
+      op.type == QLatin1String("dilate"))
+    return QStringLiteral("%1 %2").arg(op.type).arg(p["size"].toInt());
+  if (op.type == QLatin1String("dither") ||
+      op.type == QLatin1String("dither-ycbcr"))
+    return QStringLiteral("%1 %2:%3")
+        .arg(op.type)
+        .arg(p["mapSize"].toInt())
+        .arg(p["levels"].toInt());
+  if (op.type == QLatin1String("dither-bluenoise"))
+    return QStringLiteral("dither-bluenoise %1").arg(p["levels"].toInt());
+  if (op.type == QLatin1String("diffuse"))
+    return QStringLiteral("diffuse %1:%2%3")
+        .arg(p["kernel"].toString())
+        .arg(p["levels"].toInt())
+        .arg(p["serpentine"].toBool() ? QStringLiteral(":serpentine")
+                                      : QString());
+  if (op.type == QLatin1String("popularity"))
+    return p.contains("bits") ? QStringLiteral("popularity %1:%2")
+                                    .arg(p["colors"].toInt())
+                                    .arg(p["bits"].toInt())
+                              : QStringLiteral("popularity %1")
+                                    .arg(p["colors"].toInt());
+  if (op.type == QLatin1String("mediancut") ||
+      op.type == QLatin1String("octree"))
+    return QStringLiteral("%1 %2").arg(op.type).arg(p["colors"].toInt());
+  if (op.type == QLatin1String("kmeans"))
+    return p.contains("iterations") ? QStringLiteral("kmeans %1:%2")
+                                          .arg(p["colors"].toInt())
+                                          .arg(p["iterations"].toInt())
+                                    : QStringLiteral("kmeans %1")
+                                          .arg(p["colors"].toInt());
+  if (op.type == QLatin1String("equalize"))
+    return QStringLiteral("equalize %1").arg(p["mode"].toString());
+  if (op.type == QLatin1String("clahe"))
+    return QStringLiteral("clahe %1:%2")
+        .arg(p["tiles"].toInt())
+        .arg(p["clipLimit"].toDouble());
+  return op.type;
+}
+
+QImage apply(const QImage &image, const Operation &op) {
+  using DitheringAndQuantization::OutputFormat;
+  const QJsonObject &p = op.params;
+  const QString &t = op.type;
+  const OutputFormat format =
+      p["indexed"].toBool() ? OutputFormat::Indexed8 : OutputFormat::RGB32;
+
+  if (t == QLatin1String("invert"))
+    return Filters::invert(image);
+  if (t == QLatin1String("gray"))
+    return image.convertToFormat(QImage::Format_Grayscale8);
+  if (t == QLatin1String("brightness"))
+    return Filters::adjustBrightness(image, p["delta"].toInt());
+  if (t == QLatin1String("contrast"))
+    return Filters::adjustContrast(image, p["factor"].toDouble());
+  if (t == QLatin1String("gamma"))
+    return Filters::adjustGamma(image, p["gamma"].toDouble());
+  if (t == QLatin1String("blur"))
+    return Filters::blur3x3(image);
+  if (t == QLatin1String("gauss"))
+    return Filters::gaussianBlur3x3(image);
+  if (t == QLatin1String("sharpen"))
+    return Filters::sharpen3x3(image);
+  if (t == QLatin1String("edge"))
+    return Filters::edgeDetect3x3(image);
+  if (t == QLatin1String("emboss"))
+    return Filters::emboss3x3(image);
+  if (t == QLatin1String("conv"))
+    return Filters::applyConvolution(
+        image, kernelFromJson(p["kernel"].toArray()), p["divisor"].toInt(),
+        p["offset"].toInt(), p["anchorX"].toInt(), p["anchorY"].toInt());
+  if (t == QLatin1String("median"))
+    return Filters::applyMedianFilter(image, p["size"].toInt());
+  if (t == QLatin1String("erode"))
+    return Filters::applyErosionFilter(image, p["size"].toInt());
+  if (t == QLatin1String("dilate"))
+    return Filters::applyDilationFilter(image, p["size"].toInt());
+  if (t == QLatin1String("dither"))
+    return DitheringAndQuantization::applyOrderedDithering(
+        image, p["mapSize"].toInt(), p["levels"].toInt(), format);
+  if (t == QLatin1String("dither-ycbcr"))
+    return DitheringAndQuantization::applyOrderedDitheringInYCbCr(
+        image, p["mapSize"].toInt(), p["levels"].toInt());
+  if (t == QLatin1String("dither-bluenoise"))
+    return DitheringAndQuantization::applyBlueNoiseDithering(
+        image, p["levels"].toInt(), format);
+  if (t == QLatin1String("diffuse")) {
+    DitheringAndQuantization::DiffusionKernel kernel =
+        DitheringAndQuantization::DiffusionKernel::FloydSteinberg;
+    findDiffusionKernel(p["kernel"].toString(), &kernel);
+    return DitheringAndQuantization::applyErrorDiffusion(
+        image, kernel, p["levels"].toInt(), p["serpentine"].toBool(), format);
+  }
+  if (t == QLatin1String("popularity"))
+    return DitheringAndQuantization::applyPopularityQuantization(
+        image, p["colors"].toInt(), p["bits"].toInt(8), format);
+  if (t == QLatin1String("mediancut"))
+    return DitheringAndQuantization::applyMedianCutQuantization(
+        image, p["colors"].toInt(), format);
+  if (t == QLatin1String("octree"))
+    return DitheringAndQuantization::applyOctreeQuantization(
+        image, p["colors"].toInt(), format);
+  if (t == QLatin1String("kmeans")) {
+    DitheringAndQuantization::KMeansOptions options;
+    options.maxIterations = p["iterations"].toInt(options.maxIterations);
+    return DitheringAndQuantization::applyKMeansQuantization(
+        image, p["colors"].toInt(), options, format);
+  }
+  if (t == QLatin1String("lut")) {
+    QVector<int> lut;
+    for (const QJsonValue &v : p["lut"].toArray())
+      lut.append(v.toInt());
+    return Filters::applyLookupTable(image, lut);
+  }
+  if (t == QLatin1String("equalize") || t == QLatin1String("clahe")) {
+    Filters::HistogramMode mode = p["mode"].toString() == QLatin1String("rgb")
+                                      ? Filters::HistogramMode::PerChannel
+                                      : Filters::HistogramMode::Luminance;
+    if (t == QLatin1String("equalize"))
+      return Filters::equalizeHistogram(image, mode);
+    int tiles = p["tiles"].toInt();
+    return Filters::applyCLAHE(image, tiles, tiles, p["clipLimit"].toDouble(),
+                               mode);
+  }
+  return QImage();
+}
+
+QJsonObject toJson(const Operation &op) {
+  QJsonObject json;
+  json["type"] = op.type;
+  json["params"] = op.params;
+  return json;
+}
+
+bool fromJson(const QJsonObject &json, Operation &op, QString *error) {
+  QString type = json["type"].toString();
+  if (!findType(type))
+    return fail(error, QStringLiteral("unknown operation '%1'").arg(type));
+  op.type = type;
+  op.params = json["params"].toObject();
+  return validate(op, error);
+}
+
+bool saveMacro(const QString &path, const QVector<Operation> &ops,
+               QString *error) {
+  QJsonArray list;
+  for (const Operation &op : ops)
+    list.append(toJson(op));
+  QJsonObject root;
+  root["version"] = MacroVersion;
+  root["operations"] = list;
+
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return fail(error, QStringLiteral("cannot write macro %1").arg(path));
+  if (file.write(QJsonDocument(root).toJson()) < 0)
+    return fail(error, QStringLiteral("cannot write macro %1").arg(path));
+  return true;
+}
+
+bool loadMacro(const QString &path, QVector<Operation> &ops, QString *error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly))
+    return fail(error, QStringLiteral("cannot open macro %1").arg(path));
+  QJsonParseError parseError;
+  QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+  if (doc.isNull())
+    return fail(error, QStringLiteral("%1: %2")
+                           .arg(path, parseError.errorString()));
+  QJsonObject root = doc.object();
+  if (root["version"].toInt() != MacroVersion ||
+      !root["operations"].isArray())
+    return fail(error, QStringLiteral("%1 is not a macro file").arg(path));
+
+  QVector<Operation> loaded;
+  for (const QJsonValue &value : root["operations"].toArray()) {
+    Operation op;
+    QString message;
+    if (!fromJson(value.toObject(), op, &message))
+      return fail(error, QStringLiteral("%1: %2").arg(path, message));
+    loaded.append(op);
+  }
+  ops = loaded;
+  return true;
+}
+
+QImage applyAll(const QImage &image, const QVector<Operation> &ops) {
+  QImage result = image;
+  for (const Operation &op : ops) {
+    result = apply(result, op);
+    if (result.isNull())
+      break;
+  }
+  return result;
+}
+
+} // namespace Operations
@@ -0,0 +1,141 @@
+#ifndef OPERATIONS_H
+#define OPERATIONS_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @namespace Operations
+ * @brief Named, parameterized image operations.
+ *
+ * An Operation describes a call to one of the Filters or
+ * DitheringAndQuantization functions by name, with its parameters stored as
+ * JSON. This lets tools build a chain of operations from the command line
+ * and apply it without knowing every filter's signature.
+ *
+ * A chain saved to a file is a macro:
+ *
+ *     {"version": 1, "operations": [
+ *         {"type": "brightness", "params": {"delta": 20}},
+ *         {"type": "median", "params": {"size": 3}}]}
+ *
+ * The GUI records every operation it applies and can save the recording as
+ * a macro, which the GUI and the batch CLI can replay on other images.
+ */
+namespace Operations {
+
+/** @brief Version written to and required in macro files. */
+constexpr int MacroVersion = 1;
+
+/**
+ * @brief A named image operation together with its parameters.
+ */
+struct Operation {
+  QString type;       ///< Operation name, e.g. "brightness" or "median".
+  QJsonObject params; ///< Operation parameters, e.g. {"delta": 20}.
+};
+
+/**
+ * @brief Returns the names of all supported operations.
+ */
+QStringList types();
+
+/**
+ * @brief Returns true if the operation of the given type takes an argument
+ * when given on the command line.
+ */
+bool takesArgument(const QString &type);
+
+/**
+ * @brief Returns true if operations of the given type reduce the image to a
+ * palette: ordered and error diffusion dithering and the quantizers. They
+ * take an optional boolean "indexed" parameter which makes them return a
+ * Format_Indexed8 image whenever the result has at most 256 colors.
+ */
+bool producesPalette(const QString &type);
+
+/**
+ * @brief Builds an operation from a command line option.
+ *
+ * Accepted forms are e.g. "brightness 20", "contrast 1.5", "gamma 0.8",
+ * "conv kernel.txt", "median 5", "erode 3", "dilate 3", "dither 4:3"
+ * (threshold map size, one of 2, 3, 4, 6, 8, 16, 32 and 64, and levels per
+ * channel), "dither-ycbcr 4:3", "dither-bluenoise 3" (levels per channel,
+ * with the blue-noise mask), "diffuse fs:4" (error diffusion with the
+ * fs, jjn, stucki or atkinson kernel and levels per channel; "diffuse
+ * fs:4:serpentine" alternates the scan direction),
+ * "popularity 16" (or "popularity 16:6" to pre-bin colors to 6 bits per
+ * channel), "mediancut 16", "octree 16", "kmeans 16" (or "kmeans 16:40" to
+ * allow up to 40 refinement iterations), "equalize luma" (or
+ * "equalize rgb" for per-channel equalization), "clahe 8:2.5" (8x8 tiles,
+ * clip limit 2.5), "lut curve.txt" (256 whitespace-separated output values),
+ * and the
+ * argument-less "invert", "gray", "blur", "gauss",
+ * "sharpen", "edge" and "emboss".
+ *
+ * A kernel file lists one kernel row of integers per line, optionally
+ * followed by "divisor D", "offset O" and "anchor X Y" lines. Lines starting
+ * with '#' are ignored. The divisor defaults to the kernel sum (or 1) and the
+ * anchor to the kernel center.
+ *
+ * @param type The option name without leading dashes.
+ * @param argument The option argument, empty for argument-less options.
+ * @param op Receives the operation.
+ * @param error Receives a message when the option cannot be parsed.
+ * @return true on success.
+ */
+bool fromOption(const QString &type, const QString &argument, Operation &op,
+                QString *error = nullptr);
+
+/**
+ * @brief Returns a short human-readable description, e.g. "median 5".
+ */
+QString describe(const Operation &op);
+
+/**
+ * @brief Applies the operation to an image.
+ * @return The resulting image, or a null image for an unknown operation or a
+ * cancelled job.
+ */
+QImage apply(const QImage &image, const Operation &op);
+
+/**
+ * @brief Converts an operation to {"type": ..., "params": {...}}.
+ */
+QJsonObject toJson(const Operation &op);
+
+/**
+ * @brief Reads an operation written by toJson().
+ * @return false, with a message in error, if the type is unknown or the
+ * parameters are missing or out of range.
+ */
+bool fromJson(const QJsonObject &json, Operation &op,
+              QString *error = nullptr);
+
+/**
+ * @brief Writes a chain of operations to a macro file.
+ * @return true on success.
+ */
+bool saveMacro(const QString &path, const QVector<Operation> &ops,
+               QString *error = nullptr);
+
+/**
+ * @brief Reads a macro file. Every operation is validated as in fromJson().
+ * @param ops Receives the operations; left unchanged on failure.
+ * @return true on success.
+ */
+bool loadMacro(const QString &path, QVector<Operation> &ops,
+               QString *error = nullptr);
+
+/**
+ * @brief Applies a chain of operations in order.
+ * @return The resulting image, or a null image if any step failed.
+ */
+QImage applyAll(const QImage &image, const QVector<Operation> &ops);
+
+} // namespace Operations
+
+#endif // OPERATIONS_H
@@ -0,0 +1,112 @@
+#include "parallel.h"
+#include "jobcontext.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+namespace {
+/* Passes cheaper than this (roughly pixels) are not worth a thread. */
+constexpr long long MinParallelCost = 1 << 16;
+/* Bands per thread, for load balancing. */
+constexpr int BandsPerThread = 8;
+
+std::atomic<int> threadLimit{0};
+thread_local int threadBudget = 0; // 0: no ThreadBudget in scope
+thread_local bool insideLoop = false;
+
+/* Runs fn over bands of bandRows rows on the given number of threads. The
+ * bands are handed out in ascending order. */
+int runBands(int rows, int threads, int bandRows, const RowFunction &fn) {
+  JobContext *ctx = JobContext::current();
+  std::atomic<int> nextBand{0};
+  std::atomic<int> rowsDone{0};
+  std::mutex progressMutex;
+  int rowsReported = 0;
+
+  auto work = [&](int thread) {
+    JobContext::Scope scope(ctx);
+    bool wasInside = insideLoop;
+    insideLoop = true;
+    for (int band = nextBand++; band * bandRows < rows; band = nextBand++) {
+      if (ctx && ctx->isCancelled())
+        break;
+      int begin = band * bandRows;
+      int end = std::min(rows, begin + bandRows);
+      {
+        Telemetry::BandTimer timer(begin, end);
+        fn(begin, end, thread);
+      }
+      int done = rowsDone += end - begin;
+      if (ctx) {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        if (done > rowsReported) {
+          rowsReported = done;
+          ctx->reportProgress(double(done) / rows);
+        }
+      }
+    }
+    insideLoop = wasInside;
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; ++i)
+    workers.emplace_back(work, i);
+  work(0);
+  for (std::thread &t : workers)
+    t.join();
+
+  return ctx && ctx->isCancelled() ? 0 : threads;
+}
+} // namespace
+
+int maxThreads() {
+  int limit = threadLimit.load(std::memory_order_relaxed);
+  int threads = limit > 0
+                    ? limit
+                    : std::max(1, int(std::thread::hardware_concurrency()));
+  return threadBudget > 0 ? std::min(threads, threadBudget) : threads;
+}
+
+void setMaxThreads(int threads) {
+  threadLimit.store(std::max(0, threads), std::memory_order_relaxed);
+}
+
+ThreadBudget::ThreadBudget(int threads) : previous(threadBudget) {
+  threadBudget = std::max(1, threads);
+}
+
+ThreadBudget::~ThreadBudget() { threadBudget = previous; }
+
+int threadsFor(int rows, long long costPerRow, int limit) {
+  if (insideLoop || rows < 2)
+    return 1;
+  long long cost = rows * std::max(1LL, costPerRow);
+  int byCost = int(std::min<long long>(cost / MinParallelCost, rows));
+  int threads = std::min(maxThreads(), byCost);
+  if (limit > 0)
+    threads = std::min(threads, limit);
+  return std::max(1, threads);
+}
+
+int forRows(int rows, long long costPerRow, const RowFunction &fn,
+            int limit) {
+  if (rows <= 0)
+    return 1;
+  const int threads = threadsFor(rows, costPerRow, limit);
+  const int bandCount = std::min(rows, threads * BandsPerThread);
+  return runBands(rows, threads, (rows + bandCount - 1) / bandCount, fn);
+}
+
+int forRowsInOrder(int rows, long long costPerRow, const RowFunction &fn,
+                   int limit) {
+  if (rows <= 0)
+    return 1;
+  return runBands(rows, threadsFor(rows, costPerRow, limit), 1, fn);
+}
+
+} // namespace Parallel
@@ -0,0 +1,91 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+/**
+ * @namespace Parallel
+ * @brief Splits row loops across threads.
+ *
+ * The rows of a pass are cut into bands that worker threads pick up
+ * dynamically. The JobContext of the calling thread is installed on every
+ * worker, so cancellation stops all of them, and the progress is reported
+ * once per finished band. Telemetry records every band as a row band.
+ *
+ * Loops run on the calling thread alone when the pass is small, when only
+ * one thread is allowed, or when called from inside another parallel loop.
+ */
+namespace Parallel {
+
+/**
+ * @brief Processes rows [begin, end) of a pass.
+ * @param begin First row of the band.
+ * @param end One past the last row of the band.
+ * @param thread Index of the executing thread in [0, threads), e.g. to pick a
+ * per-thread accumulator.
+ */
+using RowFunction = std::function<void(int begin, int end, int thread)>;
+
+/**
+ * @brief Returns the number of threads loops may use: the hardware
+ * concurrency unless limited with setMaxThreads() or a ThreadBudget.
+ */
+int maxThreads();
+
+/** @brief Limits the number of threads; 0 restores the default. */
+void setMaxThreads(int threads);
+
+/**
+ * @brief Further limits the threads of loops started by the current thread
+ * while in scope.
+ *
+ * For callers that run several loops at once, e.g. one image per worker of a
+ * batch: with N such workers, a budget of maxThreads() / N each keeps the
+ * total near the core count instead of N times it.
+ */
+class ThreadBudget {
+public:
+  explicit ThreadBudget(int threads);
+  ~ThreadBudget();
+  ThreadBudget(const ThreadBudget &) = delete;
+  ThreadBudget &operator=(const ThreadBudget &) = delete;
+
+private:
+  int previous;
+};
+
+/**
+ * @brief Returns the number of threads forRows() will use for a pass.
+ * @param rows The number of rows.
+ * @param costPerRow Rough work per row, e.g. the image width; passes below
+ * a minimum total cost run serially.
+ * @param limit If positive, at most this many threads, e.g. when every
+ * thread needs a large private buffer.
+ */
+int threadsFor(int rows, long long costPerRow, int limit = 0);
+
+/**
+ * @brief Runs fn over all rows of a pass and waits for it to finish.
+ * @param rows The number of rows.
+ * @param costPerRow Rough work per row, see threadsFor().
+ * @param fn Called for each band of rows.
+ * @param limit If positive, at most this many threads, see threadsFor().
+ * @return The number of threads used, or 0 when the job was cancelled.
+ */
+int forRows(int rows, long long costPerRow, const RowFunction &fn,
+            int limit = 0);
+
+/**
+ * @brief Like forRows(), but hands out one row at a time in ascending order,
+ * for passes in which a row depends on the rows above it (e.g. a wavefront).
+ *
+ * A row may wait for rows above it: every one of them has already been
+ * handed to a running thread. Waiting loops must give up once the job is
+ * cancelled, since the rows they wait for may then never be finished.
+ */
+int forRowsInOrder(int rows, long long costPerRow, const RowFunction &fn,
+                   int limit = 0);
+
+} // namespace Parallel
+
+#endif // PARALLEL_H
@@ -0,0 +1,177 @@
+#include "rawimage.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <cstdio>
+#include <cstring>
+
+namespace RawImage {
+namespace {
+constexpr char Magic[8] = {'R', 'A', 'W', 'I', 'M', 'G', '0', '1'};
+constexpr quint32 ByteOrderMark = 0x01020304;
+constexpr qint64 DataAlignment = 64;
+
+struct Header {
+  char magic[8];
+  quint32 byteOrder;
+  quint32 width;
+  quint32 height;
+  quint32 format;
+  quint32 bytesPerLine;
+  quint32 colorCount;
+  quint64 dataOffset;
+  quint8 reserved[24];
+};
+static_assert(sizeof(Header) == 64, "the header must be 64 bytes");
+
+void setError(QString *error, const QString &message) {
+  if (error)
+    *error = message;
+}
+
+qint64 alignUp(qint64 value) {
+  return (value + DataAlignment - 1) / DataAlignment * DataAlignment;
+}
+
+/* Releases the mapping together with the last copy of the QImage. */
+void closeMappedFile(void *file) { delete static_cast<QFile *>(file); }
+
+/* Moves the written temporary file over the target. The target's inode is
+ * replaced rather than rewritten, so images still mapping the old file keep
+ * their contents. */
+bool replaceFile(QTemporaryFile &temp, const QString &path) {
+#ifdef Q_OS_WIN
+  // Windows cannot replace a mapped file at all; report it as an error.
+  return (!QFile::exists(path) || QFile::remove(path)) && temp.rename(path);
+#else
+  // rename(2) atomically replaces an existing target.
+  if (std::rename(QFile::encodeName(temp.fileName()).constData(),
+                  QFile::encodeName(path).constData()) != 0)
+    return false;
+  temp.setAutoRemove(false);
+  return true;
+#endif
+}
+} // namespace
+
+bool isRawImage(const QString &path) {
+  return QFileInfo(path).suffix().compare(QLatin1String(suffix()),
+                                          Qt::CaseInsensitive) == 0;
+}
+
+QImage load(const QString &path, QString *error) {
+  auto *file = new QFile(path);
+  if (!file->open(QIODevice::ReadOnly)) {
+    setError(error, QStringLiteral("cannot open %1").arg(path));
+    delete file;
+    return QImage();
+  }
+
+  const qint64 fileSize = file->size();
+  const uchar *map = fileSize >= qint64(sizeof(Header))
+                         ? file->map(0, fileSize)
+                         : nullptr;
+  Header header;
+  if (map)
+    std::memcpy(&header, map, sizeof(Header));
+  if (!map || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+      header.byteOrder != ByteOrderMark) {
+    setError(error, QStringLiteral("%1 is not a raw image written on this "
+                                   "platform")
+                        .arg(path));
+    delete file;
+    return QImage();
+  }
+
+  const auto format = QImage::Format(header.format);
+  const int width = int(header.width), height = int(header.height);
+  const qint64 pixelBytes = qint64(header.bytesPerLine) * height;
+  const qint64 tableBytes = qint64(header.colorCount) * sizeof(QRgb);
+  const bool validFormat = header.format > QImage::Format_Invalid &&
+                           header.format < QImage::NImageFormats;
+  const int depth =
+      validFormat ? QImage::toPixelFormat(format).bitsPerPixel() : 0;
+  if (!validFormat || width <= 0 || height <= 0 ||
+      header.bytesPerLine % 4 != 0 ||
+      qint64(header.bytesPerLine) * 8 < qint64(width) * depth ||
+      header.dataOffset % DataAlignment != 0 ||
+      header.dataOffset < sizeof(Header) + tableBytes ||
+      qint64(header.dataOffset) + pixelBytes > fileSize) {
+    setError(error, QStringLiteral("%1 has an invalid header").arg(path));
+    delete file;
+    return QImage();
+  }
+
+  // The QImage takes ownership of the file and unmaps it when released.
+  QImage image(map + header.dataOffset, width, height,
+               int(header.bytesPerLine), format, closeMappedFile, file);
+  if (header.colorCount > 0) {
+    QVector<QRgb> table(int(header.colorCount));
+    std::memcpy(table.data(), map + sizeof(Header), tableBytes);
+    image.setColorTable(table);
+  }
+  return image;
+}
+
+bool save(const QImage &image, const QString &path, QString *error) {
+  if (image.isNull()) {
+    setError(error, QStringLiteral("nothing to save"));
+    return false;
+  }
+
+  const QVector<QRgb> table = image.colorTable();
+  const qint64 tableBytes = qint64(table.size()) * sizeof(QRgb);
+  const qint64 dataOffset = alignUp(qint64(sizeof(Header)) + tableBytes);
+  const qint64 bytesPerLine = image.bytesPerLine();
+  const qint64 fileSize = dataOffset + bytesPerLine * image.height();
+
+  // The target may be mapped by a loaded image, e.g. when saving over the
+  // file that was loaded. Write a temporary file next to it and rename it
+  // over the target, as QSaveFile does (which cannot be mapped for writing).
+  QTemporaryFile file(path + QStringLiteral(".XXXXXX"));
+  if (!file.open() || !file.resize(fileSize)) {
+    setError(error, QStringLiteral("cannot write %1").arg(path));
+    return false;
+  }
+  // Temporary files are private to the owner; keep the target's permissions.
+  const QFileInfo target(path);
+  file.setPermissions(target.exists()
+                          ? target.permissions()
+                          : QFile::ReadOwner | QFile::WriteOwner |
+                                QFile::ReadGroup | QFile::ReadOther);
+  uchar *map = file.map(0, fileSize);
+  if (!map) {
+    setError(error, QStringLiteral("cannot map %1").arg(path));
+    return false;
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.byteOrder = ByteOrderMark;
+  header.width = quint32(image.width());
+  header.height = quint32(image.height());
+  header.format = quint32(image.format());
+  header.bytesPerLine = quint32(bytesPerLine);
+  header.colorCount = quint32(table.size());
+  header.dataOffset = quint64(dataOffset);
+  std::memcpy(map, &header, sizeof(Header));
+  if (tableBytes > 0)
+    std::memcpy(map + sizeof(Header), table.constData(), tableBytes);
+  std::memset(map + sizeof(Header) + tableBytes, 0,
+              dataOffset - sizeof(Header) - tableBytes);
+  // A QImage's rows are contiguous, so the pixels are one copy.
+  std::memcpy(map + dataOffset, image.constBits(),
+              bytesPerLine * image.height());
+
+  bool ok = file.unmap(map);
+  file.close();
+  if (!ok || file.error() != QFileDevice::NoError ||
+      !replaceFile(file, path)) {
+    setError(error, QStringLiteral("cannot write %1").arg(path));
+    return false;
+  }
+  return true;
+}
+
+} // namespace RawImage
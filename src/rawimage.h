@@ -0,0 +1,61 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <QImage>
+#include <QString>
+
+/**
+ * @namespace RawImage
+ * @brief Uncompressed ".rawimg" files that are loaded and saved through
+ * memory mapping.
+ *
+ * The file starts with a 64-byte header, followed by the color table (for
+ * indexed formats) and the pixel rows exactly as QImage stores them, with
+ * the pixel data starting on a 64-byte boundary:
+ *
+ * | Offset | Size | Field                                        |
+ * |--------|------|----------------------------------------------|
+ * | 0      | 8    | Magic "RAWIMG01"                             |
+ * | 8      | 4    | Byte order mark 0x01020304 (native order)    |
+ * | 12     | 4    | Width                                        |
+ * | 16     | 4    | Height                                       |
+ * | 20     | 4    | QImage::Format                               |
+ * | 24     | 4    | Bytes per line (a multiple of 4)             |
+ * | 28     | 4    | Number of color table entries                |
+ * | 32     | 8    | Offset of the pixel data                     |
+ * | 40     | 24   | Reserved, zero                               |
+ *
+ * Loading maps the file and wraps the mapping as a read-only QImage without
+ * copying; the mapping is released with the last copy of the image. Writing
+ * to the image detaches it as usual, so the file is never modified. save()
+ * writes a new file and renames it over the target, so saving over a file
+ * that is still mapped (including the image's own) is safe; other writers
+ * must not truncate or rewrite a mapped file in place.
+ *
+ * Files are only readable on machines with the byte order they were written
+ * with.
+ */
+namespace RawImage {
+
+/** @brief The file suffix, without the dot. */
+inline const char *suffix() { return "rawimg"; }
+
+/** @brief Returns true if the path has the ".rawimg" suffix. */
+bool isRawImage(const QString &path);
+
+/**
+ * @brief Maps a ".rawimg" file as a QImage.
+ * @return The image, or a null image with a message in @p error.
+ */
+QImage load(const QString &path, QString *error = nullptr);
+
+/**
+ * @brief Writes the image to a ".rawimg" file through a mapping of a
+ * temporary file in the same directory, which then replaces @p path.
+ * @return true on success.
+ */
+bool save(const QImage &image, const QString &path, QString *error = nullptr);
+
+} // namespace RawImage
+
+#endif // RAWIMAGE_H
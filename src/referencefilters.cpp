@@ -0,0 +1,921 @@
+#include "referencefilters.h"
+#include <QColor>
+#include <QMap>
+#include <QPair>
+#include <QtMath>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <queue>
+
+// Frozen copies of the original implementations. Do not optimize.
+
+namespace {
+/* --- Helper: Predefined Threshold Matrices --- */
+static QVector<QVector<int>> getThresholdMatrix(int size) {
+  if (size == 2) {
+    return {{0, 2}, {3, 1}};
+  }
+  if (size == 3) {
+    return {{6, 8, 4}, {1, 0, 3}, {5, 2, 7}};
+  }
+  if (size == 4) {
+    return {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+  }
+  if (size == 6) {
+    return {{0, 32, 8, 40, 2, 34},   {48, 16, 56, 24, 50, 18},
+            {12, 44, 4, 36, 14, 46}, {60, 28, 52, 20, 62, 30},
+            {3, 35, 11, 43, 1, 33},  {51, 19, 59, 27, 49, 17}};
+  }
+  if (size == 8 || size == 16 || size == 32 || size == 64) {
+    // Bayer matrix by its closed form: going from the top bit of x and y
+    // down, each bit pair (x_b, y_b) adds the base-4 digit
+    // 2 * (x_b XOR y_b) + y_b, the top bits giving the lowest digit.
+    QVector<QVector<int>> matrix(size, QVector<int>(size));
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        int value = 0, digit = 1;
+        for (int bit = size / 2; bit > 0; bit /= 2) {
+          int xb = (x & bit) ? 1 : 0;
+          int yb = (y & bit) ? 1 : 0;
+          value += (2 * (xb ^ yb) + yb) * digit;
+          digit *= 4;
+        }
+        matrix[y][x] = value;
+      }
+    }
+    return matrix;
+  }
+  return getThresholdMatrix(2);
+}
+
+/* --- Helper: Error Diffusion --- */
+struct DiffusionWeight {
+  int dx, dy, weight;
+};
+
+static QVector<DiffusionWeight>
+getDiffusionWeights(DitheringAndQuantization::DiffusionKernel kernel,
+                    int &divisor) {
+  using DitheringAndQuantization::DiffusionKernel;
+  switch (kernel) {
+  case DiffusionKernel::JarvisJudiceNinke:
+    divisor = 48;
+    return {{1, 0, 7},  {2, 0, 5},  {-2, 1, 3}, {-1, 1, 5},
+            {0, 1, 7},  {1, 1, 5},  {2, 1, 3},  {-2, 2, 1},
+            {-1, 2, 3}, {0, 2, 5},  {1, 2, 3},  {2, 2, 1}};
+  case DiffusionKernel::Stucki:
+    divisor = 42;
+    return {{1, 0, 8},  {2, 0, 4},  {-2, 1, 2}, {-1, 1, 4},
+            {0, 1, 8},  {1, 1, 4},  {2, 1, 2},  {-2, 2, 1},
+            {-1, 2, 2}, {0, 2, 4},  {1, 2, 2},  {2, 2, 1}};
+  case DiffusionKernel::Atkinson:
+    divisor = 8;
+    return {{1, 0, 1}, {2, 0, 1}, {-1, 1, 1},
+            {0, 1, 1}, {1, 1, 1}, {0, 2, 1}};
+  case DiffusionKernel::FloydSteinberg:
+    break;
+  }
+  divisor = 16;
+  return {{1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}};
+}
+
+/* Rounds error / divisor to nearest, ties away from zero. */
+static int divideError(int error, int divisor) {
+  int magnitude = (std::abs(error) * 2 + divisor) / (2 * divisor);
+  return error < 0 ? -magnitude : magnitude;
+}
+
+/* Diffuses the error of every pixel of image, scanned row by row, with
+ * quantize mapping a QColor to its output color. */
+template <typename Quantize>
+static QImage diffuseErrors(const QImage &image,
+                            DitheringAndQuantization::DiffusionKernel kernel,
+                            bool serpentine, Quantize quantize) {
+  int divisor = 1;
+  const QVector<DiffusionWeight> weights = getDiffusionWeights(kernel, divisor);
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  // One error numerator per channel and pixel.
+  QVector<int> errors(width * height * 3, 0);
+  for (int y = 0; y < height; ++y) {
+    bool reverse = serpentine && (y % 2 == 1);
+    for (int k = 0; k < width; ++k) {
+      int x = reverse ? width - 1 - k : k;
+      QColor origColor(src.pixel(x, y));
+      int *e = &errors[(y * width + x) * 3];
+      int r = std::clamp(origColor.red() + divideError(e[0], divisor), 0, 255);
+      int g =
+          std::clamp(origColor.green() + divideError(e[1], divisor), 0, 255);
+      int b = std::clamp(origColor.blue() + divideError(e[2], divisor), 0, 255);
+      QColor newColor(quantize(r, g, b));
+      dst.setPixel(x, y, newColor.rgb());
+
+      int errR = r - newColor.red();
+      int errG = g - newColor.green();
+      int errB = b - newColor.blue();
+      for (const DiffusionWeight &w : weights) {
+        int nx = x + (reverse ? -w.dx : w.dx);
+        int ny = y + w.dy;
+        if (nx < 0 || nx >= width || ny >= height)
+          continue;
+        int *t = &errors[(ny * width + nx) * 3];
+        t[0] += errR * w.weight;
+        t[1] += errG * w.weight;
+        t[2] += errB * w.weight;
+      }
+    }
+  }
+  return dst;
+}
+} // namespace
+
+namespace Filters {
+namespace reference {
+
+QImage invert(const QImage &image) {
+  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  for (int y = 0; y < result.height(); ++y) {
+    for (int x = 0; x < result.width(); ++x) {
+      QRgb pixel = result.pixel(x, y);
+      int red = 255 - qRed(pixel);
+      int green = 255 - qGreen(pixel);
+      int blue = 255 - qBlue(pixel);
+      result.setPixel(x, y, qRgb(red, green, blue));
+    }
+  }
+  return result;
+}
+
+QImage adjustBrightness(const QImage &image, int delta) {
+  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  for (int y = 0; y < result.height(); ++y) {
+    for (int x = 0; x < result.width(); ++x) {
+      QRgb pixel = result.pixel(x, y);
+      int red = qBound(0, qRed(pixel) + delta, 255);
+      int green = qBound(0, qGreen(pixel) + delta, 255);
+      int blue = qBound(0, qBlue(pixel) + delta, 255);
+      result.setPixel(x, y, qRgb(red, green, blue));
+    }
+  }
+  return result;
+}
+
+QImage adjustContrast(const QImage &image, double factor) {
+  // factor > 1 -> higher contrast, factor < 1 -> lower contrast
+  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  double midpoint = 128.0;
+  for (int y = 0; y < result.height(); ++y) {
+    for (int x = 0; x < result.width(); ++x) {
+      QRgb pixel = result.pixel(x, y);
+      int red = qBound(
+          0, static_cast<int>((qRed(pixel) - midpoint) * factor + midpoint),
+          255);
+      int green = qBound(
+          0, static_cast<int>((qGreen(pixel) - midpoint) * factor + midpoint),
+          255);
+      int blue = qBound(
+          0, static_cast<int>((qBlue(pixel) - midpoint) * factor + midpoint),
+          255);
+      result.setPixel(x, y, qRgb(red, green, blue));
+    }
+  }
+  return result;
+}
+
+QImage adjustGamma(const QImage &image, double gammaValue) {
+  QImage result = image.convertToFormat(QImage::Format_RGB32);
+  // Precompute a lookup table
+  unsigned char gammaLUT[256];
+  for (int i = 0; i < 256; ++i) {
+    gammaLUT[i] = qBound(
+        0, static_cast<int>(255.0 * qPow(i / 255.0, 1.0 / gammaValue)), 255);
+  }
+
+  for (int y = 0; y < result.height(); ++y) {
+    for (int x = 0; x < result.width(); ++x) {
+      QRgb pixel = result.pixel(x, y);
+      int red = gammaLUT[qRed(pixel)];
+      int green = gammaLUT[qGreen(pixel)];
+      int blue = gammaLUT[qBlue(pixel)];
+      result.setPixel(x, y, qRgb(red, green, blue));
+    }
+  }
+  return result;
+}
+
+QImage applyConvolution(const QImage &image,
+                        const QVector<QVector<int>> &kernel, int divisor,
+                        int offset, int anchorX, int anchorY) {
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+
+  // Safety: avoid division by 0.
+  if (divisor == 0)
+    divisor = 1;
+
+  int kRows = kernel.size();
+  if (kRows == 0)
+    return src;
+  int kCols = kernel[0].size();
+
+  // Loop over every pixel.
+  for (int y = 0; y < src.height(); y++) {
+    for (int x = 0; x < src.width(); x++) {
+      int sumR = 0, sumG = 0, sumB = 0;
+      // Loop over kernel rows and columns.
+      for (int ky = 0; ky < kRows; ky++) {
+        for (int kx = 0; kx < kCols; kx++) {
+          int pixelX = x + kx - anchorX;
+          int pixelY = y + ky - anchorY;
+          int factor = kernel[ky][kx];
+
+          // Use zero if pixel is out-of-bound.
+          if (pixelX >= 0 && pixelX < src.width() && pixelY >= 0 &&
+              pixelY < src.height()) {
+            QRgb pixel = src.pixel(pixelX, pixelY);
+            sumR += qRed(pixel) * factor;
+            sumG += qGreen(pixel) * factor;
+            sumB += qBlue(pixel) * factor;
+          }
+          // Else: out-of-bound contributes 0.
+        }
+      }
+      int outR = std::clamp((sumR / divisor) + offset, 0, 255);
+      int outG = std::clamp((sumG / divisor) + offset, 0, 255);
+      int outB = std::clamp((sumB / divisor) + offset, 0, 255);
+      dst.setPixel(x, y, qRgb(outR, outG, outB));
+    }
+  }
+
+  return dst;
+}
+
+QImage applyMedianFilter(const QImage &image, int kernelSize) {
+  QImage result(image.size(), image.format());
+  int radius = kernelSize / 2;
+  for (int y = 0; y < image.height(); ++y) {
+    for (int x = 0; x < image.width(); ++x) {
+      QVector<int> window;
+      for (int j = -radius; j <= radius; ++j) {
+        for (int i = -radius; i <= radius; ++i) {
+          int nx = x + i;
+          int ny = y + j;
+          if (nx >= 0 && nx < image.width() && ny >= 0 && ny < image.height()) {
+            int intensity = qGray(image.pixel(nx, ny));
+            window.append(intensity);
+          }
+        }
+      }
+      std::sort(window.begin(), window.end());
+      int median = window[window.size() / 2];
+      result.setPixel(x, y, qRgb(median, median, median));
+    }
+  }
+  return result;
+}
+
+QImage applyErosionFilter(const QImage &image, int kernelSize) {
+  if (kernelSize % 2 == 0) {
+    kernelSize++;
+  }
+  int radius = kernelSize / 2;
+
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int minR = 255, minG = 255, minB = 255;
+      for (int dy = -radius; dy <= radius; ++dy) {
+        int ny = std::min(std::max(y + dy, 0), height - 1);
+        for (int dx = -radius; dx <= radius; ++dx) {
+          int nx = std::min(std::max(x + dx, 0), width - 1);
+          QColor pixelColor(src.pixel(nx, ny));
+          minR = std::min(minR, pixelColor.red());
+          minG = std::min(minG, pixelColor.green());
+          minB = std::min(minB, pixelColor.blue());
+        }
+      }
+      dst.setPixel(x, y, qRgb(minR, minG, minB));
+    }
+  }
+  return dst;
+}
+
+QImage applyDilationFilter(const QImage &image, int kernelSize) {
+  if (kernelSize % 2 == 0) {
+    kernelSize++;
+  }
+  int radius = kernelSize / 2;
+
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int maxR = 0, maxG = 0, maxB = 0;
+      for (int dy = -radius; dy <= radius; ++dy) {
+        int ny = std::min(std::max(y + dy, 0), height - 1);
+        for (int dx = -radius; dx <= radius; ++dx) {
+          int nx = std::min(std::max(x + dx, 0), width - 1);
+          QColor pixelColor(src.pixel(nx, ny));
+          maxR = std::max(maxR, pixelColor.red());
+          maxG = std::max(maxG, pixelColor.green());
+          maxB = std::max(maxB, pixelColor.blue());
+        }
+      }
+      dst.setPixel(x, y, qRgb(maxR, maxG, maxB));
+    }
+  }
+  return dst;
+}
+
+} // namespace reference
+} // namespace Filters
+
+namespace DitheringAndQuantization {
+namespace reference {
+
+QImage applyOrderedDithering(const QImage &image, int thresholdMapSize,
+                             int levelsPerChannel) {
+  if (levelsPerChannel < 2)
+    levelsPerChannel = 2; // At least 2 levels.
+
+  QVector<QVector<int>> thresholdMatrix = getThresholdMatrix(thresholdMapSize);
+  int matrixMax = thresholdMapSize * thresholdMapSize;
+  // Formula:
+  // v_norm = v / 255 * levelsPerChannel.
+  // q = floor(v_norm)
+  // frac = v_norm - q.
+  // T = (thresholdMatrix[x mod N][y mod N] + 0.5) / (matrixMax)
+  // If (frac > T) then q++.
+  // Output = clamp(q, 0, levelsPerChannel - 1) scaled back to 0-255.
+
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      QColor origColor(src.pixel(x, y));
+      int newR = 0, newG = 0, newB = 0;
+      // Process each channel:
+      for (int channel = 0; channel < 3; ++channel) {
+        int v = 0;
+        if (channel == 0)
+          v = origColor.red();
+        else if (channel == 1)
+          v = origColor.green();
+        else if (channel == 2)
+          v = origColor.blue();
+
+        double v_norm = (v / 255.0) * levelsPerChannel; // value in [0, levels]
+        int q = int(floor(v_norm));
+        double frac = v_norm - q;
+        // Get threshold from matrix:
+        int i = x % thresholdMapSize;
+        int j = y % thresholdMapSize;
+        double T = (thresholdMatrix[j][i] + 0.5) / double(matrixMax);
+        if (frac > T) {
+          q++;
+        }
+        if (q < 0)
+          q = 0;
+        if (q >= levelsPerChannel)
+          q = levelsPerChannel - 1;
+        // Map q to 0..255:
+        int newVal = (levelsPerChannel > 1)
+                         ? int(q * 255.0 / (levelsPerChannel - 1))
+                         : 0;
+        if (channel == 0)
+          newR = newVal;
+        else if (channel == 1)
+          newG = newVal;
+        else if (channel == 2)
+          newB = newVal;
+      }
+      dst.setPixel(x, y, qRgb(newR, newG, newB));
+    }
+  }
+  return dst;
+}
+
+QImage applyOrderedDitheringInYCbCr(const QImage &image, int thresholdMapSize,
+                                    int levelsY) {
+  if (levelsY <= 2)
+    levelsY = 3;
+  else if (levelsY % 2 == 0)
+    levelsY = levelsY + 1;
+
+  QVector<QVector<int>> thresholdMatrix = getThresholdMatrix(thresholdMapSize);
+  int matrixSize = thresholdMapSize;
+  int matrixMax = matrixSize * matrixSize;
+
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  QImage dst(src.size(), QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      QColor origColor(src.pixel(x, y));
+      // Convert RGB to YCbCr
+      double R = origColor.red();
+      double G = origColor.green();
+      double B = origColor.blue();
+      double Y_val = 0.299 * R + 0.587 * G + 0.114 * B;
+      double Cb = 128 - 0.168736 * R - 0.331264 * G + 0.5 * B;
+      double Cr = 128 + 0.5 * R - 0.418688 * G - 0.081312 * B;
+
+      // --- Apply Ordered Dithering on the Y Channel ---
+      double y_norm = (Y_val / 255.0) * levelsY;
+      int q = int(floor(y_norm));
+      double frac = y_norm - q;
+      int i = x % matrixSize;
+      int j = y % matrixSize;
+      double T = (thresholdMatrix[j][i] + 0.5) / double(matrixMax);
+      if (frac > T)
+        q++;
+      q = std::clamp(q, 0, levelsY - 1);
+      double newY = (levelsY > 1) ? (q * 255.0 / (levelsY - 1)) : 0;
+
+      // --- Convert YCbCr back to RGB ---
+      int newR = int(newY + 1.402 * (Cr - 128));
+      int newG = int(newY - 0.344136 * (Cb - 128) - 0.714136 * (Cr - 128));
+      int newB = int(newY + 1.772 * (Cb - 128));
+      newR = std::clamp(newR, 0, 255);
+      newG = std::clamp(newG, 0, 255);
+      newB = std::clamp(newB, 0, 255);
+
+      dst.setPixel(x, y, qRgb(newR, newG, newB));
+    }
+  }
+  return dst;
+}
+
+QImage applyPopularityQuantization(const QImage &image, int numColors) {
+  QImage src = image.convertToFormat(QImage::Format_RGB32);
+  int width = src.width();
+  int height = src.height();
+
+  // Step 1: Count frequencies of colors.
+  QMap<QRgb, int> colorFrequency;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      QRgb pixel = src.pixel(x, y);
+      colorFrequency[pixel] += 1;
+    }
+  }
+
+  // Step 2: Sort colors by frequency.
+  QVector<QPair<QRgb, int>> freqList;
+  for (auto it = colorFrequency.begin(); it != colorFrequency.end(); ++it) {
+    freqList.append(qMakePair(it.key(), it.value()));
+  }
+  // Stable, so that ties keep the ascending QRgb order of the map.
+  std::stable_sort(freqList.begin(), freqList.end(),
+                   [](const QPair<QRgb, int> &a, const QPair<QRgb, int> &b) {
+                     return a.second > b.second;
+                   });
+
+  // Step 3: Select the top numColors.
+  QVector<QRgb> palette;
+  int count = qMin(numColors, freqList.size());
+  for (int i = 0; i < count; ++i) {
+    palette.append(freqList[i].first);
+  }
+  if (palette.isEmpty()) {
+    return src;
+  }
+
+  // Step 4: For each pixel, find the nearest color in the palette.
+  QImage dst(src.size(), QImage::Format_RGB32);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      QColor origColor(src.pixel(x, y));
+      int bestDist = 1e9;
+      QRgb bestColor = palette.first();
+      for (QRgb palColor : palette) {
+        QColor c(palColor);
+        int dr = origColor.red() - c.red();
+        int dg = origColor.green() - c.green();
+        int db = origColor.blue() - c.blue();
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < bestDist) {
+          bestDist = dist;
+          bestColor = palColor;
+        }
+      }
+      dst.setPixel(x, y, bestColor);
+    }
+  }
+  return dst;
+}
+
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           int levelsPerChannel, bool serpentine) {
+  int levels = std::clamp(levelsPerChannel, 2, 256);
+  // Each channel goes to the nearest of levels evenly spaced values.
+  auto quantize = [levels](int r, int g, int b) {
+    int v[] = {r, g, b};
+    for (int &c : v) {
+      int q = (c * (levels - 1) + 127) / 255;
+      c = (q * 255 + (levels - 1) / 2) / (levels - 1);
+    }
+    return qRgb(v[0], v[1], v[2]);
+  };
+  return diffuseErrors(image, kernel, serpentine, quantize);
+}
+
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           const QVector<QRgb> &palette, bool serpentine) {
+  if (palette.isEmpty())
+    return image.convertToFormat(QImage::Format_RGB32);
+  auto quantize = [&palette](int r, int g, int b) {
+    int bestDist = 1e9;
+    QRgb bestColor = palette.first();
+    for (QRgb palColor : palette) {
+      QColor c(palColor);
+      int dr = r - c.red();
+      int dg = g - c.green();
+      int db = b - c.blue();
+      int dist = dr * dr + dg * dg + db * db;
+      if (dist < bestDist) {
+        bestDist = dist;
+        bestColor = palColor;
+      }
+    }
+    return bestColor;
+  };
+  return diffuseErrors(image, kernel, serpentine, quantize);
+}
+
+} // namespace reference
+} // namespace DitheringAndQuantization
+
+namespace DrawingEngine {
+namespace reference {
+
+/* ---------- low‑level helpers ---------------------------------------- */
+static inline void setPixelSafe(QImage &im, int x, int y, const QColor &c) {
+  if (x >= 0 && x < im.width() && y >= 0 && y < im.height())
+    im.setPixel(x, y, c.rgb());
+}
+
+static inline void blend(QImage &im, int x, int y, double a, const QColor &c) {
+  if (x < 0 || y < 0 || x >= im.width() || y >= im.height())
+    return;
+  QRgb bg = im.pixel(x, y);
+  int r = int(qRed(bg) * (1 - a) + c.red() * a);
+  int g = int(qGreen(bg) * (1 - a) + c.green() * a);
+  int b = int(qBlue(bg) * (1 - a) + c.blue() * a);
+  im.setPixel(x, y, qRgb(r, g, b));
+}
+
+/* integer part helpers */
+static inline int iPart(double x) { return int(std::floor(x)); }
+static inline double fPart(double x) { return x - std::floor(x); }
+static inline double rfPart(double x) { return 1.0 - fPart(x); }
+
+/* ---------- DDA line -------------------------------------------------- */
+void drawLineDDA(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
+  int dx = x1 - x0, dy = y1 - y0, steps = std::max(std::abs(dx), std::abs(dy));
+  if (!steps) {
+    setPixelSafe(im, x0, y0, c);
+    return;
+  }
+  double x = x0, y = y0, ix = dx / double(steps), iy = dy / double(steps);
+  for (int i = 0; i <= steps; ++i, x += ix, y += iy)
+    setPixelSafe(im, int(std::round(x)), int(std::round(y)), c);
+}
+
+/* ---------- Xiaolin‑Wu line ------------------------------------------ */
+void drawLineWu(QImage &im, int x0, int y0, int x1, int y1, const QColor &c) {
+  bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+  if (steep) {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+  }
+  if (x0 > x1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+
+  double dx = x1 - x0, dy = y1 - y0, grad = dx ? dy / dx : 0.0;
+
+  auto plot = [&](int x, int y, double a) {
+    if (steep)
+      blend(im, y, x, a, c);
+    else
+      blend(im, x, y, a, c);
+  };
+
+  /* first end */
+  double xEnd = std::round(x0), yEnd = y0 + grad * (xEnd - x0);
+  double xGap = rfPart(x0 + 0.5);
+  int ix = int(xEnd), iy = iPart(yEnd);
+  plot(ix, iy, rfPart(yEnd) * xGap);
+  plot(ix, iy + 1, fPart(yEnd) * xGap);
+
+  double intery = yEnd + grad;
+
+  /* second end */
+  xEnd = std::round(x1);
+  yEnd = y1 + grad * (xEnd - x1);
+  xGap = fPart(x1 + 0.5);
+  int ix2 = int(xEnd), iy2 = iPart(yEnd);
+  plot(ix2, iy2, rfPart(yEnd) * xGap);
+  plot(ix2, iy2 + 1, fPart(yEnd) * xGap);
+
+  /* main loop */
+  for (int x = ix + 1; x < ix2; ++x) {
+    plot(x, iPart(intery), rfPart(intery));
+    plot(x, iPart(intery) + 1, fPart(intery));
+    intery += grad;
+  }
+}
+
+/* ---------- Mid‑point circle (aliased) ------------------------------- */
+void drawCircleMidpoint(QImage &im, int xc, int yc, int r, const QColor &col) {
+  int x = 0, y = r, d = 1 - r;
+  while (x <= y) {
+    setPixelSafe(im, xc + x, yc + y, col);
+    setPixelSafe(im, xc - x, yc + y, col);
+    setPixelSafe(im, xc + x, yc - y, col);
+    setPixelSafe(im, xc - x, yc - y, col);
+    setPixelSafe(im, xc + y, yc + x, col);
+    setPixelSafe(im, xc - y, yc + x, col);
+    setPixelSafe(im, xc + y, yc - x, col);
+    setPixelSafe(im, xc - y, yc - x, col);
+    if (d < 0)
+      d += 2 * x + 3;
+    else {
+      d += 2 * (x - y) + 5;
+      --y;
+    }
+    ++x;
+  }
+}
+
+/* ---------- Xiaolin‑Wu anti‑aliased circle --------------------------- */
+static inline void circlePlot(QImage &im, int xc, int yc, int x, int y,
+                              double a, const QColor &c) {
+  blend(im, xc + x, yc + y, a, c);
+  blend(im, xc - x, yc + y, a, c);
+  blend(im, xc + x, yc - y, a, c);
+  blend(im, xc - x, yc - y, a, c);
+  blend(im, xc + y, yc + x, a, c);
+  blend(im, xc - y, yc + x, a, c);
+  blend(im, xc + y, yc - x, a, c);
+  blend(im, xc - y, yc - x, a, c);
+}
+
+void drawCircleWu(QImage &im, int xc, int yc, int r, const QColor &col) {
+  if (r <= 0)
+    return;
+  double x = r, y = 0.0;
+  double err = 0.0;
+
+  while (x >= y) {
+    double xReal = std::sqrt(r * r - y * y);
+    double xCeil = std::ceil(xReal);
+    double D = xCeil - xReal;
+
+    circlePlot(im, xc, yc, int(xCeil), int(y), 1.0 - D, col);
+    circlePlot(im, xc, yc, int(xCeil) - 1, int(y), D, col);
+
+    ++y;
+  }
+}
+
+/* ---------- Half-circle --------------------------- */
+static inline bool outsideHalf(int x, int y, int xc, int yc, double nx,
+                               double ny) {
+  return (x - xc) * nx + (y - yc) * ny >= 0;
+}
+
+/* Mid-point (aliased) */
+void drawHalfCircleMidpoint(QImage &im, int xc, int yc, int r, double nx,
+                            double ny, const QColor &col) {
+  int x = 0, y = r, d = 1 - r;
+  while (x <= y) {
+    auto trySet = [&](int px, int py) {
+      if (outsideHalf(px, py, xc, yc, nx, ny))
+        setPixelSafe(im, px, py, col);
+    };
+    trySet(xc + x, yc + y);
+    trySet(xc - x, yc + y);
+    trySet(xc + x, yc - y);
+    trySet(xc - x, yc - y);
+    trySet(xc + y, yc + x);
+    trySet(xc - y, yc + x);
+    trySet(xc + y, yc - x);
+    trySet(xc - y, yc - x);
+
+    d < 0 ? d += 2 * x + 3 : (d += 2 * (x - y) + 5, --y);
+    ++x;
+  }
+}
+
+/* Wu (antialiased)*/
+static inline void halfCirclePlotAA(QImage &im, int xc, int yc, int x, int y,
+                                    double a, double nx, double ny,
+                                    const QColor &c) {
+  auto tryBlend = [&](int px, int py, double alpha) {
+    if ((px - xc) * nx + (py - yc) * ny >= 0)
+      blend(im, px, py, alpha, c);
+  };
+
+  tryBlend(xc + x, yc + y, a);
+  tryBlend(xc - x, yc + y, a);
+  tryBlend(xc + x, yc - y, a);
+  tryBlend(xc - x, yc - y, a);
+  tryBlend(xc + y, yc + x, a);
+  tryBlend(xc - y, yc + x, a);
+  tryBlend(xc + y, yc - x, a);
+  tryBlend(xc - y, yc - x, a);
+}
+
+void drawHalfCircleWu(QImage &im, int xc, int yc, int r, double nx, double ny,
+                      const QColor &col) {
+  if (r <= 0)
+    return;
+
+  for (int y = 0; y <= r; ++y) {
+    /* exactly the same math as the full-circle Wu */
+    double xReal = std::sqrt(r * r - y * y);
+    int xInt = int(std::floor(xReal));
+    double D = xReal - xInt; // fractional part
+
+    /* left pixel (xInt) gets weight 1-D, right one (xInt+1) gets D */
+    halfCirclePlotAA(im, xc, yc, xInt + 1, y, D, nx, ny, col);
+    halfCirclePlotAA(im, xc, yc, xInt, y, 1.0 - D, nx, ny, col);
+  }
+}
+
+/* ---------- free‑hand ------------------------------------------------- */
+void drawFreehandPen(QImage &im, const QVector<QPoint> &pts,
+                     const QColor &col) {
+  for (int i = 1; i < pts.size(); ++i)
+    drawLineDDA(im, pts[i - 1].x(), pts[i - 1].y(), pts[i].x(), pts[i].y(),
+                col);
+}
+
+/* ================================================================ */
+/* Edge-Table Scan-line fill                                   */
+/* ================================================================ */
+struct EdgeRec {
+  int yMax;
+  double x, invSlope;
+};
+
+static void bucketSortEdges(const QVector<QPoint> &P,
+                            QVector<QVector<EdgeRec>> &ET, int &yMin,
+                            int &yMax) {
+  int n = P.size();
+  yMin = INT_MAX;
+  yMax = INT_MIN;
+  for (int i = 0; i < n; ++i) {
+    QPoint a = P[i], b = P[(i + 1) % n];
+    if (a.y() == b.y())
+      continue;
+    if (a.y() > b.y())
+      std::swap(a, b);
+
+    EdgeRec e;
+    e.yMax = b.y();
+    e.x = a.x();
+    e.invSlope = double(b.x() - a.x()) / double(b.y() - a.y());
+
+    int k = a.y();
+    if (k < yMin)
+      yMin = k;
+    if (e.yMax > yMax)
+      yMax = e.yMax;
+    if (k >= 0 && k < ET.size())
+      ET[k].append(e);
+  }
+}
+
+static void scanlineFill(QImage &img, const QVector<QPoint> &P,
+                         const QColor *colour, const QImage *pattern) {
+  if (P.size() < 3)
+    return;
+  int H = img.height();
+  QVector<QVector<EdgeRec>> ET(H);
+  int yMin, yMax;
+  bucketSortEdges(P, ET, yMin, yMax);
+
+  QVector<EdgeRec> AET;
+
+  for (int y = yMin; y <= yMax; ++y) {
+    AET += ET[y];
+
+    for (int i = AET.size() - 1; i >= 0; --i)
+      if (AET[i].yMax == y)
+        AET.removeAt(i);
+
+    std::sort(AET.begin(), AET.end(),
+              [](const EdgeRec &a, const EdgeRec &b) { return a.x < b.x; });
+
+    for (int i = 0; i + 1 < AET.size(); i += 2) {
+      int x1 = int(std::ceil(AET[i].x));
+      int x2 = int(std::floor(AET[i + 1].x));
+      for (int x = x1; x <= x2; ++x) {
+        if (x < 0 || x >= img.width() || y < 0 || y >= H)
+          continue;
+        if (colour)
+          img.setPixel(x, y, colour->rgb());
+        else {
+          QRgb p = pattern->pixel(x % pattern->width(), y % pattern->height());
+          img.setPixel(x, y, p);
+        }
+      }
+    }
+
+    for (EdgeRec &e : AET)
+      e.x += e.invSlope;
+  }
+}
+
+/* --------------- Smith scan-line fill ------------------ */
+void fillSeedScanline(QImage &img, int sx, int sy, const QColor *fillCol,
+                      const QImage *pattern) {
+  if (sx < 0 || sy < 0 || sx >= img.width() || sy >= img.height())
+    return;
+
+  const QRgb target = img.pixel(sx, sy);
+  if ((fillCol && target == fillCol->rgb()) ||
+      (pattern &&
+       target == pattern->pixel(sx % pattern->width(), sy % pattern->height())))
+    return;
+
+  struct Span {
+    int xL, xR, y;
+  };
+  std::queue<Span> q;
+  q.push({sx, sx, sy});
+
+  auto isTarget = [&](int x, int y) {
+    return x >= 0 && x < img.width() && y >= 0 && y < img.height() &&
+           img.pixel(x, y) == target;
+  };
+
+  auto setPixel = [&](int x, int y) {
+    if (fillCol)
+      img.setPixel(x, y, fillCol->rgb());
+    else
+      img.setPixel(x, y,
+                   pattern->pixel(x % pattern->width(), y % pattern->height()));
+  };
+
+  while (!q.empty()) {
+    Span s = q.front();
+    q.pop();
+
+    int xL = s.xL, xR = s.xR, y = s.y;
+    while (xL - 1 >= 0 && isTarget(xL - 1, y))
+      --xL;
+    while (xR + 1 < img.width() && isTarget(xR + 1, y))
+      ++xR;
+
+    for (int x = xL; x <= xR; ++x)
+      setPixel(x, y);
+
+    for (int dir : {-1, +1}) {
+      int ny = y + dir;
+      int x = xL;
+      while (x <= xR) {
+        while (x <= xR && !isTarget(x, ny))
+          ++x;
+        int start = x;
+        while (x <= xR && isTarget(x, ny))
+          ++x;
+        if (start < x)
+          q.push({start, x - 1, ny});
+      }
+    }
+  }
+}
+
+void fillPolygonET(QImage &img, const QVector<QPoint> &P,
+                   const QColor &colour) {
+  scanlineFill(img, P, &colour, nullptr);
+}
+
+void fillPolygonET(QImage &img, const QVector<QPoint> &P,
+                   const QImage *pattern) {
+  scanlineFill(img, P, nullptr, pattern);
+}
+
+} // namespace reference
+} // namespace DrawingEngine
@@ -0,0 +1,103 @@
+#ifndef REFERENCEFILTERS_H
+#define REFERENCEFILTERS_H
+
+#include "ditheringandquantization.h"
+
+#include <QColor>
+#include <QImage>
+#include <QPoint>
+#include <QVector>
+
+/*
+ * Frozen, straightforward implementations of the image operations.
+ *
+ * These are kept exactly as the filters were first written, one pixel at a
+ * time through QImage::pixel/setPixel, and must not be optimized. The
+ * differential harness (bench/filters_diff.cpp) compares the optimized
+ * functions in Filters and DitheringAndQuantization, and the primitives of
+ * drawingengine.h, against them, so that performance work cannot silently
+ * change the output.
+ */
+
+namespace Filters {
+namespace reference {
+
+QImage invert(const QImage &image);
+QImage adjustBrightness(const QImage &image, int delta);
+QImage adjustContrast(const QImage &image, double factor);
+QImage adjustGamma(const QImage &image, double gammaValue);
+QImage applyConvolution(const QImage &image,
+                        const QVector<QVector<int>> &kernel, int divisor,
+                        int offset, int anchorX, int anchorY);
+QImage applyMedianFilter(const QImage &image, int kernelSize = 3);
+QImage applyErosionFilter(const QImage &image, int kernelSize = 3);
+QImage applyDilationFilter(const QImage &image, int kernelSize = 3);
+
+} // namespace reference
+} // namespace Filters
+
+namespace DitheringAndQuantization {
+namespace reference {
+
+QImage applyOrderedDithering(const QImage &image, int thresholdMapSize,
+                             int levelsPerChannel);
+QImage applyOrderedDitheringInYCbCr(const QImage &image, int thresholdMapSize,
+                                    int levelsY = 3);
+
+/**
+ * Popularity quantization. Colors of equal frequency are ordered by
+ * ascending QRgb value (a stable sort over the color map), which makes the
+ * palette deterministic.
+ */
+QImage applyPopularityQuantization(const QImage &image, int numColors);
+
+/**
+ * Error diffusion, scanning the whole image serially. Errors are integer
+ * numerators over the kernel divisor, divided with ties away from zero, so
+ * the result is exact rather than subject to float rounding.
+ */
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           int levelsPerChannel, bool serpentine = false);
+/**
+ * Error diffusion to the nearest palette color by exhaustive search; ties go
+ * to the lowest palette index.
+ */
+QImage applyErrorDiffusion(const QImage &image, DiffusionKernel kernel,
+                           const QVector<QRgb> &palette,
+                           bool serpentine = false);
+
+} // namespace reference
+} // namespace DitheringAndQuantization
+
+/* The drawing primitives of drawingengine.h, plotting every pixel through
+ * bounds-checked QImage::pixel/setPixel and blending in double precision. */
+namespace DrawingEngine {
+namespace reference {
+
+void drawLineDDA(QImage &img, int x0, int y0, int x1, int y1,
+                 const QColor &color);
+void drawLineWu(QImage &img, int x0, int y0, int x1, int y1,
+                const QColor &color);
+void drawCircleMidpoint(QImage &img, int xc, int yc, int r, const QColor &c);
+void drawCircleWu(QImage &img, int xc, int yc, int r, const QColor &col);
+void drawHalfCircleMidpoint(QImage &img, int xc, int yc, int r, double nx,
+                            double ny, const QColor &col);
+void drawHalfCircleWu(QImage &img, int xc, int yc, int r, double nx, double ny,
+                      const QColor &col);
+void drawFreehandPen(QImage &img, const QVector<QPoint> &points,
+                     const QColor &color);
+
+/**
+ * Edge-table polygon fill. Every vertex must lie on a row of the image: the
+ * edge table is indexed by row without a range check.
+ */
+void fillPolygonET(QImage &img, const QVector<QPoint> &P, const QColor &colour);
+void fillPolygonET(QImage &img, const QVector<QPoint> &P,
+                   const QImage *pattern);
+void fillSeedScanline(QImage &img, int sx, int sy, const QColor *fillCol,
+                      const QImage *pattern);
+
+} // namespace reference
+} // namespace DrawingEngine
+
+#endif // REFERENCEFILTERS_H
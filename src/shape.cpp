@@ -2,6 +2,8 @@
 #include "drawingengine.h"
 #include <QtMath>
 
+QList<RectangleShape *> gClipRects;
+
 /* -------- LineShape ---------------------------------------------------- */
 void LineShape::draw(QImage &im) const {
   auto drawThin = useAntiAlias ? drawLineWu : drawLineDDA;
@@ -66,8 +68,6 @@ void PolygonShape::draw(QImage &im) const {
         drawLineDDA(im, a.x(), a.y() + off, b.x(), b.y() + off, drawingColor);
     }
   }
-  extern QList<RectangleShape *> gClipRects;
-
   for (RectangleShape *R : gClipRects) {
     QRect rect(R->p1, R->p2);
     for (int i = 0; i < vertices.size(); ++i) {
@@ -3,6 +3,7 @@
 #include <QColor>
 #include <QDataStream>
 #include <QImage>
+#include <QList>
 #include <QPoint>
 #include <QVector>
 
@@ -109,4 +110,7 @@ public:
   int radius;
 };
 
+/* Rectangles that polygons are clipped against (Liang-Barsky preview). */
+extern QList<RectangleShape *> gClipRects;
+
 #endif
@@ -0,0 +1,405 @@
+#include "streaming.h"
+#include "bluenoise.h"
+#include "jobcontext.h"
+#include "rawimage.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QJsonArray>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+namespace Streaming {
+namespace {
+void setError(QString *error, const QString &message) {
+  if (error)
+    *error = message;
+}
+
+/* Binary PPM (P6) or PGM (P5) with a maxval of at most 255. Samples are
+ * rescaled to 0..255, since the output always declares a maxval of 255. */
+class PnmStripReader : public StripReader {
+public:
+  bool open(const QString &path, QString *error) {
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+      setError(error, QStringLiteral("cannot open %1").arg(path));
+      return false;
+    }
+    QByteArray magic = file.read(2);
+    int width = readHeaderInt(), height = readHeaderInt();
+    int maxval = readHeaderInt();
+    if ((magic != "P5" && magic != "P6") || width <= 0 || height <= 0 ||
+        maxval <= 0 || maxval > 255) {
+      setError(error, QStringLiteral("%1 is not an 8-bit binary PPM/PGM")
+                          .arg(path));
+      return false;
+    }
+    gray = magic == "P5";
+    imageSize = QSize(width, height);
+    scaled = maxval != 255;
+    // Samples above maxval are invalid; they saturate.
+    for (int v = 0; v < 256; ++v)
+      scale[v] = uchar(std::min(255, (v * 255 + maxval / 2) / maxval));
+    return true;
+  }
+
+  QSize size() const override { return imageSize; }
+
+  QImage readRows(int count) override {
+    const int width = imageSize.width();
+    const int channels = gray ? 1 : 3;
+    QImage rows(width, count,
+                gray ? QImage::Format_Grayscale8 : QImage::Format_RGB32);
+    QByteArray line(width * channels, Qt::Uninitialized);
+    for (int y = 0; y < count; ++y) {
+      if (file.read(line.data(), line.size()) != line.size())
+        return QImage();
+      uchar *in = reinterpret_cast<uchar *>(line.data());
+      if (scaled) {
+        for (int i = 0; i < line.size(); ++i)
+          in[i] = scale[in[i]];
+      }
+      if (gray) {
+        std::memcpy(rows.scanLine(y), in, width);
+      } else {
+        QRgb *out = reinterpret_cast<QRgb *>(rows.scanLine(y));
+        for (int x = 0; x < width; ++x, in += 3)
+          out[x] = qRgb(in[0], in[1], in[2]);
+      }
+    }
+    return rows;
+  }
+
+private:
+  /* Reads the next header number, skipping whitespace and comments. The
+   * single whitespace character after maxval is consumed as well. */
+  int readHeaderInt() {
+    char c = 0;
+    while (file.getChar(&c)) {
+      if (c == '#') {
+        while (file.getChar(&c) && c != '\n') {
+        }
+      } else if (!std::isspace(uchar(c))) {
+        break;
+      }
+    }
+    if (c < '0' || c > '9')
+      return -1;
+    int value = 0;
+    do {
+      value = value * 10 + (c - '0');
+      if (value > (1 << 24))
+        return -1;
+    } while (file.getChar(&c) && c >= '0' && c <= '9');
+    return value;
+  }
+
+  QFile file;
+  QSize imageSize;
+  bool gray = false;
+  bool scaled = false; ///< Whether maxval is below 255.
+  uchar scale[256];    ///< Sample value -> 0..255.
+};
+
+/* Any format whose image plugin can decode a clip rectangle. */
+class ClipRectStripReader : public StripReader {
+public:
+  bool open(const QString &path, QString *error) {
+    filePath = path;
+    QImageReader reader(path);
+    if (!reader.canRead()) {
+      setError(error, QStringLiteral("cannot read %1: %2")
+                          .arg(path, reader.errorString()));
+      return false;
+    }
+    if (!reader.supportsOption(QImageIOHandler::ClipRect) ||
+        !reader.supportsOption(QImageIOHandler::Size)) {
+      setError(error,
+               QStringLiteral("the %1 format cannot be decoded in strips; "
+                              "convert %2 to PPM/PGM first")
+                   .arg(QString::fromLatin1(reader.format()), path));
+      return false;
+    }
+    imageSize = reader.size();
+    return imageSize.isValid();
+  }
+
+  QSize size() const override { return imageSize; }
+
+  QImage readRows(int count) override {
+    QImageReader reader(filePath);
+    reader.setClipRect(QRect(0, nextRow, imageSize.width(), count));
+    QImage rows = reader.read();
+    if (rows.isNull() || rows.height() != count)
+      return QImage();
+    nextRow += count;
+    return rows.format() == QImage::Format_Grayscale8
+               ? rows
+               : rows.convertToFormat(QImage::Format_RGB32);
+  }
+
+private:
+  QString filePath;
+  QSize imageSize;
+  int nextRow = 0;
+};
+
+/* A memory-mapped ".rawimg"; only the rows being read are paged in. */
+class RawStripReader : public StripReader {
+public:
+  bool open(const QString &path, QString *error) {
+    image = RawImage::load(path, error);
+    return !image.isNull();
+  }
+
+  QSize size() const override { return image.size(); }
+
+  QImage readRows(int count) override {
+    QImage::Format format = image.format() == QImage::Format_Grayscale8
+                                ? QImage::Format_Grayscale8
+                                : QImage::Format_RGB32;
+    QImage rows = image.copy(0, nextRow, image.width(), count)
+                      .convertToFormat(format);
+    nextRow += count;
+    return rows;
+  }
+
+private:
+  QImage image;
+  int nextRow = 0;
+};
+
+/* Writes binary PPM (P6) or PGM (P5) row by row. */
+class PnmStripWriter {
+public:
+  bool open(const QString &path, QSize size, QString *error) {
+    gray = QFileInfo(path).suffix().compare(QLatin1String("pgm"),
+                                            Qt::CaseInsensitive) == 0;
+    width = size.width();
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+      setError(error, QStringLiteral("cannot write %1").arg(path));
+      return false;
+    }
+    QByteArray header = QStringLiteral("%1\n%2 %3\n255\n")
+                            .arg(gray ? "P5" : "P6")
+                            .arg(size.width())
+                            .arg(size.height())
+                            .toLatin1();
+    return file.write(header) == header.size();
+  }
+
+  /* Writes rows [first, first + count) of an RGB32 or Grayscale8 image. */
+  bool writeRows(const QImage &image, int first, int count) {
+    QByteArray line(width * (gray ? 1 : 3), Qt::Uninitialized);
+    for (int y = first; y < first + count; ++y) {
+      uchar *out = reinterpret_cast<uchar *>(line.data());
+      if (image.format() == QImage::Format_Grayscale8) {
+        const uchar *in = image.constScanLine(y);
+        for (int x = 0; x < width; ++x) {
+          if (gray) {
+            *out++ = in[x];
+          } else {
+            *out++ = in[x];
+            *out++ = in[x];
+            *out++ = in[x];
+          }
+        }
+      } else {
+        const QRgb *in =
+            reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+          if (gray) {
+            *out++ = uchar(qGray(in[x]));
+          } else {
+            *out++ = uchar(qRed(in[x]));
+            *out++ = uchar(qGreen(in[x]));
+            *out++ = uchar(qBlue(in[x]));
+          }
+        }
+      }
+      if (file.write(line) != line.size())
+        return false;
+    }
+    return true;
+  }
+
+  bool close() {
+    file.close();
+    return file.error() == QFileDevice::NoError;
+  }
+
+private:
+  QFile file;
+  int width = 0;
+  bool gray = false;
+};
+
+/* Copies rows of the same width and format. */
+void copyRows(const QImage &from, int fromRow, QImage &to, int toRow,
+              int count) {
+  const int bytes = std::min(from.bytesPerLine(), to.bytesPerLine());
+  for (int i = 0; i < count; ++i)
+    std::memcpy(to.scanLine(toRow + i), from.constScanLine(fromRow + i),
+                bytes);
+}
+} // namespace
+
+std::unique_ptr<StripReader> StripReader::open(const QString &path,
+                                               QString *error) {
+  QString suffix = QFileInfo(path).suffix().toLower();
+  if (suffix == QLatin1String("ppm") || suffix == QLatin1String("pgm") ||
+      suffix == QLatin1String("pnm")) {
+    auto reader = std::make_unique<PnmStripReader>();
+    if (!reader->open(path, error))
+      return nullptr;
+    return reader;
+  }
+  if (RawImage::isRawImage(path)) {
+    auto reader = std::make_unique<RawStripReader>();
+    if (!reader->open(path, error))
+      return nullptr;
+    return reader;
+  }
+  auto reader = std::make_unique<ClipRectStripReader>();
+  if (!reader->open(path, error))
+    return nullptr;
+  return reader;
+}
+
+int halo(const Operations::Operation &op) {
+  const QString &t = op.type;
+  if (t == QLatin1String("blur") || t == QLatin1String("gauss") ||
+      t == QLatin1String("sharpen") || t == QLatin1String("edge") ||
+      t == QLatin1String("emboss"))
+    return 1;
+  if (t == QLatin1String("conv")) {
+    int rows = op.params["kernel"].toArray().size();
+    int anchorY = op.params["anchorY"].toInt();
+    return std::max(std::abs(anchorY), std::abs(rows - 1 - anchorY));
+  }
+  if (t == QLatin1String("median") || t == QLatin1String("erode") ||
+      t == QLatin1String("dilate"))
+    return std::max(0, op.params["size"].toInt()) / 2;
+  return 0;
+}
+
+int rowAlignment(const Operations::Operation &op) {
+  if (op.type == QLatin1String("dither") ||
+      op.type == QLatin1String("dither-ycbcr"))
+    return std::max(1, op.params["mapSize"].toInt());
+  if (op.type == QLatin1String("dither-bluenoise"))
+    return BlueNoise::MaskSize;
+  return 1;
+}
+
+bool canStream(const QVector<Operations::Operation> &ops, QString *reason) {
+  for (const Operations::Operation &op : ops) {
+    if (!Operations::types().contains(op.type) ||
+        op.type == QLatin1String("diffuse") ||
+        op.type == QLatin1String("popularity") ||
+        op.type == QLatin1String("mediancut") ||
+        op.type == QLatin1String("octree") ||
+        op.type == QLatin1String("kmeans") ||
+        op.type == QLatin1String("equalize") ||
+        op.type == QLatin1String("clahe")) {
+      setError(reason, QStringLiteral("%1 needs the whole image and cannot "
+                                      "be streamed")
+                           .arg(Operations::describe(op)));
+      return false;
+    }
+  }
+  return true;
+}
+
+bool isOutputFormat(const QString &format) {
+  return format.isEmpty() ||
+         format.compare(QLatin1String("ppm"), Qt::CaseInsensitive) == 0 ||
+         format.compare(QLatin1String("pgm"), Qt::CaseInsensitive) == 0;
+}
+
+bool processFile(const QString &input, const QString &output,
+                 const QVector<Operations::Operation> &ops, int stripRows,
+                 QString *error, QSize *imageSize) {
+  if (!canStream(ops, error))
+    return false;
+  std::unique_ptr<StripReader> reader = StripReader::open(input, error);
+  if (!reader)
+    return false;
+  const QSize size = reader->size();
+  const int height = size.height();
+  if (imageSize)
+    *imageSize = size;
+
+  // Halos add up along the chain: each operation needs its own halo of
+  // correct rows from the previous one.
+  int totalHalo = 0, alignment = 1;
+  for (const Operations::Operation &op : ops) {
+    totalHalo += halo(op);
+    alignment = std::lcm(alignment, rowAlignment(op));
+  }
+  const int strip =
+      (std::max(stripRows, 1) + alignment - 1) / alignment * alignment;
+
+  PnmStripWriter writer;
+  if (!writer.open(output, size, error))
+    return false;
+
+  // The window holds input rows [windowBegin, windowEnd); consecutive
+  // windows overlap by the halo, which is copied rather than re-read.
+  QImage window;
+  int windowBegin = 0, windowEnd = 0;
+  for (int y0 = 0; y0 < height; y0 += strip) {
+    const int y1 = std::min(height, y0 + strip);
+    int begin = std::max(0, y0 - totalHalo) / alignment * alignment;
+    int end = std::min(height, y1 + totalHalo);
+
+    const int reuse = std::max(0, windowEnd - begin);
+    QImage fresh;
+    if (end > windowEnd) {
+      fresh = reader->readRows(end - windowEnd);
+      if (fresh.isNull()) {
+        setError(error, QStringLiteral("read error in %1").arg(input));
+        return false;
+      }
+    }
+    QImage::Format format = window.isNull() ? fresh.format() : window.format();
+    QImage next(size.width(), end - begin, format);
+    if (reuse > 0)
+      copyRows(window, begin - windowBegin, next, 0, reuse);
+    if (!fresh.isNull())
+      copyRows(fresh.convertToFormat(format), 0, next, reuse, fresh.height());
+
+    QImage result = Operations::applyAll(next, ops);
+    if (!result.isNull() && result.format() != QImage::Format_Grayscale8)
+      result = result.convertToFormat(QImage::Format_RGB32);
+    if (result.isNull()) {
+      setError(error, JobContext::cancellationRequested()
+                          ? QStringLiteral("cancelled")
+                          : QStringLiteral("processing failed"));
+      return false;
+    }
+    if (!writer.writeRows(result, y0 - begin, y1 - y0)) {
+      setError(error, QStringLiteral("write error in %1").arg(output));
+      return false;
+    }
+
+    window = next;
+    windowBegin = begin;
+    windowEnd = end;
+  }
+
+  if (!writer.close()) {
+    setError(error, QStringLiteral("write error in %1").arg(output));
+    return false;
+  }
+  return true;
+}
+
+} // namespace Streaming
@@ -0,0 +1,109 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include "operations.h"
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+/**
+ * @namespace Streaming
+ * @brief Strip-wise processing of images too large to hold in memory.
+ *
+ * The image is read from top to bottom in strips of rows. Each strip is
+ * extended by a halo of neighbouring rows that the operations need (e.g. the
+ * kernel radius of a convolution), the operation chain is applied to it, and
+ * the rows of the strip itself are written straight to the output file. Peak
+ * memory is proportional to width * (strip + halo) rather than to the image.
+ *
+ * Since the halo rows are real image rows and strips touching the top or
+ * bottom edge end where the image ends, the output is identical to
+ * processing the whole image at once. Ordered dithering depends on the row
+ * index modulo the threshold map size, so strips start on multiples of it.
+ *
+ * Binary PPM/PGM files (P6/P5, 8 bits; a maxval below 255 is rescaled) are
+ * read and written truly sequentially, and ".rawimg" files (see RawImage)
+ * are read through their mapping. Other input formats are decoded strip by
+ * strip through QImageReader's clip rectangle when the format's plugin
+ * supports it (e.g. JPEG); this bounds memory but may decode the file once
+ * per strip.
+ * Output is always written as PPM, or PGM for a ".pgm" file name.
+ */
+namespace Streaming {
+
+/**
+ * @brief Reads an image sequentially, a number of rows at a time.
+ */
+class StripReader {
+public:
+  virtual ~StripReader() = default;
+
+  /** @brief The size of the whole image. */
+  virtual QSize size() const = 0;
+
+  /**
+   * @brief Reads the next rows.
+   * @param count Number of rows; must not exceed the rows left.
+   * @return The rows as an RGB32 or Grayscale8 image, or a null image on a
+   * read error.
+   */
+  virtual QImage readRows(int count) = 0;
+
+  /**
+   * @brief Opens a reader for the file.
+   * @return The reader, or nullptr with a message in @p error if the file
+   * cannot be read strip-wise.
+   */
+  static std::unique_ptr<StripReader> open(const QString &path,
+                                           QString *error = nullptr);
+};
+
+/**
+ * @brief Returns the number of rows above and below a row that the
+ * operation reads to compute it.
+ */
+int halo(const Operations::Operation &op);
+
+/**
+ * @brief Returns the row period the operation's output depends on, e.g. the
+ * threshold map size for ordered dithering, or 1.
+ */
+int rowAlignment(const Operations::Operation &op);
+
+/**
+ * @brief Returns true if the operations only depend on a bounded
+ * neighbourhood of each row; global ones such as popularity quantization
+ * and histogram equalization cannot be streamed.
+ */
+bool canStream(const QVector<Operations::Operation> &ops,
+               QString *reason = nullptr);
+
+/**
+ * @brief Returns true if processFile() can write the output format: "ppm"
+ * or "pgm" in any case, or empty for PPM.
+ */
+bool isOutputFormat(const QString &format);
+
+/**
+ * @brief Applies the operations to a file strip by strip.
+ *
+ * Runs on the calling thread and honours the calling thread's JobContext.
+ *
+ * @param input The input file.
+ * @param output The output file (PPM, or PGM for a ".pgm" name).
+ * @param ops The operations, applied in order.
+ * @param stripRows The number of output rows produced per strip. Rounded up
+ * to the row alignment of the operations.
+ * @param error Receives a message on failure.
+ * @param imageSize Receives the size of the input once it has been opened.
+ * @return true on success.
+ */
+bool processFile(const QString &input, const QString &output,
+                 const QVector<Operations::Operation> &ops, int stripRows = 256,
+                 QString *error = nullptr, QSize *imageSize = nullptr);
+
+} // namespace Streaming
+
+#endif // STREAMING_H
@@ -0,0 +1,259 @@
+#include "telemetry.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Telemetry {
+namespace detail {
+std::atomic<bool> enabled{false};
+} // namespace detail
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point origin = Clock::now();
+
+qint64 nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              origin)
+      .count();
+}
+
+/* Events of one thread. Only the owning thread writes; head is published
+ * with release semantics so that readers see completed slots. */
+struct Ring {
+  Event events[RingCapacity];
+  std::atomic<quint64> head{0};
+  int threadId = 0;
+};
+
+/* Rings are never freed: a thread that exits returns its ring to the free
+ * list, and the next thread that records continues it, with the same id.
+ * The number of rings is thus the peak number of threads recording at
+ * once (parallel loops start fresh threads on every pass), capped at
+ * MaxRings; threads beyond the cap are not recorded. */
+constexpr int MaxRings = 256;
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<Ring>> registry;
+std::vector<std::shared_ptr<Ring>> freeRings;
+std::atomic<qint64> clearedAtNs{-1};
+
+/* Per-thread recording state. The ring is acquired on the first event, so
+ * threads that never record cost nothing. */
+struct ThreadState {
+  std::shared_ptr<Ring> ring;
+  bool overCap = false;
+  int depth = 0;
+  bool bandOpen = false;
+  int bandStartRow = 0;
+  int lastRow = 0;
+  qint64 bandStartNs = 0;
+
+  ~ThreadState() {
+    if (!ring)
+      return;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    freeRings.push_back(std::move(ring));
+  }
+};
+
+thread_local ThreadState state;
+
+bool acquireRing() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (!freeRings.empty()) {
+    state.ring = std::move(freeRings.back());
+    freeRings.pop_back();
+  } else if (int(registry.size()) < MaxRings) {
+    auto ring = std::make_shared<Ring>();
+    ring->threadId = int(registry.size()) + 1;
+    registry.push_back(ring);
+    state.ring = std::move(ring);
+  } else {
+    state.overCap = true;
+  }
+  return !state.overCap;
+}
+
+void record(Event event) {
+  if (!state.ring && (state.overCap || !acquireRing()))
+    return;
+  Ring &ring = *state.ring;
+  quint64 head = ring.head.load(std::memory_order_relaxed);
+  event.threadId = ring.threadId;
+  ring.events[head % RingCapacity] = event;
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void closeBand(qint64 endNs) {
+  if (!state.bandOpen)
+    return;
+  state.bandOpen = false;
+  Event e;
+  e.name = "rows";
+  e.kind = Event::RowBand;
+  e.startNs = state.bandStartNs;
+  e.durationNs = endNs - state.bandStartNs;
+  e.rowBegin = state.bandStartRow;
+  e.rowEnd = state.lastRow + 1;
+  e.depth = state.depth;
+  record(e);
+}
+} // namespace
+
+void setEnabled(bool enabled) {
+  detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+ScopedTimer::ScopedTimer(const char *name, qint64 pixels)
+    : name(name), pixels(pixels), startNs(0), active(isEnabled()) {
+  if (!active)
+    return;
+  // Bands left open by an enclosing operation belong to it, not to us.
+  closeBand(nowNs());
+  ++state.depth;
+  startNs = nowNs();
+}
+
+ScopedTimer::~ScopedTimer() {
+  if (!active)
+    return;
+  qint64 endNs = nowNs();
+  closeBand(endNs);
+  --state.depth;
+  Event e;
+  e.name = name;
+  e.kind = Event::Operation;
+  e.startNs = startNs;
+  e.durationNs = endNs - startNs;
+  e.pixels = pixels;
+  e.threads = threads;
+  e.depth = state.depth;
+  record(e);
+}
+
+BandTimer::BandTimer(int rowBegin, int rowEnd)
+    : rowBegin(rowBegin), rowEnd(rowEnd), startNs(0), active(isEnabled()) {
+  if (active)
+    startNs = nowNs();
+}
+
+BandTimer::~BandTimer() {
+  if (!active)
+    return;
+  Event e;
+  e.name = "rows";
+  e.kind = Event::RowBand;
+  e.startNs = startNs;
+  e.durationNs = nowNs() - startNs;
+  e.rowBegin = rowBegin;
+  e.rowEnd = rowEnd;
+  e.depth = state.depth;
+  record(e);
+}
+
+void rowBand(int row, int rows) {
+  int band = std::max(1, rows / RowBands);
+  if (row % band == 0) {
+    qint64 now = nowNs();
+    closeBand(now);
+    state.bandOpen = true;
+    state.bandStartRow = row;
+    state.bandStartNs = now;
+  }
+  state.lastRow = row;
+}
+
+QVector<Event> snapshot() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    rings = registry;
+  }
+
+  qint64 cleared = clearedAtNs.load(std::memory_order_relaxed);
+  QVector<Event> events;
+  for (const auto &ring : rings) {
+    quint64 head = ring->head.load(std::memory_order_acquire);
+    quint64 first = head > quint64(RingCapacity) ? head - RingCapacity : 0;
+    QVector<Event> copied;
+    copied.reserve(int(head - first));
+    for (quint64 i = first; i < head; ++i)
+      copied.append(ring->events[i % RingCapacity]);
+
+    // Slots the writer may have reused during the copy are unreliable.
+    quint64 after = ring->head.load(std::memory_order_acquire);
+    for (quint64 i = first; i < head; ++i) {
+      if (i + RingCapacity <= after)
+        continue;
+      const Event &e = copied[int(i - first)];
+      if (e.startNs > cleared)
+        events.append(e);
+    }
+  }
+
+  std::sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+    return a.startNs < b.startNs;
+  });
+  return events;
+}
+
+void clear() { clearedAtNs.store(nowNs(), std::memory_order_relaxed); }
+
+bool writeChromeTrace(const QString &path) {
+  const QVector<Event> events = snapshot();
+  QJsonArray trace;
+  QVector<int> threadIds;
+
+  for (const Event &e : events) {
+    QJsonObject entry;
+    entry["name"] = QString::fromLatin1(e.name);
+    entry["cat"] = e.kind == Event::RowBand ? "rows" : "operation";
+    entry["ph"] = "X";
+    entry["ts"] = e.startNs / 1000.0;
+    entry["dur"] = e.durationNs / 1000.0;
+    entry["pid"] = 1;
+    entry["tid"] = e.threadId;
+    QJsonObject args;
+    if (e.kind == Event::RowBand) {
+      args["rowBegin"] = e.rowBegin;
+      args["rowEnd"] = e.rowEnd;
+    } else {
+      args["pixels"] = double(e.pixels);
+      args["threads"] = e.threads;
+    }
+    entry["args"] = args;
+    trace.append(entry);
+    if (!threadIds.contains(e.threadId))
+      threadIds.append(e.threadId);
+  }
+
+  for (int tid : threadIds) {
+    QJsonObject meta;
+    meta["name"] = "thread_name";
+    meta["ph"] = "M";
+    meta["pid"] = 1;
+    meta["tid"] = tid;
+    meta["args"] = QJsonObject{{"name", QString("Thread %1").arg(tid)}};
+    trace.append(meta);
+  }
+
+  QJsonObject root;
+  root["traceEvents"] = trace;
+  root["displayTimeUnit"] = "ms";
+
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  return file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) >= 0;
+}
+
+} // namespace Telemetry
@@ -0,0 +1,130 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <atomic>
+
+/**
+ * @namespace Telemetry
+ * @brief Lightweight timing instrumentation for filters and rendering.
+ *
+ * Scoped timers record events into a ring buffer owned by the recording
+ * thread, so recording never takes a lock. When a thread exits, its ring
+ * (and its events) are handed on to the next thread that records, so memory
+ * stays bounded by the number of threads recording at once. Row loops
+ * additionally record one event per band of rows through
+ * JobContext::reportRow(). The recorded events can be inspected with
+ * snapshot() or written as a chrome://tracing JSON file.
+ *
+ * Recording is off by default. While it is disabled, a timer costs a single
+ * relaxed atomic load.
+ */
+namespace Telemetry {
+
+/**
+ * @brief One recorded time span.
+ */
+struct Event {
+  enum Kind { Operation, RowBand };
+
+  const char *name = nullptr; ///< Static string, e.g. "Filters::invert".
+  Kind kind = Operation;
+  qint64 startNs = 0;    ///< Start, relative to the first recorded event.
+  qint64 durationNs = 0;
+  qint64 pixels = 0;     ///< Pixels processed, 0 if not applicable.
+  int threads = 1;       ///< Threads the operation ran on.
+  int threadId = 0;      ///< Small id of the recording thread's ring; a
+                         ///< thread that exits passes it on.
+  int depth = 0;         ///< Nesting level of Operation events per thread.
+  int rowBegin = 0;      ///< First row of a RowBand event.
+  int rowEnd = 0;        ///< One past the last row of a RowBand event.
+};
+
+/** @brief Number of events kept per thread before the oldest are dropped. */
+constexpr int RingCapacity = 8192;
+
+/** @brief Rows are grouped into this many RowBand events per pass. */
+constexpr int RowBands = 16;
+
+namespace detail {
+extern std::atomic<bool> enabled;
+} // namespace detail
+
+void setEnabled(bool enabled);
+
+inline bool isEnabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Times the enclosing scope as an Operation event.
+ *
+ * The name must be a string literal (or otherwise outlive the recording).
+ */
+class ScopedTimer {
+public:
+  explicit ScopedTimer(const char *name, qint64 pixels = 0);
+  /** @brief Times an operation over every pixel of the given image. */
+  ScopedTimer(const char *name, const QImage &image)
+      : ScopedTimer(name, qint64(image.width()) * image.height()) {}
+  ~ScopedTimer();
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  /** @brief Records how many threads the timed operation used. */
+  void setThreads(int count) { threads = count; }
+
+private:
+  const char *name;
+  qint64 pixels;
+  qint64 startNs;
+  int threads = 1;
+  bool active;
+};
+
+/**
+ * @brief Times a band of rows processed as a unit, e.g. by a parallel loop.
+ */
+class BandTimer {
+public:
+  BandTimer(int rowBegin, int rowEnd);
+  ~BandTimer();
+  BandTimer(const BandTimer &) = delete;
+  BandTimer &operator=(const BandTimer &) = delete;
+
+private:
+  int rowBegin;
+  int rowEnd;
+  qint64 startNs;
+  bool active;
+};
+
+/**
+ * @brief Called once per row by row loops; records RowBand events. Only
+ * called while recording is enabled.
+ */
+void rowBand(int row, int rows);
+
+/**
+ * @brief Returns the recorded events of all threads, ordered by start time.
+ *
+ * Safe to call while other threads record. Events that are overwritten
+ * while being copied are dropped from the result.
+ */
+QVector<Event> snapshot();
+
+/** @brief Drops all recorded events. */
+void clear();
+
+/**
+ * @brief Writes the recorded events as a chrome://tracing JSON file.
+ * @return true on success.
+ */
+bool writeChromeTrace(const QString &path);
+
+} // namespace Telemetry
+
+#endif // TELEMETRY_H
@@ -0,0 +1,240 @@
+#include "tiledimageview.h"
+
+#include <QCache>
+#include <QCoreApplication>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPixmap>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr int TileSize = 256;
+constexpr int MaxLevel = 16;
+constexpr double MinZoom = 1.0 / 256;
+constexpr double MaxZoom = 64.0;
+constexpr int DefaultCacheKilobytes = 128 * 1024;
+
+struct TileKey {
+  qint64 image;
+  int level;
+  int tx;
+  int ty;
+
+  bool operator==(const TileKey &o) const {
+    return image == o.image && level == o.level && tx == o.tx && ty == o.ty;
+  }
+};
+
+inline size_t qHash(const TileKey &key, size_t seed = 0) {
+  return ::qHash(key.image, seed) ^ ::qHash((key.level << 28) ^
+                                            (key.tx << 14) ^ key.ty, seed);
+}
+
+/* Shared by all views; cost is in kilobytes. Cleared before the
+ * application object goes away, since pixmaps must not outlive it. */
+QCache<TileKey, QPixmap> &tileCache() {
+  static QCache<TileKey, QPixmap> *cache = nullptr;
+  if (!cache) {
+    cache = new QCache<TileKey, QPixmap>(DefaultCacheKilobytes);
+    if (QCoreApplication *app = QCoreApplication::instance())
+      QObject::connect(app, &QCoreApplication::aboutToQuit,
+                       [] { tileCache().clear(); });
+  }
+  return *cache;
+}
+
+/* The level whose point-sampling step 2^level is the largest not above
+ * 1 / zoom, so tiles are never magnified by more than 2x on screen when
+ * zoomed out. */
+int levelForZoom(double zoom) {
+  if (zoom >= 1.0)
+    return 0;
+  return std::min(MaxLevel, int(std::floor(std::log2(1.0 / zoom))));
+}
+} // namespace
+
+TiledImageView::TiledImageView(QWidget *parent) : QWidget(parent) {
+  setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+  setMouseTracking(false);
+  setCursor(Qt::OpenHandCursor);
+}
+
+void TiledImageView::setImage(const QImage &newImage) {
+  bool sameSize = newImage.size() == image.size();
+  image = newImage;
+  // A new image of the same size (e.g. a filter result) keeps the view.
+  if (fitting || !sameSize)
+    fitToView();
+  update();
+}
+
+void TiledImageView::setPlaceholderText(const QString &text) {
+  placeholder = text;
+  update();
+}
+
+void TiledImageView::setTileCacheSize(int kilobytes) {
+  tileCache().setMaxCost(kilobytes);
+}
+
+void TiledImageView::setView(double zoom, const QPointF &center) {
+  fitting = false;
+  zoomFactor = std::clamp(zoom, MinZoom, MaxZoom);
+  viewCenter = center;
+  clampCenter();
+  update();
+}
+
+void TiledImageView::fitToView() {
+  fitting = true;
+  if (image.isNull() || width() <= 0 || height() <= 0) {
+    zoomFactor = 1.0;
+  } else {
+    double fit = std::min(double(width()) / image.width(),
+                          double(height()) / image.height());
+    zoomFactor = std::clamp(std::min(1.0, fit), MinZoom, MaxZoom);
+  }
+  viewCenter = QPointF(image.width() / 2.0, image.height() / 2.0);
+  update();
+}
+
+QPointF TiledImageView::toImage(const QPointF &widgetPos) const {
+  return viewCenter +
+         (widgetPos - QPointF(width() / 2.0, height() / 2.0)) / zoomFactor;
+}
+
+void TiledImageView::clampCenter() {
+  viewCenter.setX(std::clamp(viewCenter.x(), 0.0, double(image.width())));
+  viewCenter.setY(std::clamp(viewCenter.y(), 0.0, double(image.height())));
+}
+
+QImage TiledImageView::renderTile(int level, int tx, int ty) const {
+  const int step = 1 << level;
+  const int span = TileSize * step;
+  const QRect area =
+      QRect(tx * span, ty * span, span, span).intersected(image.rect());
+  if (level == 0)
+    return image.copy(area);
+
+  // Point-sample the centre of every step x step block.
+  const int w = (area.width() + step - 1) / step;
+  const int h = (area.height() + step - 1) / step;
+  QImage tile(w, h, QImage::Format_ARGB32);
+  const QImage::Format format = image.format();
+  const QVector<QRgb> colorTable = image.colorTable();
+  for (int j = 0; j < h; ++j) {
+    int y = std::min(area.top() + j * step + step / 2, area.bottom());
+    QRgb *out = reinterpret_cast<QRgb *>(tile.scanLine(j));
+    const uchar *line = image.constScanLine(y);
+    for (int i = 0; i < w; ++i) {
+      int x = std::min(area.left() + i * step + step / 2, area.right());
+      if (format == QImage::Format_RGB32 || format == QImage::Format_ARGB32)
+        out[i] = reinterpret_cast<const QRgb *>(line)[x];
+      else if (format == QImage::Format_Grayscale8)
+        out[i] = qRgb(line[x], line[x], line[x]);
+      else if (format == QImage::Format_Indexed8)
+        out[i] = colorTable.value(line[x]);
+      else
+        out[i] = image.pixel(x, y);
+    }
+  }
+  return tile;
+}
+
+void TiledImageView::paintEvent(QPaintEvent *) {
+  QPainter p(this);
+  p.fillRect(rect(), palette().window());
+  if (image.isNull()) {
+    p.drawText(rect(), Qt::AlignCenter, placeholder);
+    return;
+  }
+
+  const int level = levelForZoom(zoomFactor);
+  const int span = TileSize << level;
+  const QRectF visible =
+      QRectF(toImage(QPointF(0, 0)), toImage(QPointF(width(), height())))
+          .intersected(QRectF(image.rect()));
+  if (visible.isEmpty())
+    return;
+
+  p.setRenderHint(QPainter::SmoothPixmapTransform, zoomFactor < 1.0);
+  const QPointF origin = QPointF(width() / 2.0, height() / 2.0) -
+                         viewCenter * zoomFactor;
+  const int tx0 = int(visible.left()) / span;
+  const int ty0 = int(visible.top()) / span;
+  const int tx1 = int(std::ceil(visible.right())) / span;
+  const int ty1 = int(std::ceil(visible.bottom())) / span;
+  QCache<TileKey, QPixmap> &cache = tileCache();
+
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      const QRect area =
+          QRect(tx * span, ty * span, span, span).intersected(image.rect());
+      if (area.isEmpty())
+        continue;
+      const TileKey key{image.cacheKey(), level, tx, ty};
+      QPixmap pixmap;
+      if (QPixmap *cached = cache.object(key)) {
+        pixmap = *cached;
+      } else {
+        pixmap = QPixmap::fromImage(renderTile(level, tx, ty));
+        int cost = int(qint64(pixmap.width()) * pixmap.height() * 4 / 1024);
+        cache.insert(key, new QPixmap(pixmap), std::max(1, cost));
+      }
+      QRectF target(origin + QPointF(area.topLeft()) * zoomFactor,
+                    QSizeF(area.size()) * zoomFactor);
+      p.drawPixmap(target, pixmap, QRectF(pixmap.rect()));
+    }
+  }
+}
+
+void TiledImageView::resizeEvent(QResizeEvent *) {
+  if (fitting)
+    fitToView();
+}
+
+void TiledImageView::wheelEvent(QWheelEvent *e) {
+  if (image.isNull())
+    return;
+  const QPointF cursor = e->position();
+  const QPointF anchor = toImage(cursor);
+  double zoom = std::clamp(zoomFactor * std::pow(1.0015, e->angleDelta().y()),
+                           MinZoom, MaxZoom);
+  // Keep the image point under the cursor in place.
+  QPointF center =
+      anchor - (cursor - QPointF(width() / 2.0, height() / 2.0)) / zoom;
+  setView(zoom, center);
+  emit viewChanged(zoomFactor, viewCenter);
+  e->accept();
+}
+
+void TiledImageView::mousePressEvent(QMouseEvent *e) {
+  if (e->button() == Qt::LeftButton) {
+    dragging = true;
+    lastMousePos = e->pos();
+    setCursor(Qt::ClosedHandCursor);
+  }
+}
+
+void TiledImageView::mouseMoveEvent(QMouseEvent *e) {
+  if (!dragging || image.isNull())
+    return;
+  QPointF delta = QPointF(e->pos() - lastMousePos) / zoomFactor;
+  lastMousePos = e->pos();
+  setView(zoomFactor, viewCenter - delta);
+  emit viewChanged(zoomFactor, viewCenter);
+}
+
+void TiledImageView::mouseReleaseEvent(QMouseEvent *e) {
+  if (e->button() == Qt::LeftButton) {
+    dragging = false;
+    setCursor(Qt::OpenHandCursor);
+  }
+}
+
+void TiledImageView::mouseDoubleClickEvent(QMouseEvent *) {
+  fitToView();
+  emit viewChanged(zoomFactor, viewCenter);
+}
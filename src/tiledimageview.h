@@ -0,0 +1,85 @@
+#ifndef TILEDIMAGEVIEW_H
+#define TILEDIMAGEVIEW_H
+
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QWidget>
+
+/**
+ * @brief The TiledImageView class
+ *
+ * Displays an image of any size with zoom and pan. Instead of converting the
+ * whole image into one pixmap, the view renders only the tiles that
+ * intersect the viewport, at a level of detail matching the zoom, and keeps
+ * them in an LRU cache shared by all views. Memory use is therefore bounded
+ * by the cache, and repainting after a pan or zoom converts only tiles that
+ * were not visible before.
+ *
+ * Levels below full resolution are point-sampled, so a tile costs the same
+ * whatever the zoom; the final fractional scaling is smoothed by QPainter.
+ * Indexed and grayscale images are shown as they are, expanded to 32 bits
+ * one tile at a time.
+ *
+ * Mouse wheel zooms around the cursor, dragging pans, double-click fits the
+ * image to the view. User changes are announced with viewChanged() so that
+ * several views can be kept in sync with setView().
+ */
+class TiledImageView : public QWidget {
+  Q_OBJECT
+public:
+  explicit TiledImageView(QWidget *parent = nullptr);
+
+  /**
+   * @brief Shows an image. The view keeps a shallow copy; tiles of images
+   * that are no longer shown age out of the cache.
+   */
+  void setImage(const QImage &image);
+
+  /** @brief Text shown while no image is set. */
+  void setPlaceholderText(const QString &text);
+
+  double zoom() const { return zoomFactor; }
+  QPointF center() const { return viewCenter; }
+
+  /** @brief Total cost limit of the shared tile cache, in kilobytes. */
+  static void setTileCacheSize(int kilobytes);
+
+public slots:
+  /**
+   * @brief Shows the given zoom and image point at the view's center,
+   * without emitting viewChanged().
+   */
+  void setView(double zoom, const QPointF &center);
+
+  /** @brief Fits the whole image into the view. */
+  void fitToView();
+
+signals:
+  /** @brief Emitted when the user zooms or pans. */
+  void viewChanged(double zoom, const QPointF &center);
+
+protected:
+  void paintEvent(QPaintEvent *) override;
+  void resizeEvent(QResizeEvent *) override;
+  void wheelEvent(QWheelEvent *) override;
+  void mousePressEvent(QMouseEvent *) override;
+  void mouseMoveEvent(QMouseEvent *) override;
+  void mouseReleaseEvent(QMouseEvent *) override;
+  void mouseDoubleClickEvent(QMouseEvent *) override;
+
+private:
+  QPointF toImage(const QPointF &widgetPos) const;
+  QImage renderTile(int level, int tx, int ty) const;
+  void clampCenter();
+
+  QImage image;
+  QString placeholder;
+  double zoomFactor = 1.0;
+  QPointF viewCenter;     ///< Image point shown at the widget's center.
+  bool fitting = true;    ///< Refit on resize until the user zooms or pans.
+  bool dragging = false;
+  QPoint lastMousePos;
+};
+
+#endif // TILEDIMAGEVIEW_H